@@ -0,0 +1,213 @@
+#include "execplan.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <alloca.h>
+#ifdef __GNUC__
+#include <strings.h>
+#define stricmp strcasecmp
+#endif
+
+typedef struct LoadInterval_s
+{
+	IniLoadSection_t* sect;
+	uint64_t start;
+	uint64_t end; //exclusive
+	int origIdx; //position in the ini
+	int group; //LOADs are only reordered within a group, every unsized LOAD is a group of its own
+	int execIdx; //position after reordering
+} LoadInterval_t;
+
+//file LOADs grouped by filename in ascending skip, raw sector LOADs after them by partition and lba
+static int compare_load_order(const void* a, const void* b)
+{
+	const LoadInterval_t* left = *(const LoadInterval_t* const*)a;
+	const LoadInterval_t* right = *(const LoadInterval_t* const*)b;
+	if (left->group != right->group)
+		return left->group - right->group;
+
+	const bool leftRaw = left->sect->filename == NULL;
+	const bool rightRaw = right->sect->filename == NULL;
+	if (leftRaw != rightRaw)
+		return leftRaw ? 1 : -1;
+
+	if (!leftRaw)
+	{
+		const int nameOrder = stricmp(left->sect->filename, right->sect->filename);
+		if (nameOrder != 0)
+			return nameOrder;
+		if (left->sect->skip != right->sect->skip)
+			return (left->sect->skip < right->sect->skip) ? -1 : 1;
+	}
+	else
+	{
+		if (left->sect->part != right->sect->part)
+			return (left->sect->part < right->sect->part) ? -1 : 1;
+		if (left->sect->lba != right->sect->lba)
+			return (left->sect->lba < right->sect->lba) ? -1 : 1;
+	}
+
+	//qsort isn't stable, keep ini order for everything else
+	return left->origIdx - right->origIdx;
+}
+
+static int compare_load_start(const void* a, const void* b)
+{
+	const LoadInterval_t* left = *(const LoadInterval_t* const*)a;
+	const LoadInterval_t* right = *(const LoadInterval_t* const*)b;
+	if (left->start != right->start)
+		return (left->start < right->start) ? -1 : 1;
+
+	return left->origIdx - right->origIdx;
+}
+
+//byStart holds non-overlapping intervals sorted by start, so their ends are sorted too
+static int last_overlapping_load(LoadInterval_t** byStart, int numIntervals, uint64_t start, uint64_t end)
+{
+	if (start >= end)
+		return -1;
+
+	int lo = 0;
+	int hi = numIntervals;
+	while (lo < hi)
+	{
+		const int mid = lo + (hi - lo) / 2;
+		if (byStart[mid]->end <= start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	int lastExecIdx = -1;
+	for (int i=lo; i<numIntervals && byStart[i]->start < end; i++)
+	{
+		if (byStart[i]->execIdx > lastExecIdx)
+			lastExecIdx = byStart[i]->execIdx;
+	}
+
+	return lastExecIdx;
+}
+
+int build_exec_plan(const IniParsedInfo_t* info, const uint64_t* loadSizes, ExecStep_t* outSteps, ErrPrintFunc printer)
+{
+	int numLoads = 0;
+	for (IniLoadSectionNode_t* nod=info->loads; nod!=NULL; nod=nod->next)
+		numLoads++;
+
+	LoadInterval_t* intervals = alloca(numLoads * sizeof(LoadInterval_t));
+	LoadInterval_t** byExec = alloca(numLoads * sizeof(LoadInterval_t*));
+	LoadInterval_t** byStart = alloca(numLoads * sizeof(LoadInterval_t*));
+	{
+		//a LOAD of unknown size could overlap anything, so it keeps its place relative to every other LOAD
+		int i = 0;
+		int group = 0;
+		for (IniLoadSectionNode_t* nod=info->loads; nod!=NULL; nod=nod->next, i++)
+		{
+			intervals[i].sect = &nod->curr;
+			intervals[i].start = nod->curr.dst;
+			intervals[i].end = (uint64_t)nod->curr.dst + loadSizes[i];
+			intervals[i].origIdx = i;
+			if (intervals[i].end > 0x100000000ull)
+			{
+				printer("LOAD '%s' of 0x%08x%08x bytes at 0x%08x would write past 4 GiB\n", nod->curr.sectname,
+					(uint32_t)(loadSizes[i] >> 32), (uint32_t)loadSizes[i], nod->curr.dst);
+				return -1;
+			}
+			if (loadSizes[i] == 0)
+			{
+				intervals[i].group = ++group;
+				group++;
+			}
+			else
+				intervals[i].group = group;
+			byExec[i] = &intervals[i];
+			byStart[i] = &intervals[i];
+		}
+	}
+
+	qsort(byExec, numLoads, sizeof(LoadInterval_t*), compare_load_order);
+	//unsized LOADs all run before the first COPY, just like when every LOAD ran before every COPY
+	int lastUnsized = -1;
+	uint64_t lowestUnsizedDst = UINT64_MAX;
+	for (int i=0; i<numLoads; i++)
+	{
+		byExec[i]->execIdx = i;
+		if (byExec[i]->start == byExec[i]->end)
+		{
+			lastUnsized = i;
+			if (byExec[i]->start < lowestUnsizedDst)
+				lowestUnsizedDst = byExec[i]->start;
+		}
+	}
+
+	//unsized LOADs can't be checked for overlaps, keep them out of the interval list
+	qsort(byStart, numLoads, sizeof(LoadInterval_t*), compare_load_start);
+	int numIntervals = 0;
+	for (int i=0; i<numLoads; i++)
+	{
+		if (byStart[i]->start == byStart[i]->end)
+			continue;
+
+		if (numIntervals > 0 && byStart[numIntervals-1]->end > byStart[i]->start)
+		{
+			const LoadInterval_t* prev = byStart[numIntervals-1];
+			printer("LOAD '%s' and LOAD '%s' both write to 0x%08x, refusing to guess which should win\n",
+				prev->sect->sectname, byStart[i]->sect->sectname, (uint32_t)byStart[i]->start);
+			return -1;
+		}
+		byStart[numIntervals++] = byStart[i];
+	}
+
+	//a COPY becomes ready once every LOAD touching its source or destination is done
+	int numSteps = 0;
+	int nextLoad = 0;
+	int minReadyAfter = lastUnsized;
+	for (IniCopySectionNode_t* nod=info->copies; nod!=NULL; nod=nod->next)
+	{
+		const IniCopySection_t* sect = &nod->curr;
+		uint32_t dstLen = sect->dstlen;
+		if (sect->compType == 0 && sect->srclen > dstLen)
+			dstLen = sect->srclen;
+
+		int readyAfter = last_overlapping_load(byStart, numIntervals, sect->src, (uint64_t)sect->src + sect->srclen);
+		const int dstReadyAfter = last_overlapping_load(byStart, numIntervals, sect->dst, (uint64_t)sect->dst + dstLen);
+		if (dstReadyAfter > readyAfter)
+			readyAfter = dstReadyAfter;
+		if (minReadyAfter > readyAfter)
+			readyAfter = minReadyAfter;
+
+		minReadyAfter = readyAfter;
+		while (nextLoad <= readyAfter)
+		{
+			outSteps[numSteps].type = EXEC_STEP_LOAD;
+			outSteps[numSteps].load = byExec[nextLoad++]->sect;
+			numSteps++;
+		}
+		outSteps[numSteps].type = EXEC_STEP_COPY;
+		outSteps[numSteps].copy = &nod->curr;
+		numSteps++;
+	}
+	while (nextLoad < numLoads)
+	{
+		outSteps[numSteps].type = EXEC_STEP_LOAD;
+		outSteps[numSteps].load = byExec[nextLoad++]->sect;
+		numSteps++;
+	}
+
+	for (IniBootSectionNode_t* nod=info->boots; nod!=NULL; nod=nod->next)
+	{
+		bool pcWritten = nod->curr.pc >= lowestUnsizedDst ||
+			last_overlapping_load(byStart, numIntervals, nod->curr.pc, (uint64_t)nod->curr.pc + 1) >= 0;
+		for (IniCopySectionNode_t* copyNod=info->copies; copyNod!=NULL && !pcWritten; copyNod=copyNod->next)
+		{
+			const IniCopySection_t* sect = &copyNod->curr;
+			const uint32_t dstLen = (sect->compType == 0 && sect->srclen > sect->dstlen) ? sect->srclen : sect->dstlen;
+			pcWritten = nod->curr.pc >= sect->dst && nod->curr.pc - sect->dst < dstLen;
+		}
+
+		if (!pcWritten)
+			printer("Warning, BOOT '%s' pc 0x%08x is not written by any LOAD or COPY\n", nod->curr.sectname, nod->curr.pc);
+	}
+
+	return numSteps;
+}
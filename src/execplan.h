@@ -0,0 +1,37 @@
+#ifndef _EXECPLAN_H_
+#define _EXECPLAN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "iniparse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { EXEC_STEP_LOAD, EXEC_STEP_COPY };
+
+typedef struct ExecStep_s
+{
+	int type;
+	union
+	{
+		IniLoadSection_t* load;
+		IniCopySection_t* copy;
+	};
+} ExecStep_t;
+
+//Orders the LOADs by file and offset so every file is read front to back, and moves each COPY up to right
+//after the last LOAD that writes its source or destination, keeping the COPYs in their original order.
+//loadSizes holds the bytes written at dst by each LOAD in list order, outSteps needs room for all LOADs and COPYs.
+//A size of 0 means unknown: that LOAD isn't moved past any other LOAD and runs before every COPY.
+//Returns the number of steps, or -1 if two LOADs write the same memory (their order would decide the result)
+//or a LOAD would write past the end of the 32-bit address space.
+int build_exec_plan(const IniParsedInfo_t* info, const uint64_t* loadSizes, ExecStep_t* outSteps, ErrPrintFunc printer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
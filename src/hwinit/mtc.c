@@ -3,7 +3,6 @@
 #include "lib/decomp.h"
 #include "lib/crc32.h"
 #include "lib/printk.h"
-#include "lib/heap.h"
 #include <string.h>
 
 typedef int bool;
@@ -12,111 +11,118 @@ typedef int bool;
 #include "minerva_tc/mtc/mtc.h"
 #include "minerva_tc/mtc/mtc_mc_emc_regs.h"
 
-extern size_t mtc_sdram_lzma_size;
-extern const char mtc_sdram_lzma[];
+extern size_t mtc_sdram_idx_size;
+extern const char mtc_sdram_idx[];
+
+//layout of the container built by the mtc_sdram_idx Makefile rule
+#define MTC_INDEX_MAGIC 0x4943544D //"MTCI"
+
+typedef struct
+{
+    u32 offset; //of the lzma stream, from start of container
+    u32 comp_size;
+    u32 decomp_size;
+    u32 crc;
+} mtc_index_entry_t;
+
+typedef struct
+{
+    u32 magic;
+    u32 num_entries;
+    mtc_index_entry_t entries[];
+} mtc_index_t;
 
 static mtc_config_t _current_config = {0};
-static u32 _current_table_crc = 0;
+//checksum of each table entry, so only the entries actually used need to be verified later
+#define MTC_MAX_TABLE_ENTRIES 32
+static u32 _table_entry_crcs[MTC_MAX_TABLE_ENTRIES] = {0};
 
-static bool _initialize_mtc_table()
+static bool _mtc_entry_intact(const emc_table_t* entry)
 {
-    const size_t mtc_tables_size = ulzman(mtc_sdram_lzma, mtc_sdram_lzma_size, NULL, 0);
-    if (mtc_tables_size > 0)
-    {
-#ifdef MTC_DEBUGGING
-        printk("[MTC_LOAD] Decompressing %u -> %u bytes of MTC tables...\n", mtc_sdram_lzma_size, mtc_tables_size);
-#endif
-        u8* decomp_buffer = malloc(mtc_tables_size);
-        
-#ifdef MTC_DEBUGGING
-        const u32 decomp_time_start = get_tmr_us();
-#endif
-        const size_t mtc_decomp_size = ulzman(mtc_sdram_lzma, mtc_sdram_lzma_size, decomp_buffer, mtc_tables_size);
-#ifdef MTC_DEBUGGING
-        const u32 decomp_time_end = get_tmr_us();
-#endif
-        if (mtc_decomp_size != mtc_tables_size)
-        {
-            printk("[MTC_LOAD] Error during lzma decompression, got %u instead of %u bytes out!\n", mtc_decomp_size, mtc_tables_size);
-            free(decomp_buffer);
-        }
-        else
-        {
-#ifdef MTC_DEBUGGING
-            printk("[MTC_LOAD] Decompression took %u us.\n", decomp_time_end - decomp_time_start);
-#endif
-            
-            u8 matchBuffer[0x40];
-            memcpy(matchBuffer, decomp_buffer, sizeof(matchBuffer));
+    const emc_table_t* mtcTable = _current_config.mtc_table;
+    if (mtcTable == NULL || entry < mtcTable || entry >= &mtcTable[_current_config.table_entries])
+        return false;
 
-            const u8* matchStart = &decomp_buffer[sizeof(matchBuffer)];
-            const u8* matchEnd = &decomp_buffer[mtc_tables_size];
+    return crc32b((unsigned char*)entry, sizeof(emc_table_t)) == _table_entry_crcs[entry - mtcTable];
+}
 
-            typedef struct
-            {
-                u32 start;
-                u32 len;
-            } ramEntry_t;
+static bool _initialize_mtc_table()
+{
+    const mtc_index_t* index = (const mtc_index_t*)mtc_sdram_idx;
+    if (mtc_sdram_idx_size < sizeof(mtc_index_t) || index->magic != MTC_INDEX_MAGIC ||
+        mtc_sdram_idx_size < sizeof(mtc_index_t) + index->num_entries * sizeof(mtc_index_entry_t))
+    {
+        printk("[MTC_LOAD] Invalid MTC table index!\n");
+        return false;
+    }
 
-            ramEntry_t entries[8];
-            memset(entries, 0, sizeof(entries));
+    _current_config.sdram_id = get_sdram_id();
+    if (_current_config.sdram_id >= index->num_entries)
+    {
+        printk("[MTC_LOAD] No MTC table for sdram id %u (have %u)\n", _current_config.sdram_id, index->num_entries);
+        return false;
+    }
 
-#ifdef MTC_DEBUGGING
-            const u32 search_time_start = get_tmr_us();
-#endif
-            u32 numEntries = 0;
-            while (matchStart < matchEnd)
-            {
-                if (memcmp(matchStart, matchBuffer, sizeof(matchBuffer)) == 0)
-                {
-                    entries[numEntries].len = (matchStart - decomp_buffer) - entries[numEntries].start;
-                    entries[++numEntries].start = (matchStart - decomp_buffer);
-                }
-                matchStart += sizeof(matchBuffer);
-            }
-            entries[numEntries].len = (matchEnd - decomp_buffer) - entries[numEntries].start;
-            numEntries++;
-#ifdef MTC_DEBUGGING
-            const u32 search_time_end = get_tmr_us();
-#endif
+    const mtc_index_entry_t* entry = &index->entries[_current_config.sdram_id];
+    if (entry->offset > mtc_sdram_idx_size || entry->comp_size > mtc_sdram_idx_size - entry->offset)
+    {
+        printk("[MTC_LOAD] MTC table %u extents out of bounds!\n", _current_config.sdram_id);
+        return false;
+    }
 
-            _current_config.sdram_id = get_sdram_id();
-            for (u32 i=0; i<numEntries; i++)
-            {
 #ifdef MTC_DEBUGGING
-                printk("[MTC_LOAD] \tentry(%u): %08x %08x", i, entries[i].start, entries[i].len);
+    printk("[MTC_LOAD] Decompressing %u -> %u bytes of MTC table %u...\n", entry->comp_size, entry->decomp_size, _current_config.sdram_id);
+    const u32 decomp_time_start = get_tmr_us();
 #endif
-                if (i == _current_config.sdram_id)
-                {
+    //only the table we need gets decompressed, straight to its final place
+    emc_table_t* mtcTable = (void*)(0x80000000);
+    const size_t mtc_decomp_size = ulzman(&mtc_sdram_idx[entry->offset], entry->comp_size, mtcTable, entry->decomp_size);
 #ifdef MTC_DEBUGGING
-                    printk(" <- CHOSEN");
+    const u32 decomp_time_end = get_tmr_us();
 #endif
-
-                    _current_config.mtc_table = (void*)(0x80000000);
-                    _current_config.table_entries = entries[i].len / sizeof(emc_table_t);
-                    _current_config.emc_2X_clk_src_is_pllmb = false;
-	                _current_config.fsp_for_src_freq = false;
-                    _current_config.train_ram_patterns = true;
-
-                    const size_t total_table_size = _current_config.table_entries * sizeof(emc_table_t);
-                    memcpy(_current_config.mtc_table, &decomp_buffer[entries[i].start], total_table_size);
-                    _current_table_crc = crc32b((unsigned char*)_current_config.mtc_table, total_table_size);
-                }
-                
+    if (mtc_decomp_size != entry->decomp_size)
+    {
+        printk("[MTC_LOAD] Error during lzma decompression, got %u instead of %u bytes out!\n", mtc_decomp_size, entry->decomp_size);
+        return false;
+    }
 #ifdef MTC_DEBUGGING
-                printk("\n");
+    printk("[MTC_LOAD] Decompression took %u us.\n", decomp_time_end - decomp_time_start);
 #endif
-            }
 
-            free(decomp_buffer);
-#ifdef MTC_DEBUGGING
-            printk("[MTC_LOAD] Finding entries took %u us.\n", search_time_end - search_time_start);
-#endif
-            return true;
-        }
+    const u32 table_entries = entry->decomp_size / sizeof(emc_table_t);
+    const size_t total_table_size = table_entries * sizeof(emc_table_t);
+    const u32 table_crc = crc32b((unsigned char*)mtcTable, total_table_size);
+    if (total_table_size != entry->decomp_size || table_crc != entry->crc)
+    {
+        printk("[MTC_LOAD] MTC table %u corrupted (crc32 0x%08x expected 0x%08x)!\n", _current_config.sdram_id, table_crc, entry->crc);
+        return false;
     }
+    if (table_entries > MTC_MAX_TABLE_ENTRIES)
+    {
+        printk("[MTC_LOAD] MTC table %u has too many entries (%u)!\n", _current_config.sdram_id, table_entries);
+        return false;
+    }
+
+    for (u32 i=0; i<table_entries; i++)
+        _table_entry_crcs[i] = crc32b((unsigned char*)&mtcTable[i], sizeof(emc_table_t));
+
+    _current_config.mtc_table = mtcTable;
+    _current_config.table_entries = table_entries;
+    _current_config.emc_2X_clk_src_is_pllmb = false;
+    _current_config.fsp_for_src_freq = false;
+    _current_config.train_ram_patterns = true;
+
+    return true;
+}
+
+int mtc_get_table_extent(u32* outStart, u32* outSize)
+{
+    if (_current_config.mtc_table == NULL)
+        return 0;
 
-    return false;
+    *outStart = (u32)_current_config.mtc_table;
+    *outSize = _current_config.table_entries * sizeof(emc_table_t);
+    return 1;
 }
 
 int mtc_perform_memory_training(int targetFreq)
@@ -126,14 +132,10 @@ int mtc_perform_memory_training(int targetFreq)
 
     const emc_table_t* mtcTable = _current_config.mtc_table;
     const u32 numEntries = _current_config.table_entries;    
-    const size_t mtcTableSize = numEntries * sizeof(emc_table_t);
 
     if (mtcTable == NULL || numEntries == 0)
         return 0;
 
-    if (crc32b((unsigned char*)mtcTable, mtcTableSize) != _current_table_crc)
-        return 0;
-
     const emc_table_t* currentTable = _current_config.current_emc_table;
     if (currentTable == NULL)
     {
@@ -152,6 +154,12 @@ int mtc_perform_memory_training(int targetFreq)
         }
         currentTable = &mtcTable[runningEntry];
     }
+
+    if (!_mtc_entry_intact(currentTable))
+    {
+        printk("[MTC] currently running entry is corrupted\n");
+        return 0;
+    }
     
 #ifdef MTC_DEBUGGING
     printk("[MTC] currently using entry for %d kHz: %s\n", currentTable->rate_khz, currentTable->dvfs_ver);
@@ -160,7 +168,7 @@ int mtc_perform_memory_training(int targetFreq)
 #ifdef MTC_SEPARATE_TRAINING
     for (u32 i=0; i<numEntries; i++) 
     {
-		if (&mtcTable[i] == currentTable) 
+		if (&mtcTable[i] == currentTable || !_mtc_entry_intact(&mtcTable[i])) 
             continue;
 
         _current_config.rate_from = currentTable->rate_khz;
@@ -182,6 +190,12 @@ int mtc_perform_memory_training(int targetFreq)
 		if (nextTable->periodic_training && targetFreq > 0)
 			break;
 
+        if (!_mtc_entry_intact(nextTable))
+        {
+            printk("[MTC] table entry %u is corrupted, not switching\n", nextTableIdx);
+            break;
+        }
+
         _current_config.rate_from = currentTable->rate_khz;
         _current_config.rate_to = nextTable->rate_khz;
 #ifdef MTC_SEPARATE_TRAINING
@@ -210,24 +224,16 @@ int mtc_perform_memory_training(int targetFreq)
 
 u32 mtc_redo_periodic_training(u32 lastPeriodicMs)
 {
-    const emc_table_t* mtcTable = _current_config.mtc_table;
-    const u32 numEntries = _current_config.table_entries;    
-    const size_t mtcTableSize = numEntries * sizeof(emc_table_t);
-
-    if (mtcTable == NULL || numEntries == 0)
-        return 0;
-
-    if (crc32b((unsigned char*)mtcTable, mtcTableSize) != _current_table_crc)
-        return 0;
-
-    const emc_table_t* currentTable = _current_config.current_emc_table;
-    if (currentTable == NULL)
-        return 0;
-
+    //this gets called in a tight loop, so bail out as cheaply as possible until it's time
     const u32 currTimeMs = get_tmr_ms();
     if (currTimeMs < (lastPeriodicMs + EMC_PERIODIC_TRAIN_MS))
         return lastPeriodicMs;
 
+    //periodic training goes from the current entry to itself, so that's the only one to verify
+    const emc_table_t* currentTable = _current_config.current_emc_table;
+    if (currentTable == NULL || !_mtc_entry_intact(currentTable))
+        return currTimeMs;
+
     _current_config.rate_from = currentTable->rate_khz;
     _current_config.rate_to = currentTable->rate_khz;
     _current_config.train_mode = OP_PERIODIC_TRAIN;
@@ -6,5 +6,7 @@
 int mtc_perform_memory_training(int targetFreq);
 //performs periodic training if the time interval since last one is greater than periodic training timeout
 u32 mtc_redo_periodic_training(u32 lastPeriodicMs);
+//where the decompressed MTC table sits once training has loaded it, returns 0 before that
+int mtc_get_table_extent(u32* outStart, u32* outSize);
 
 #endif
@@ -47,27 +47,124 @@ static int trim_trailing_whitespace(char* textBytes, const int maxLen)
 	return realLen;
 }
 
-static char* my_strdup(const char* srcString, AllocatorFunc allocator)
+static void* arena_alloc(IniArena_t* arena, size_t numBytes)
 {
-	if (srcString == NULL)
+	const size_t alignedUsed = (arena->used + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+	if (alignedUsed > arena->size || arena->size - alignedUsed < numBytes)
 		return NULL;
 
-	size_t srcLen = strlen(srcString);
-	char* dstString = (char*)allocator(srcLen+1);
-	memcpy(dstString, srcString, srcLen+1);
-	return dstString;
+	arena->used = alignedUsed + numBytes;
+	return arena->base + alignedUsed;
 }
 
-IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, AllocatorFunc allocator, ErrPrintFunc printer)
+//every section starts with a [, so counting them gives an upper bound without parsing
+static size_t count_max_sections(const char* iniBytes, const int numBytes)
+{
+	size_t numSections = 0;
+	for (int i=0; i<numBytes; i++)
+	{
+		if (iniBytes[i] == '[')
+			numSections++;
+	}
+
+	return numSections;
+}
+
+enum { SECTION_LOAD, SECTION_COPY, SECTION_BOOT };
+
+typedef struct IniSectionHashEntry_s
+{
+	const char* name; //NULL for empty slots
+	void* node;
+	int type;
+} IniSectionHashEntry_t;
+
+typedef struct IniSectionHash_s
+{
+	IniSectionHashEntry_t* entries;
+	size_t mask;
+} IniSectionHash_t;
+
+static size_t section_hash_capacity(size_t maxSections)
+{
+	//at most half full, so probe sequences stay short and there is always an empty slot
+	size_t capacity = 8;
+	while (capacity < maxSections*2)
+		capacity *= 2;
+
+	return capacity;
+}
+
+//section names are case insensitive, so hash them lowercased (FNV-1a)
+static uint32_t section_name_hash(const char* name, int type)
+{
+	uint32_t hash = 2166136261u ^ (uint32_t)type;
+	for (; *name != 0; name++)
+	{
+		char theChar = *name;
+		if (theChar >= 'A' && theChar <= 'Z')
+			theChar += 'a' - 'A';
+
+		hash = (hash ^ (uint8_t)theChar) * 16777619u;
+	}
+
+	return hash;
+}
+
+static IniSectionHashEntry_t* section_hash_find(IniSectionHash_t* table, const char* name, int type)
+{
+	size_t idx = section_name_hash(name, type) & table->mask;
+	for (;;)
+	{
+		IniSectionHashEntry_t* entry = &table->entries[idx];
+		if (entry->name == NULL || (entry->type == type && stricmp(entry->name, name) == 0))
+			return entry;
+
+		idx = (idx + 1) & table->mask;
+	}
+}
+
+size_t memloader_ini_arena_size(const char* iniBytes, const int numBytes)
+{
+	size_t maxNodeSize = sizeof(IniLoadSectionNode_t);
+	if (sizeof(IniCopySectionNode_t) > maxNodeSize)
+		maxNodeSize = sizeof(IniCopySectionNode_t);
+	if (sizeof(IniBootSectionNode_t) > maxNodeSize)
+		maxNodeSize = sizeof(IniBootSectionNode_t);
+
+	maxNodeSize = (maxNodeSize + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+	const size_t maxSections = count_max_sections(iniBytes, numBytes);
+	return maxSections * maxNodeSize + section_hash_capacity(maxSections) * sizeof(IniSectionHashEntry_t) + sizeof(void*);
+}
+
+IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, IniArena_t* arena, ErrPrintFunc printer)
 {
 	IniParsedInfo_t out;
+	memset(&out.globals, 0, sizeof(out.globals));
 	out.loads = NULL;
 	out.copies = NULL;
 	out.boots = NULL;
 
+	IniSectionHash_t sections;
+	{
+		const size_t capacity = section_hash_capacity(count_max_sections(iniBytes, numBytes));
+		sections.entries = arena_alloc(arena, capacity * sizeof(IniSectionHashEntry_t));
+		sections.mask = capacity - 1;
+		if (sections.entries == NULL)
+		{
+			printer("Arena of %u bytes too small for the ini section table\n", (unsigned int)arena->size);
+			return out;
+		}
+		memset(sections.entries, 0, capacity * sizeof(IniSectionHashEntry_t));
+	}
+
 	IniLoadSectionNode_t* currLoadNode = NULL;
 	IniCopySectionNode_t* currCopyNode = NULL;
 	IniBootSectionNode_t* currBootNode = NULL;
+	IniLoadSectionNode_t* lastLoadNode = NULL;
+	IniCopySectionNode_t* lastCopyNode = NULL;
+	IniBootSectionNode_t* lastBootNode = NULL;
+	bool inGlobalScope = true;
 
 	int currLine = -1;
 	int currPos = 0;	
@@ -93,7 +190,7 @@ IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, Allocato
 		currLine++;
 
 		//skip leading space
-		while (is_space(*currBytes) && lineLength > 0)
+		while (lineLength > 0 && is_space(*currBytes))
 		{
 			currBytes++;
 			lineLength--;
@@ -120,7 +217,7 @@ IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, Allocato
 			lineLength--;
 
 			//skip leading space
-			while (is_space(*currBytes) && lineLength > 0)
+			while (lineLength > 0 && is_space(*currBytes))
 			{
 				currBytes++;
 				lineLength--;
@@ -143,7 +240,7 @@ IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, Allocato
 			char* rightSide = currBytes+colonPos+1;
 			int rightSideLen = lineLength-colonPos-1;
 
-			while (is_space(*rightSide) && rightSideLen > 0)
+			while (rightSideLen > 0 && is_space(*rightSide))
 			{
 				rightSide++;
 				rightSideLen--;
@@ -161,99 +258,83 @@ IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, Allocato
 			currLoadNode = NULL;
 			currCopyNode = NULL;
 			currBootNode = NULL;
-			if (strnicmp(leftSide, "load", leftSideLen) == 0)
+			inGlobalScope = false;
+			int sectionType = -1;
+			if (leftSideLen > 0) //strnicmp would match anything otherwise
 			{
-				if (out.loads == NULL)
-				{
-					out.loads = allocator(sizeof(IniLoadSectionNode_t));
-					currLoadNode = out.loads;
-					memset(currLoadNode, 0, sizeof(IniLoadSectionNode_t));
-				}
-				else
+				if (strnicmp(leftSide, "load", leftSideLen) == 0)
+					sectionType = SECTION_LOAD;
+				else if (strnicmp(leftSide, "copy", leftSideLen) == 0)
+					sectionType = SECTION_COPY;
+				else if (strnicmp(leftSide, "boot", leftSideLen) == 0)
+					sectionType = SECTION_BOOT;
+			}
+
+			//repeated section names continue the existing section
+			IniSectionHashEntry_t* hashEntry = NULL;
+			void* newNode = NULL;
+			if (sectionType >= 0)
+			{
+				hashEntry = section_hash_find(&sections, rightSide, sectionType);
+				if (hashEntry->name == NULL)
 				{
-					IniLoadSectionNode_t* currNode = out.loads;
-					while (currNode->next != NULL) 
-					{ 
-						if (stricmp(currNode->curr.sectname, rightSide) == 0)
-						{
-							currLoadNode = currNode;
-							break;
-						}
-						currNode = currNode->next; 
-					}
-					if (currLoadNode == NULL)
+					static const size_t NODE_SIZES[] = { sizeof(IniLoadSectionNode_t), sizeof(IniCopySectionNode_t), sizeof(IniBootSectionNode_t) };
+					newNode = arena_alloc(arena, NODE_SIZES[sectionType]);
+					if (newNode == NULL)
 					{
-						currNode->next = allocator(sizeof(IniLoadSectionNode_t));
-						currLoadNode = currNode->next;
-						memset(currLoadNode, 0, sizeof(IniLoadSectionNode_t));
+						printer("Arena of %u bytes full at section '%s' on line %d, stopping\n", (unsigned int)arena->size, rightSide, currLine);
+						break;
 					}
-				}
+					memset(newNode, 0, NODE_SIZES[sectionType]);
 
-				if (currLoadNode->curr.sectname == NULL)
-					currLoadNode->curr.sectname = my_strdup(rightSide, allocator);
+					hashEntry->name = rightSide;
+					hashEntry->node = newNode;
+					hashEntry->type = sectionType;
+				}
 			}
-			else if (strnicmp(leftSide, "copy", leftSideLen) == 0)
+
+			if (sectionType == SECTION_LOAD)
 			{
-				if (out.copies == NULL)
+				currLoadNode = hashEntry->node;
+				if (newNode != NULL)
 				{
-					out.copies = allocator(sizeof(IniCopySectionNode_t));
-					currCopyNode = out.copies;
-					memset(currCopyNode, 0, sizeof(IniCopySectionNode_t));
+					currLoadNode->curr.sectname = rightSide;
+					if (lastLoadNode == NULL)
+						out.loads = currLoadNode;
+					else
+						lastLoadNode->next = currLoadNode;
+
+					lastLoadNode = currLoadNode;
 				}
-				else
+			}
+			else if (sectionType == SECTION_COPY)
+			{
+				currCopyNode = hashEntry->node;
+				if (newNode != NULL)
 				{
-					IniCopySectionNode_t* currNode = out.copies;
-					while (currNode->next != NULL)
-					{
-						if (stricmp(currNode->curr.sectname, rightSide) == 0)
-						{
-							currCopyNode = currNode;
-							break;
-						}
-						currNode = currNode->next;
-					}
-					if (currCopyNode == NULL)
-					{
-						currNode->next = allocator(sizeof(IniCopySectionNode_t));
-						currCopyNode = currNode->next;
-						memset(currCopyNode, 0, sizeof(IniCopySectionNode_t));
-					}
-				}
+					currCopyNode->curr.sectname = rightSide;
+					if (lastCopyNode == NULL)
+						out.copies = currCopyNode;
+					else
+						lastCopyNode->next = currCopyNode;
 
-				if (currCopyNode->curr.sectname == NULL)
-					currCopyNode->curr.sectname = my_strdup(rightSide, allocator);
+					lastCopyNode = currCopyNode;
+				}
 			}
-			else if (strnicmp(leftSide, "boot", leftSideLen) == 0)
+			else if (sectionType == SECTION_BOOT)
 			{
-				if (out.boots == NULL)
+				currBootNode = hashEntry->node;
+				if (newNode != NULL)
 				{
-					out.boots = allocator(sizeof(IniBootSectionNode_t));
-					currBootNode = out.boots;
-					memset(currBootNode, 0, sizeof(IniBootSectionNode_t));
+					currBootNode->curr.sectname = rightSide;
 					currBootNode->curr.pwroffHoldTime = -1;
+					if (lastBootNode == NULL)
+						out.boots = currBootNode;
+					else
+						lastBootNode->next = currBootNode;
+
+					lastBootNode = currBootNode;
 				}
-				else
-				{
-					IniBootSectionNode_t* currNode = out.boots;
-					while (currNode->next != NULL)
-					{
-						if (stricmp(currNode->curr.sectname, rightSide) == 0)
-						{
-							currBootNode = currNode;
-							break;
-						}
-						currNode = currNode->next;
-					}
-					if (currBootNode == NULL)
-					{
-						currNode->next = allocator(sizeof(IniBootSectionNode_t));
-						currBootNode = currNode->next;
-						memset(currBootNode, 0, sizeof(IniBootSectionNode_t));
-						currBootNode->curr.pwroffHoldTime = -1;
-					}
-				}
-				if (currBootNode->curr.sectname == NULL)
-					currBootNode->curr.sectname = my_strdup(rightSide, allocator);
 			}
 			else
 			{
@@ -275,11 +356,16 @@ IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, Allocato
 			char* leftSide = currBytes;
 			int leftSideLen = equalsPos;
 			leftSideLen = trim_trailing_whitespace(leftSide, leftSideLen);
+			if (leftSideLen == 0) //strnicmp would match the first key
+			{
+				printer("Empty key in kv pair on line %d, skipping\n", currLine);
+				continue;
+			}
 
 			//right side processing
 			char* rightSide = currBytes+equalsPos+1;
 			int rightSideLen = lineLength-equalsPos-1;
-			while (is_space(*rightSide) && rightSideLen > 0)
+			while (rightSideLen > 0 && is_space(*rightSide))
 			{
 				rightSide++;
 				rightSideLen--;
@@ -287,8 +373,8 @@ IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, Allocato
 
 			if (currLoadNode != NULL)
 			{
-				enum { KEY_INPUTFILE, KEY_SKIPBYTES, KEY_COUNTBYTES, KEY_DSTADDR, KEY_COUNT };
-				static const char* keyNames[KEY_COUNT] = { "if", "skip", "count", "dst" };
+				enum { KEY_INPUTFILE, KEY_SKIPBYTES, KEY_COUNTBYTES, KEY_DSTADDR, KEY_COMPTYPE, KEY_DSTLEN, KEY_LBA, KEY_SECTORS, KEY_PARTITION, KEY_COUNT };
+				static const char* keyNames[KEY_COUNT] = { "if", "skip", "count", "dst", "type", "dstlen", "lba", "sectors", "part" };
 
 				int currKey;
 				for (currKey=0; currKey<KEY_COUNT; currKey++)
@@ -303,7 +389,7 @@ IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, Allocato
 					continue;
 				}
 				else if (currKey == KEY_INPUTFILE)
-					currLoadNode->curr.filename = my_strdup(rightSide,allocator);
+					currLoadNode->curr.filename = rightSide;
 				else
 				{
 					char* outPos = NULL;
@@ -316,12 +402,24 @@ IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, Allocato
 						currLoadNode->curr.count = theValue;
 					else if (currKey == KEY_DSTADDR)
 						currLoadNode->curr.dst = theValue;
+					else if (currKey == KEY_COMPTYPE)
+						currLoadNode->curr.compType = theValue;
+					else if (currKey == KEY_DSTLEN)
+						currLoadNode->curr.dstlen = theValue;
+					else if (currKey == KEY_PARTITION && theValue > 4)
+						printer("Invalid value '%s' for LOAD section key '%s' on line %d, only MBR partitions 1-4 or 0 for the whole card are supported\n", rightSide, leftSide, currLine);
+					else if (currKey == KEY_LBA)
+						currLoadNode->curr.lba = theValue;
+					else if (currKey == KEY_SECTORS)
+						currLoadNode->curr.sectors = theValue;
+					else if (currKey == KEY_PARTITION)
+						currLoadNode->curr.part = (uint8_t)theValue;
 				}
 			}
 			else if (currCopyNode != NULL)
 			{
-				enum { KEY_COMPTYPE, KEY_SRCADDR, KEY_SRCLEN, KEY_DSTADDR, KEY_DSTLEN, KEY_COUNT };
-				static const char* keyNames[KEY_COUNT] ={ "type", "src", "srclen", "dst", "dstlen" };
+				enum { KEY_COMPTYPE, KEY_SRCADDR, KEY_SRCLEN, KEY_DSTADDR, KEY_DSTLEN, KEY_MARGIN, KEY_COUNT };
+				static const char* keyNames[KEY_COUNT] ={ "type", "src", "srclen", "dst", "dstlen", "margin" };
 				int currKey;
 				for (currKey=0; currKey<KEY_COUNT; currKey++)
 				{
@@ -350,6 +448,8 @@ IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, Allocato
 						currCopyNode->curr.dst = theValue;
 					else if (currKey == KEY_DSTLEN)
 						currCopyNode->curr.dstlen = theValue;
+					else if (currKey == KEY_MARGIN)
+						currCopyNode->curr.margin = theValue;
 				}
 			}
 			else if (currBootNode != NULL)
@@ -396,6 +496,34 @@ IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, Allocato
 						currBootNode->curr.maxMemoryFreq = (int16_t)theValue;
 				}
 			}
+			else if (inGlobalScope)
+			{
+				enum { KEY_EARLYMEMORYFREQ, KEY_COUNT };
+				static const char* keyNames[KEY_COUNT] ={ "earlyMemoryFreq" };
+				int currKey;
+				for (currKey=0; currKey<KEY_COUNT; currKey++)
+				{
+					if (strnicmp(leftSide, keyNames[currKey], leftSideLen) == 0)
+						break;
+				}
+
+				if (currKey == KEY_COUNT)
+				{
+					printer("Unknown global key '%s' on line %d, skipping\n", leftSide, currLine);
+					continue;
+				}
+				else if (currKey == KEY_EARLYMEMORYFREQ)
+				{
+					char* outPos = NULL;
+					int32_t theValue = strtol(rightSide, &outPos, 0);
+					if (outPos == NULL || outPos == rightSide)
+						printer("Invalid value '%s' for global key '%s' on line %d, skipping\n", rightSide, leftSide, currLine);
+					else if (theValue < -32768 || theValue > 32767)
+						printer("Value '%d' out of range for global key '%s' on line %d, skipping\n", theValue, leftSide, currLine);
+					else
+						out.globals.earlyMemoryFreq = (int16_t)theValue;
+				}
+			}
 			else
 			{
 				printer("Key '%s' outside of recognized section on line %d, skipping\n", leftSide, currLine);
@@ -406,53 +534,3 @@ IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, Allocato
 
 	return out;
 }
-
-void free_memloader_info(IniParsedInfo_t* infoPtr, DeallocatorFunc deallocator)
-{
-	if (infoPtr->loads != NULL)
-	{
-		IniLoadSectionNode_t* currNode = infoPtr->loads;
-		while (currNode != NULL)
-		{
-			IniLoadSectionNode_t* freeMe = currNode;
-			currNode = currNode->next;
-			if (freeMe->curr.sectname != NULL)
-				deallocator(freeMe->curr.sectname);	
-			if (freeMe->curr.filename != NULL)
-				deallocator(freeMe->curr.filename);	
-
-			deallocator(freeMe);
-		}
-		infoPtr->loads = NULL;
-	}
-
-	if (infoPtr->copies != NULL)
-	{
-		IniCopySectionNode_t* currNode = infoPtr->copies;
-		while (currNode != NULL)
-		{
-			IniCopySectionNode_t* freeMe = currNode;
-			currNode = currNode->next;
-			if (freeMe->curr.sectname != NULL)
-				deallocator(freeMe->curr.sectname);	
-
-			deallocator(freeMe);
-		}
-		infoPtr->copies = NULL;
-	}
-
-	if (infoPtr->boots != NULL)
-	{
-		IniBootSectionNode_t* currNode = infoPtr->boots;
-		while (currNode != NULL)
-		{
-			IniBootSectionNode_t* freeMe = currNode;
-			currNode = currNode->next;
-			if (freeMe->curr.sectname != NULL)
-				deallocator(freeMe->curr.sectname);	
-
-			deallocator(freeMe);
-		}
-		infoPtr->boots = NULL;
-	}
-}
@@ -15,6 +15,11 @@ typedef struct IniLoadSection_s
 	uint32_t skip;
 	uint32_t count;
 	uint32_t dst;
+	uint32_t compType; //same as IniCopySection_t, decompressed while reading
+	uint32_t dstlen; //only used if compType != 0
+	uint32_t lba; //used instead of filename if that's NULL, first sector relative to part
+	uint32_t sectors; //0 means up to the end of part
+	uint8_t part; //MBR partition number 1-4, 0 for the whole card
 } IniLoadSection_t;
 
 typedef struct IniCopySection_s
@@ -25,6 +30,7 @@ typedef struct IniCopySection_s
 	uint32_t srclen;
 	uint32_t dst;
 	uint32_t dstlen;
+	uint32_t margin; //for decompressing in place, how far past dst+dstlen the compressed data must end
 } IniCopySection_t;
 
 typedef struct IniBootSection_s
@@ -54,19 +60,35 @@ typedef struct IniBootSectionNode_s
 	struct IniBootSectionNode_s* next;
 } IniBootSectionNode_t;
 
+//keys that appear before the first section
+typedef struct IniGlobalOptions_s
+{
+	int16_t earlyMemoryFreq; //MHz to train memory to before LOADs, 0 to leave it until BOOT
+} IniGlobalOptions_t;
+
 typedef struct IniParsedInfo_s
 {
+	IniGlobalOptions_t globals;
 	IniLoadSectionNode_t* loads;
 	IniCopySectionNode_t* copies;
 	IniBootSectionNode_t* boots;
 } IniParsedInfo_t;
 
-typedef void*(*AllocatorFunc)(size_t numBytes);
-typedef int(*ErrPrintFunc)(const char* format, ...);
-IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, AllocatorFunc allocator, ErrPrintFunc printer);
+//all nodes come out of one caller provided block, so there is nothing to free individually
+typedef struct IniArena_s
+{
+	uint8_t* base;
+	size_t size;
+	size_t used;
+} IniArena_t;
+
+//upper bound for the arena needed to parse these bytes
+size_t memloader_ini_arena_size(const char* iniBytes, const int numBytes);
 
-typedef void(*DeallocatorFunc)(void* allocBytes);
-void free_memloader_info(IniParsedInfo_t* infoPtr, DeallocatorFunc deallocator);
+//iniBytes[numBytes] must be 0, the parser terminates strings in place and the last line has nothing else to stop it.
+//strings in the result point into iniBytes, so it has to outlive the result just like the arena
+typedef int(*ErrPrintFunc)(const char* format, ...);
+IniParsedInfo_t parse_memloader_ini(char* iniBytes, const int numBytes, IniArena_t* arena, ErrPrintFunc printer);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,91 @@
+#include "blzdecode.h"
+#include <stdint.h>
+
+#define BLZ_FOOTER_SIZE 12
+
+static uint32_t read_le32(const uint8_t* p)
+{
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Same algorithm as the Horizon kernel, but walking pointers instead of
+   offsets, with every control byte of eight literals copied unrolled, and
+   with the bounds checks the kernel leaves out so corrupt data can't write
+   outside the buffer or overtake input that hasn't been read yet. */
+size_t blz_uncompress(void* buf, size_t compSize, size_t bufSize)
+{
+   uint8_t* const base = (uint8_t*)buf;
+   if (compSize < BLZ_FOOTER_SIZE || compSize > bufSize)
+      return 0;
+
+   const uint8_t* footer = base + compSize - BLZ_FOOTER_SIZE;
+   const uint32_t cmpAndHdrSize = read_le32(footer);
+   const uint32_t headerSize = read_le32(footer + 4);
+   const uint32_t addlSize = read_le32(footer + 8);
+   if (cmpAndHdrSize > compSize || headerSize < BLZ_FOOTER_SIZE || headerSize > cmpAndHdrSize ||
+       addlSize > bufSize - compSize)
+      return 0;
+
+   uint8_t* const start = base + compSize - cmpAndHdrSize;
+   uint8_t* const end = base + compSize + addlSize;
+   const uint8_t* in = start + cmpAndHdrSize - headerSize;
+   uint8_t* out = end;
+
+   while (out > start)
+   {
+      if (in == start)
+         return 0;
+
+      unsigned int control = *--in;
+      if (control == 0 && out - start >= 8 && in - start >= 8)
+      {
+         out[-1] = in[-1]; out[-2] = in[-2]; out[-3] = in[-3]; out[-4] = in[-4];
+         out[-5] = in[-5]; out[-6] = in[-6]; out[-7] = in[-7]; out[-8] = in[-8];
+         out -= 8;
+         in -= 8;
+         continue;
+      }
+
+      for (int i=0; i<8 && out > start; i++, control <<= 1)
+      {
+         if ((control & 0x80) == 0)
+         {
+            if (in == start)
+               return 0;
+
+            *--out = *--in;
+            continue;
+         }
+
+         if (in - start < 2)
+            return 0;
+
+         in -= 2;
+         const unsigned int seg = in[0] | ((unsigned int)in[1] << 8);
+         size_t len = (seg >> 12) + 3;
+         const size_t dist = (seg & 0xFFF) + 3;
+         if (len > (size_t)(out - start))
+            len = out - start;
+
+         out -= len;
+         if (out < in || dist > (size_t)(end - out) - len)
+            return 0;
+
+         /* matches can overlap their own source (dist is as low as 3 and len
+            up to 18), so copy downwards like the kernel: every byte read is
+            then either above the match or one this match already wrote.
+            Two at a time still works since dist is never below 3. */
+         uint8_t* to = out + len;
+         while (to - out >= 2)
+         {
+            to[-1] = to[dist - 1];
+            to[-2] = to[dist - 2];
+            to -= 2;
+         }
+         if (to != out)
+            to[-1] = to[dist - 1];
+      }
+   }
+
+   return compSize + addlSize;
+}
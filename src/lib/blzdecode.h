@@ -0,0 +1,24 @@
+#ifndef _BLZDECODE_H_
+#define _BLZDECODE_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Nintendo's backward LZ (BLZ), as used for KIP1 and package2 segments. The
+   compressed data ends with a 12 byte footer and is decoded from the end
+   towards the start, growing into the space after it, so it always expands
+   where it is: buf holds compSize bytes of compressed data and has room for
+   bufSize bytes of output. Anything in front of the compressed area (as the
+   footer describes it) is stored and stays as it is.
+   Returns the decompressed size, or 0 if the data is corrupt or doesn't fit.
+   Shared with the host tools, so it must stay plain C. */
+size_t blz_uncompress(void* buf, size_t compSize, size_t bufSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
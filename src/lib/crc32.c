@@ -1,28 +1,56 @@
 #include "crc32.h"
+#include <stdint.h>
 
-/* This is the basic CRC-32 calculation with some optimization but no
-table lookup. The the byte reversal is avoided by shifting the crc reg
-right instead of left and by using a reversed 32-bit word to represent
-the polynomial.
-   When compiled to Cyclops with GCC, this function executes in 8 + 72n
-instructions, where n is the number of bytes in the input message. It
-should be doable in 4 + 61n instructions.
-   If the inner loop is strung out (approx. 5*8 = 40 instructions),
-it would take about 6 + 46n instructions. */
+#if CRC32_SLICES != 1 && CRC32_SLICES != 4 && CRC32_SLICES != 8
+#error "CRC32_SLICES must be 1, 4 or 8"
+#endif
 
-unsigned int crc32b(unsigned char* message, unsigned int msgLen) 
+/* Generated by crc32_table.s */
+extern const uint32_t crc32_table[CRC32_SLICES][256];
+
+/* Table driven slice-by-N CRC-32. Bytes are consumed one at a time until the
+input pointer is word aligned (the BPMP can't do unaligned loads), then
+CRC32_SLICES bytes are folded in per iteration with one lookup each.
+Assumes a little-endian CPU. */
+
+unsigned int crc32_update(unsigned int crc, const void* buf, unsigned int len)
 {
-   unsigned int byte, crc, mask;
-   crc = 0xFFFFFFFF;
-   for (unsigned int i=0; i<msgLen; i++) 
+   const uint32_t (*table)[256] = crc32_table;
+   const unsigned char* p = buf;
+   uint32_t c = ~crc;
+
+#if CRC32_SLICES > 1
+   while (len > 0 && ((uintptr_t)p & 3) != 0)
+   {
+      c = table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+      len--;
+   }
+
+   while (len >= CRC32_SLICES)
    {
-      byte = message[i];            // Get next byte.
-      crc = crc ^ byte;
-      for (int j = 7; j >= 0; j--) // Do eight times.
-      {
-         mask = -(crc & 1);
-         crc = (crc >> 1) ^ (0xEDB88320 & mask);
-      }
+      const uint32_t one = *(const uint32_t*)p ^ c;
+#if CRC32_SLICES == 8
+      const uint32_t two = *(const uint32_t*)(p+4);
+      c = table[7][one & 0xFF] ^ table[6][(one >> 8) & 0xFF] ^
+          table[5][(one >> 16) & 0xFF] ^ table[4][one >> 24] ^
+          table[3][two & 0xFF] ^ table[2][(two >> 8) & 0xFF] ^
+          table[1][(two >> 16) & 0xFF] ^ table[0][two >> 24];
+#else
+      c = table[3][one & 0xFF] ^ table[2][(one >> 8) & 0xFF] ^
+          table[1][(one >> 16) & 0xFF] ^ table[0][one >> 24];
+#endif
+      p += CRC32_SLICES;
+      len -= CRC32_SLICES;
    }
-   return ~crc;
-}
\ No newline at end of file
+#endif
+
+   while (len-- > 0)
+      c = table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+
+   return ~c;
+}
+
+unsigned int crc32b(unsigned char* message, unsigned int msgLen) 
+{
+   return crc32_update(0, message, msgLen);
+}
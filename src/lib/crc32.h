@@ -1,6 +1,17 @@
 #ifndef _CRC32_H_
 #define _CRC32_H_
 
+/* Number of 256-entry lookup tables used by crc32_update (1, 4 or 8).
+   More tables process more bytes per loop iteration but cost 1KB each. */
+#ifndef CRC32_SLICES
+#define CRC32_SLICES 4
+#endif
+
+#ifndef __ASSEMBLER__
+/* Continues a crc32 from a previously returned value (start with 0), so data
+   can be checksummed in pieces as it arrives. */
+unsigned int crc32_update(unsigned int crc, const void* buf, unsigned int len);
 unsigned int crc32b(unsigned char* message, unsigned int msgLen);
+#endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,23 @@
+#include "lib/crc32.h"
+
+/* CRC-32 (reversed polynomial 0xEDB88320) lookup tables, computed by the
+   assembler at build time so there is no runtime setup. Entry n of table k
+   is the crc register after feeding byte n followed by k zero bytes. */
+
+.section .rodata.crc32_table, "a"
+.balign 4
+.global crc32_table
+crc32_table:
+    .set crc_tbl, 0
+    .rept CRC32_SLICES
+    .set crc_idx, 0
+    .rept 256
+    .set crc_val, crc_idx
+    .rept 8*(crc_tbl+1)
+    .set crc_val, ((crc_val >> 1) ^ (0xEDB88320 & -(crc_val & 1))) & 0xFFFFFFFF
+    .endr
+    .4byte crc_val
+    .set crc_idx, crc_idx+1
+    .endr
+    .set crc_tbl, crc_tbl+1
+    .endr
@@ -17,6 +17,8 @@
 #define _DECOMP_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include "xxhash.h"
 
 /* Decompresses an LZ4F image (multiple LZ4 blocks with frame header) from src
  * to dst, ensuring that it doesn't read more than srcn bytes and doesn't write
@@ -28,7 +30,60 @@
  */
 size_t ulz4fn(const void *src, size_t srcn, void *dst, size_t dstn);
 
-/* Defined in src/lib/lzma.c. Returns decompressed size or 0 on error. */
+/* Defined in src/lib/lzma.c. Takes either a legacy .lzma stream or an .xz
+ * container of LZMA2 blocks without extra filters, told apart by the xz magic.
+ * Returns decompressed size or 0 on error. */
 size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn);
 
+/* Supplies compressed input to the streaming decoders below. Reads up to len
+ * bytes into buf and returns how many were read, which is only less than len
+ * at the end of the input or on error.
+ */
+typedef size_t (*decomp_read_func)(void *ctx, void *buf, size_t len);
+
+/* Same as ulz4fn and ulzman, but the compressed data is pulled through read
+ * as it is needed instead of having to be in memory in full beforehand.
+ */
+size_t ulz4fn_stream(decomp_read_func read, void *ctx, void *dst, size_t dstn);
+size_t ulzman_stream(decomp_read_func read, void *ctx, void *dst, size_t dstn);
+
+/* Incremental LZ4F decoder for input that arrives in pieces of any size, as
+ * used by ulz4fn and ulz4fn_stream. The output goes to one contiguous buffer,
+ * so frames with linked blocks work as well as independent ones. Block and
+ * content checksums are checked if the frame has them and verify_checksums
+ * is set. Feed it input until lz4f_feed returns LZ4F_DONE or LZ4F_ERROR, then
+ * lz4f_finish frees its buffer and returns the decompressed size, or 0 if the
+ * frame was bad or incomplete. Pieces that hold a whole compressed block are
+ * decoded where they are, so in-place decompression works as for ulz4fn.
+ */
+enum { LZ4F_ERROR = -1, LZ4F_NEED_MORE = 0, LZ4F_DONE = 1 };
+
+struct lz4f_decoder {
+	uint8_t *dst;
+	size_t dstn;
+	uint8_t *out;
+	int state;
+	int verify_checksums;
+	uint8_t flags;
+	size_t max_block_size;
+	uint64_t content_size;
+
+	/* header, block header and checksum bytes are gathered here */
+	uint8_t field[4 + 2 + sizeof(uint64_t) + 1];
+	size_t field_have;
+	size_t field_need;
+
+	uint32_t block_size;
+	int block_compressed;
+	size_t block_have;
+	uint8_t *block_out;
+	uint8_t *block;		/* only for blocks split across pieces */
+	uint32_t block_checksum;
+	XXH32_STATE content_checksum;
+};
+
+void lz4f_init(struct lz4f_decoder *d, void *dst, size_t dstn, int verify_checksums);
+int lz4f_feed(struct lz4f_decoder *d, const void *src, size_t srcn);
+size_t lz4f_finish(struct lz4f_decoder *d);
+
 #endif	/* _DECOMP_H_ */
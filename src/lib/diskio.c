@@ -10,6 +10,89 @@
 #include <string.h>
 #include "diskio.h"		/* FatFs lower layer API */
 #include "storage.h"
+#include "heap.h"
+
+/*-----------------------------------------------------------------------*/
+/* Sector cache                                                          */
+/*-----------------------------------------------------------------------*/
+/* Single sector reads are FatFs fetching FAT, directory and partial     */
+/* data sectors into its windows, which it does over and over for every  */
+/* f_open and chain walk. Those go through a small set-associative cache.*/
+/* Multi-sector reads are bulk file data and bypass it. The volume is    */
+/* mounted read-only, so cached sectors never go stale.                  */
+
+#define DISK_CACHE_SETS		16	/* Must be a power of 2 */
+#define DISK_CACHE_WAYS		4
+#define DISK_CACHE_SS		512
+
+typedef struct {
+	DWORD	sector;
+	DWORD	lastUse;	/* For LRU replacement, 0 = line is empty */
+	BYTE	pdrv;
+} DISK_CACHE_TAG;
+
+static DISK_CACHE_TAG cacheTags[DISK_CACHE_SETS][DISK_CACHE_WAYS];
+static BYTE* cacheData;		/* Allocated on first use, 16 byte aligned for DMA */
+static DWORD cacheUseCounter;
+static DISK_CACHE_STATS cacheStats;
+
+static void disk_cache_invalidate (
+	BYTE pdrv
+)
+{
+	for (UINT set = 0; set < DISK_CACHE_SETS; set++) {
+		for (UINT way = 0; way < DISK_CACHE_WAYS; way++) {
+			if (cacheTags[set][way].pdrv == pdrv) cacheTags[set][way].lastUse = 0;
+		}
+	}
+}
+
+static DRESULT disk_cache_read (
+	BYTE pdrv,
+	BYTE *buff,
+	DWORD sector
+)
+{
+	if (cacheData == NULL) {
+		cacheData = malloc(DISK_CACHE_SETS * DISK_CACHE_WAYS * DISK_CACHE_SS);
+		if (cacheData == NULL) {
+			return sdmmc_storage_read(get_storage_for_index(pdrv), sector, 1, buff) ? RES_OK : RES_ERROR;
+		}
+	}
+
+	const UINT set = sector & (DISK_CACHE_SETS - 1);
+	DISK_CACHE_TAG* tags = cacheTags[set];
+	UINT victim = 0;
+	for (UINT way = 0; way < DISK_CACHE_WAYS; way++) {
+		if (tags[way].lastUse != 0 && tags[way].sector == sector && tags[way].pdrv == pdrv) {
+			tags[way].lastUse = ++cacheUseCounter;
+			cacheStats.hits++;
+			memcpy(buff, &cacheData[(set * DISK_CACHE_WAYS + way) * DISK_CACHE_SS], DISK_CACHE_SS);
+			return RES_OK;
+		}
+		if (tags[way].lastUse < tags[victim].lastUse) victim = way;
+	}
+
+	cacheStats.misses++;
+	BYTE* line = &cacheData[(set * DISK_CACHE_WAYS + victim) * DISK_CACHE_SS];
+	if (!sdmmc_storage_read(get_storage_for_index(pdrv), sector, 1, line)) {
+		tags[victim].lastUse = 0;
+		return RES_ERROR;
+	}
+
+	tags[victim].sector = sector;
+	tags[victim].pdrv = pdrv;
+	tags[victim].lastUse = ++cacheUseCounter;
+	memcpy(buff, line, DISK_CACHE_SS);
+	return RES_OK;
+}
+
+void disk_cache_stats (
+	DISK_CACHE_STATS* stats	/* Receives hit and miss counts since boot */
+)
+{
+	*stats = cacheStats;
+}
 
 DSTATUS disk_status (
 	BYTE pdrv		/* Physical drive nmuber to identify the drive */
@@ -22,6 +105,7 @@ DSTATUS disk_initialize (
 	BYTE pdrv				/* Physical drive nmuber to identify the drive */
 )
 {
+	disk_cache_invalidate(pdrv);	/* Could be a different card since the last mount */
 	return 0;
 }
 
@@ -32,6 +116,8 @@ DRESULT disk_read (
 	UINT count		/* Number of sectors to read */
 )
 {
+	if (count == 1) return disk_cache_read(pdrv, buff, sector);
+
 	return sdmmc_storage_read(get_storage_for_index(pdrv), sector, count, buff) ? RES_OK : RES_ERROR;
 }
 
@@ -42,6 +128,7 @@ DRESULT disk_write (
 	UINT count			/* Number of sectors to write */
 )
 {
+	disk_cache_invalidate(pdrv);
 	return sdmmc_storage_write(get_storage_for_index(pdrv), sector, count, (void *)buff) ? RES_OK : RES_ERROR;
 }
 
@@ -35,6 +35,14 @@ DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 
+/* Single sector read cache counters */
+typedef struct {
+	DWORD	hits;
+	DWORD	misses;
+} DISK_CACHE_STATS;
+
+void disk_cache_stats (DISK_CACHE_STATS* stats);
+
 
 /* Disk Status Bits (DSTATUS) */
 
@@ -28,12 +28,14 @@ typedef struct _hnode
 typedef struct _heap
 {
 	u32 start;
+	u32 end;
 	hnode_t *first;
 } heap_t;
 
-static void _heap_create(heap_t *heap, u32 start)
+static void _heap_create(heap_t *heap, u32 start, u32 size)
 {
 	heap->start = start;
+	heap->end = start + size;
 	heap->first = NULL;
 }
 
@@ -46,6 +48,9 @@ static u32 _heap_alloc(heap_t *heap, u32 size)
 
 	if (!heap->first)
 	{
+		if (heap->end - heap->start < sizeof(hnode_t) + size)
+			return 0;
+
 		node = (hnode_t *)heap->start;
 		node->used = 1;
 		node->size = size;
@@ -80,6 +85,9 @@ static u32 _heap_alloc(heap_t *heap, u32 size)
 	}
 
 	new = (hnode_t *)((u32)node + sizeof(hnode_t) + node->size);
+	if ((u32)new > heap->end || heap->end - (u32)new < sizeof(hnode_t) + size)
+		return 0;
+
 	new->used = 1;
 	new->size = size;
 	new->prev = node;
@@ -112,9 +120,9 @@ static void _heap_free(heap_t *heap, u32 addr)
 
 static heap_t _heap;
 
-void heap_init(u32 base)
+void heap_init(u32 base, u32 size)
 {
-	_heap_create(&_heap, base);
+	_heap_create(&_heap, base, size);
 }
 
 void *malloc(u32 size)
@@ -125,7 +133,8 @@ void *malloc(u32 size)
 void *calloc(u32 num, u32 size)
 {
 	void *res = (void *)_heap_alloc(&_heap, num * size);
-	memset(res, 0, num * size);
+	if (res != NULL)
+		memset(res, 0, num * size);
 	return res;
 }
 
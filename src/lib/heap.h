@@ -19,7 +19,8 @@
 
 #include "hwinit/types.h"
 
-void heap_init(u32 base);
+//allocations fail once they would reach past base+size
+void heap_init(u32 base, u32 size);
 void *malloc(u32 size);
 void *calloc(u32 num, u32 size);
 void free(void *buf);
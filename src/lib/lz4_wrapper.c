@@ -32,6 +32,8 @@
 #include <stdint.h>
 #include <string.h>
 #include "hwinit/types.h"
+#include "heap.h"
+#include "decomp.h"
 
 static inline uint16_t read_le16(const void *src)
 {
@@ -124,19 +126,48 @@ struct lz4_block_header {
 	/* + uint32_t block_checksum iff has_block_checksum is set */
 } __packed;
 
-size_t ulz4fn(const void *src, size_t srcn, void *dst, size_t dstn)
+enum {
+	LZ4F_STATE_HEADER,
+	LZ4F_STATE_BLOCK_HEADER,
+	LZ4F_STATE_BLOCK_DATA,
+	LZ4F_STATE_BLOCK_CHECKSUM,
+	LZ4F_STATE_CONTENT_CHECKSUM,
+	LZ4F_STATE_DONE,
+	LZ4F_STATE_ERROR,
+};
+
+/* Flag bits of the frame descriptor, same as the lz4_frame_header fields */
+#define LZ4F_FLAG_CONTENT_CHECKSUM	(1 << 2)
+#define LZ4F_FLAG_CONTENT_SIZE		(1 << 3)
+#define LZ4F_FLAG_BLOCK_CHECKSUM	(1 << 4)
+#define LZ4F_FLAG_INDEPENDENT_BLOCKS	(1 << 5)
+
+/* ulz4fn_stream reads the input this much at a time */
+#define LZ4F_STREAM_CHUNK_SIZE	(64 * 1024)
+
+static void lz4f_expect_field(struct lz4f_decoder *d, int state, size_t len)
 {
-	const void *in = src;
-	void *out = dst;
-	size_t out_size = 0;
-	int has_block_checksum;
+	d->state = state;
+	d->field_have = 0;
+	d->field_need = len;
+}
 
-	{ /* With in-place decompression the header may become invalid later. */
-		const struct lz4_frame_header *h = in;
+/* Returns 1 once all field_need bytes are there, 0 if the input ran out first */
+static int lz4f_gather_field(struct lz4f_decoder *d, const uint8_t **in, const uint8_t *in_end)
+{
+	size_t size = MIN((size_t)(in_end - *in), d->field_need - d->field_have);
+	memcpy(&d->field[d->field_have], *in, size);
+	d->field_have += size;
+	*in += size;
+
+	return d->field_have == d->field_need;
+}
 
-		if (srcn < sizeof(*h) + sizeof(uint64_t) + sizeof(uint8_t))
-			return 0;	/* input overrun */
+static int lz4f_parse_header(struct lz4f_decoder *d)
+{
+	const struct lz4_frame_header *h = (const void *)d->field;
 
+	if (d->field_need == sizeof(*h)) {
 		/* We assume there's always only a single, standard frame. */
 		if (read_le32(&h->magic) != LZ4F_MAGICNUMBER || h->version != 1)
 			return 0;	/* unknown format */
@@ -144,58 +175,233 @@ size_t ulz4fn(const void *src, size_t srcn, void *dst, size_t dstn)
 		if (h->reserved0 || h->reserved1 || h->reserved2)
 			return 0;	/* reserved must be zero */
 
-		if (!h->independent_blocks)
-			return 0;	/* we don't support block dependency */
+		if (h->max_block_size < 4)
+			return 0;	/* invalid block size id */
 
-		has_block_checksum = h->has_block_checksum;
+		/* the rest of the header is the content size if any and its checksum */
+		d->flags = h->flags;
+		d->field_need += (h->has_content_size ? sizeof(uint64_t) : 0) + sizeof(uint8_t);
+		return 1;
+	}
 
-		in += sizeof(*h);
+	if (d->verify_checksums) {
+		const size_t desc_size = d->field_need - sizeof(h->magic) - sizeof(uint8_t);
+		if (d->field[d->field_need - 1] != ((xxh32(&d->field[sizeof(h->magic)], desc_size, 0) >> 8) & 0xFF))
+			return 0;	/* header checksum mismatch */
+	}
 
-		if (h->has_content_size)
-		{
-			const size_t content_size = read_le32(in);
-			if (content_size > dstn)
-				return content_size;
+	/* 4 -> 64KB, 5 -> 256KB, 6 -> 1MB, 7 -> 4MB */
+	d->max_block_size = (size_t)1 << (8 + 2 * h->max_block_size);
 
-			in += sizeof(uint64_t);
-		}
-		in += sizeof(uint8_t);
+	if (h->has_content_size) {
+		d->content_size = read_le32(&d->field[sizeof(*h)]) |
+			((uint64_t)read_le32(&d->field[sizeof(*h) + sizeof(uint32_t)]) << 32);
+		if (d->content_size > d->dstn)
+			return 0;	/* output overrun */
 	}
 
-	while (1) {
-		struct lz4_block_header b = { { .raw = read_le32(in) } };
-		in += sizeof(struct lz4_block_header);
+	lz4f_expect_field(d, LZ4F_STATE_BLOCK_HEADER, sizeof(struct lz4_block_header));
+	return 1;
+}
 
-		if ((size_t)(in - src) + b.size > srcn)
-			break;			/* input overrun */
+static int lz4f_parse_block_header(struct lz4f_decoder *d)
+{
+	struct lz4_block_header b = { { .raw = read_le32(d->field) } };
 
-		if (!b.size) {
-			out_size = out - dst;
-			break;			/* decompression successful */
-		}
+	if (!b.size) {
+		/* end mark */
+		if ((d->flags & LZ4F_FLAG_CONTENT_SIZE) && (uint64_t)(d->out - d->dst) != d->content_size)
+			return 0;	/* content size mismatch */
+
+		if (d->flags & LZ4F_FLAG_CONTENT_CHECKSUM)
+			lz4f_expect_field(d, LZ4F_STATE_CONTENT_CHECKSUM, sizeof(uint32_t));
+		else
+			d->state = LZ4F_STATE_DONE;
+
+		return 1;
+	}
+
+	if (b.size > d->max_block_size)
+		return 0;	/* corrupted block header */
+
+	if (b.not_compressed && b.size > (size_t)(d->dst + d->dstn - d->out))
+		return 0;	/* output overrun */
+
+	d->block_size = b.size;
+	d->block_compressed = !b.not_compressed;
+	d->block_have = 0;
+	d->block_out = d->out;
+	d->state = LZ4F_STATE_BLOCK_DATA;
+	return 1;
+}
+
+/* Called with the whole block, either straight from the input or gathered in d->block */
+static int lz4f_decode_block(struct lz4f_decoder *d, const uint8_t *data)
+{
+	if (d->verify_checksums && (d->flags & LZ4F_FLAG_BLOCK_CHECKSUM))
+		d->block_checksum = xxh32(data, d->block_size, 0);
+
+	/* linked blocks may refer back to anything decoded earlier in the frame */
+	const uint8_t *prefix = (d->flags & LZ4F_FLAG_INDEPENDENT_BLOCKS) ? d->out : d->dst;
+
+	/* constant folding essential, do not touch params! */
+	int ret = LZ4_decompress_generic((const char *)data, (char *)d->out, d->block_size,
+			d->dst + d->dstn - d->out, endOnInputSize,
+			full, 0, noDict, prefix, NULL, 0);
+	if (ret < 0)
+		return 0;	/* decompression error */
+
+	d->out += ret;
+	return 1;
+}
+
+static int lz4f_block_done(struct lz4f_decoder *d)
+{
+	if (d->verify_checksums) {
+		const size_t size = d->out - d->block_out;
+		if (!d->block_compressed && (d->flags & LZ4F_FLAG_BLOCK_CHECKSUM))
+			d->block_checksum = xxh32(d->block_out, size, 0);
+		if (d->flags & LZ4F_FLAG_CONTENT_CHECKSUM)
+			xxh32_update(&d->content_checksum, d->block_out, size);
+	}
+
+	if (d->flags & LZ4F_FLAG_BLOCK_CHECKSUM)
+		lz4f_expect_field(d, LZ4F_STATE_BLOCK_CHECKSUM, sizeof(uint32_t));
+	else
+		lz4f_expect_field(d, LZ4F_STATE_BLOCK_HEADER, sizeof(struct lz4_block_header));
+
+	return 1;
+}
+
+/* Returns 1 once the block is complete, 0 if the input ran out first, -1 on error */
+static int lz4f_feed_block(struct lz4f_decoder *d, const uint8_t **in, const uint8_t *in_end)
+{
+	const size_t avail = in_end - *in;
+	const size_t size = MIN(avail, d->block_size - d->block_have);
 
-		if (b.not_compressed) {
-			size_t size = MIN((uintptr_t)b.size, (uintptr_t)dst
-				+ dstn - (uintptr_t)out);
-			memcpy(out, in, size);
-			if (size < b.size)
-				break;		/* output overrun */
-			out += size;
+	/* decoding in place, the output already overwrote input we haven't read */
+	if (*in >= d->dst && *in < d->out)
+		return -1;
+
+	if (!d->block_compressed) {
+		/* stored blocks go straight to their final place */
+		memmove(d->out, *in, size);
+		d->out += size;
+		d->block_have += size;
+		*in += size;
+
+		return (d->block_have == d->block_size) ? 1 : 0;
+	}
+
+	if (d->block_have == 0 && avail >= d->block_size) {
+		*in += d->block_size;
+		return lz4f_decode_block(d, *in - d->block_size) ? 1 : -1;
+	}
+
+	if (d->block == NULL && (d->block = malloc(d->max_block_size)) == NULL)
+		return -1;
+
+	memcpy(&d->block[d->block_have], *in, size);
+	d->block_have += size;
+	*in += size;
+	if (d->block_have < d->block_size)
+		return 0;
+
+	return lz4f_decode_block(d, d->block) ? 1 : -1;
+}
+
+void lz4f_init(struct lz4f_decoder *d, void *dst, size_t dstn, int verify_checksums)
+{
+	memset(d, 0, sizeof(*d));
+	d->dst = dst;
+	d->dstn = dstn;
+	d->out = dst;
+	d->verify_checksums = verify_checksums;
+	xxh32_init(&d->content_checksum, 0);
+	lz4f_expect_field(d, LZ4F_STATE_HEADER, sizeof(struct lz4_frame_header));
+}
+
+int lz4f_feed(struct lz4f_decoder *d, const void *src, size_t srcn)
+{
+	const uint8_t *in = src;
+	const uint8_t *in_end = in + srcn;
+
+	while (d->state != LZ4F_STATE_DONE && d->state != LZ4F_STATE_ERROR) {
+		int ok;
+
+		if (d->state == LZ4F_STATE_BLOCK_DATA) {
+			ok = lz4f_feed_block(d, &in, in_end);
+			if (ok == 0)
+				return LZ4F_NEED_MORE;
+			if (ok > 0)
+				ok = lz4f_block_done(d);
 		} else {
-			/* constant folding essential, do not touch params! */
-			int ret = LZ4_decompress_generic(in, out, b.size,
-					dst + dstn - out, endOnInputSize,
-					full, 0, noDict, out, NULL, 0);
-			if (ret < 0)
-				break;		/* decompression error */
-
-			out += ret;
+			if (!lz4f_gather_field(d, &in, in_end))
+				return LZ4F_NEED_MORE;
+
+			switch (d->state) {
+			case LZ4F_STATE_HEADER:
+				ok = lz4f_parse_header(d);
+				break;
+			case LZ4F_STATE_BLOCK_HEADER:
+				ok = lz4f_parse_block_header(d);
+				break;
+			case LZ4F_STATE_BLOCK_CHECKSUM:
+				ok = !d->verify_checksums || read_le32(d->field) == d->block_checksum;
+				lz4f_expect_field(d, LZ4F_STATE_BLOCK_HEADER, sizeof(struct lz4_block_header));
+				break;
+			default: /* LZ4F_STATE_CONTENT_CHECKSUM */
+				ok = !d->verify_checksums || read_le32(d->field) == xxh32_digest(&d->content_checksum);
+				d->state = LZ4F_STATE_DONE;
+				break;
+			}
 		}
 
-		in += b.size;
-		if (has_block_checksum)
-			in += sizeof(uint32_t);
+		if (ok <= 0)
+			d->state = LZ4F_STATE_ERROR;
+	}
+
+	return (d->state == LZ4F_STATE_DONE) ? LZ4F_DONE : LZ4F_ERROR;
+}
+
+size_t lz4f_finish(struct lz4f_decoder *d)
+{
+	free(d->block);
+	d->block = NULL;
+
+	if (d->state != LZ4F_STATE_DONE)
+		return 0;
+
+	return d->out - d->dst;
+}
+
+size_t ulz4fn(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	struct lz4f_decoder d;
+
+	lz4f_init(&d, dst, dstn, 1);
+	lz4f_feed(&d, src, srcn);
+	return lz4f_finish(&d);
+}
+
+size_t ulz4fn_stream(decomp_read_func read, void *ctx, void *dst, size_t dstn)
+{
+	struct lz4f_decoder d;
+	uint8_t *chunk = malloc(LZ4F_STREAM_CHUNK_SIZE);
+	int status = LZ4F_NEED_MORE;
+
+	if (chunk == NULL)
+		return 0;
+
+	lz4f_init(&d, dst, dstn, 1);
+	while (status == LZ4F_NEED_MORE) {
+		size_t size = read(ctx, chunk, LZ4F_STREAM_CHUNK_SIZE);
+		if (size == 0)
+			break;		/* input overrun */
+
+		status = lz4f_feed(&d, chunk, size);
 	}
 
-	return out_size;
-}
\ No newline at end of file
+	free(chunk);
+	return lz4f_finish(&d);
+}
@@ -11,49 +11,389 @@
  */
 
 #include "printk.h"
+#include "heap.h"
+#include "decomp.h"
+#include "crc32.h"
 #include <string.h>
 
 #include "lzmadecode.h"
 
-size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
+#define LZMA_HEADER_SIZE (LZMA_PROPERTIES_SIZE + 8)
+#define LZMA_STREAM_CHUNK_SIZE (32*1024)
+
+static size_t lzma_decode(const unsigned char *header, ILzmaInCallback *inCallback,
+			const void *src, size_t srcn, void *dst, size_t dstn)
 {
-	unsigned char properties[LZMA_PROPERTIES_SIZE];
-	const int data_offset = LZMA_PROPERTIES_SIZE + 8;
 	UInt32 outSize;
 	SizeT inProcessed;
 	SizeT outProcessed;
 	int res;
 	CLzmaDecoderState state;
 	SizeT mallocneeds;
-	unsigned char scratchpad[15980];
+	/* enough for lc+lp <= 3, which covers the default lc=3 lp=0 */
+	CProb scratchpad[LZMA_BASE_SIZE + (LZMA_LIT_SIZE << 3)];
 	const unsigned char *cp;
 
-	memcpy(properties, src, LZMA_PROPERTIES_SIZE);
 	/* The outSize in LZMA stream is a 64bit integer stored in little-endian
 	 * (ref: lzma.cc@LZMACompress: put_64). To prevent accessing by
 	 * unaligned memory address and to load in correct endianness, read each
 	 * byte and re-construct. */
-	cp = src + LZMA_PROPERTIES_SIZE;
+	cp = header + LZMA_PROPERTIES_SIZE;
 	outSize = cp[3] << 24 | cp[2] << 16 | cp[1] << 8 | cp[0];
-	if (LzmaDecodeProperties(&state.Properties, properties,
+	if (LzmaDecodeProperties(&state.Properties, header,
 				 LZMA_PROPERTIES_SIZE) != LZMA_RESULT_OK) {
 		printk("lzma: Incorrect stream properties.\n");
 		return 0;
 	}
+	if (outSize > dstn)
+		return outSize;
+
+	/* on the stack like before, so the common case keeps nothing on the heap
+	   while dst is written; only a larger lc+lp needs it */
 	mallocneeds = (LzmaGetNumProbs(&state.Properties) * sizeof(CProb));
-	if (mallocneeds > sizeof(scratchpad)) {
-		printk("lzma: Decoder scratchpad too small, needs %u bytes!\n", (UInt32)mallocneeds);
+	state.Probs = (mallocneeds <= sizeof(scratchpad)) ? scratchpad : malloc(mallocneeds);
+	if (state.Probs == NULL) {
+		printk("lzma: Can't allocate %u bytes of probabilities!\n", (UInt32)mallocneeds);
 		return 0;
 	}
-	if (outSize > dstn)
-		return outSize;
-		
-	state.Probs = (CProb *)scratchpad;
-	res = LzmaDecode(&state, src + data_offset, srcn - data_offset,
-			 &inProcessed, dst, outSize, &outProcessed);
+	state.InCallback = inCallback;
+	LzmaDecoderInit(&state);
+	res = LzmaDecode(&state, src, srcn, &inProcessed, dst, 0, outSize, &outProcessed);
+	if (state.Probs != scratchpad)
+		free(state.Probs);
 	if (res != 0) {
 		printk("lzma: Decoding error = %d\n", res);
 		return 0;
 	}
 	return outProcessed;
 }
+
+/*
+ * .xz containers holding LZMA2 blocks, as produced by xz without extra filters.
+ * LZMA2 splits the data into chunks of at most 64KB compressed, each either
+ * stored or LZMA with optional resets of the state, properties or dictionary.
+ * A whole chunk is always available to the decoder so it never needs the input
+ * callback. Since the output is one contiguous buffer, the dictionary is simply
+ * everything decoded since the last dictionary reset.
+ */
+#define XZ_STREAM_HEADER_SIZE 12
+#define XZ_FILTER_LZMA2 0x21
+#define LZMA2_MAX_PACKED_SIZE (64*1024)
+/* LZMA2 limits lc+lp to 4, so one table fits every chunk's properties */
+#define LZMA2_MAX_LCLP 4
+
+static const unsigned char xz_magic[6] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+
+typedef struct {
+	const unsigned char *buf; /* in-memory input, NULL when reading through read */
+	size_t avail;
+	const unsigned char *dst; /* start of the output, to catch in-place overruns */
+	decomp_read_func read;
+	void *ctx;
+	unsigned char *chunk;
+	size_t pos; /* bytes consumed since the start of the stream */
+} xz_input_t;
+
+/* Returns the next len contiguous input bytes, or NULL if there aren't that many.
+ * len can't exceed LZMA2_MAX_PACKED_SIZE, and the bytes only stay valid until the next call. */
+static const unsigned char *xz_input_get(xz_input_t *in, size_t len)
+{
+	const unsigned char *data;
+
+	if (in->buf != NULL) {
+		if (len > in->avail)
+			return NULL;
+		data = in->buf;
+		in->buf += len;
+		in->avail -= len;
+	} else {
+		if (in->read(in->ctx, in->chunk, len) != len)
+			return NULL;
+		data = in->chunk;
+	}
+	in->pos += len;
+	return data;
+}
+
+/* Stored chunks are read straight into the output when streaming */
+static int xz_input_copy(xz_input_t *in, void *dst, size_t len)
+{
+	const unsigned char *data;
+
+	if (in->buf == NULL) {
+		if (in->read(in->ctx, dst, len) != len)
+			return 0;
+		in->pos += len;
+		return 1;
+	}
+
+	data = xz_input_get(in, len);
+	if (data == NULL)
+		return 0;
+	if (data >= in->dst && data < (const unsigned char *)dst)
+		return 0;	/* decoding in place, the output overtook the input */
+	memmove(dst, data, len);
+	return 1;
+}
+
+static UInt32 read_le32(const unsigned char *p)
+{
+	return p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0];
+}
+
+/* Variable length integers in block headers, 7 bits per byte */
+static const unsigned char *xz_skip_vli(const unsigned char *p, const unsigned char *end, UInt32 *value)
+{
+	int shift = 0;
+
+	*value = 0;
+	while (p < end && shift < 63) {
+		const unsigned char b = *p++;
+		if (shift < 32)
+			*value |= (UInt32)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			return p;
+		shift += 7;
+	}
+	return NULL;
+}
+
+/* Returns the number of bytes decoded into out, or -1 on error */
+static long lzma2_decode(xz_input_t *in, CLzmaDecoderState *state, unsigned char *out, size_t outn)
+{
+	size_t pos = 0;
+	size_t dictStart = 0;
+	int needDictReset = 1;
+	int needProps = 1;
+
+	while (1) {
+		const unsigned char *data = xz_input_get(in, 1);
+		unsigned char control;
+		size_t unpacked, packed;
+		SizeT inProcessed, outProcessed;
+
+		if (data == NULL)
+			return -1;
+		control = data[0];
+		if (control == 0x00)
+			return pos;
+		if (control >= 0x03 && control < 0x80)
+			return -1;	/* invalid control byte */
+
+		if (control >= 0xE0 || control == 0x01) {
+			dictStart = pos;
+			needDictReset = 0;
+			needProps = 1;
+		} else if (needDictReset)
+			return -1;
+
+		if (control < 0x80) {
+			/* stored chunk */
+			data = xz_input_get(in, 2);
+			if (data == NULL)
+				return -1;
+			unpacked = (data[0] << 8 | data[1]) + 1;
+			if (unpacked > outn - pos || !xz_input_copy(in, out + pos, unpacked))
+				return -1;
+			pos += unpacked;
+			continue;
+		}
+
+		data = xz_input_get(in, (control >= 0xC0) ? 5 : 4);
+		if (data == NULL)
+			return -1;
+		unpacked = ((control & 0x1F) << 16 | data[0] << 8 | data[1]) + 1;
+		packed = (data[2] << 8 | data[3]) + 1;
+		if (control >= 0xC0) {
+			unsigned char props[LZMA_PROPERTIES_SIZE] = { data[4] };
+			if (LzmaDecodeProperties(&state->Properties, props, sizeof(props)) != LZMA_RESULT_OK ||
+				state->Properties.lc + state->Properties.lp > LZMA2_MAX_LCLP)
+				return -1;
+			needProps = 0;
+		} else if (needProps)
+			return -1;
+
+		if (control >= 0xA0)
+			LzmaDecoderInit(state);
+
+		if (unpacked > outn - pos)
+			return -1;
+		data = xz_input_get(in, packed);
+		if (data == NULL)
+			return -1;
+		if (LzmaDecode(state, data, packed, &inProcessed, out + dictStart, pos - dictStart,
+				pos - dictStart + unpacked, &outProcessed) != LZMA_RESULT_OK || outProcessed != unpacked)
+			return -1;
+		pos += unpacked;
+	}
+}
+
+/* streamHeader holds the 12 bytes before in, blocks are decoded until the index */
+static size_t xz_decode(const unsigned char *streamHeader, xz_input_t *in, unsigned char *dst, size_t dstn)
+{
+	/* check field size for each check type */
+	static const unsigned char checkSizes[16] = { 0, 4, 4, 4, 8, 8, 8, 16, 16, 16, 32, 32, 32, 64, 64, 64 };
+	CLzmaDecoderState state;
+	size_t out = 0;
+	unsigned char checkType;
+
+	if (streamHeader[6] != 0 || streamHeader[7] > 0x0F ||
+		crc32_update(0, &streamHeader[6], 2) != read_le32(&streamHeader[8])) {
+		printk("xz: Unsupported or corrupt stream header.\n");
+		return 0;
+	}
+	checkType = streamHeader[7];
+
+	state.Properties.lc = LZMA2_MAX_LCLP;
+	state.Properties.lp = 0;
+	state.Properties.pb = 0;
+	state.Probs = malloc(LzmaGetNumProbs(&state.Properties) * sizeof(CProb));
+	state.InCallback = NULL;
+	if (state.Probs == NULL)
+		return 0;
+
+	while (1) {
+		const unsigned char *data = xz_input_get(in, 1);
+		const unsigned char *end;
+		unsigned char headerSize;
+		UInt32 crc, value;
+		long blockLen;
+
+		if (data == NULL)
+			goto corrupt;
+		if (data[0] == 0)
+			break;		/* index, no more blocks */
+
+		/* block header, covered by its own crc32 */
+		headerSize = data[0];
+		crc = crc32_update(0, &headerSize, 1);
+		data = xz_input_get(in, headerSize * 4 + 3);
+		if (data == NULL)
+			goto corrupt;
+		end = data + headerSize * 4 - 1;
+		if (crc32_update(crc, data, end - data) != read_le32(end))
+			goto corrupt;
+
+		/* only a lone LZMA2 filter, anything else needs a BCJ or delta decoder we don't have */
+		if ((data[0] & 0x3F) != 0) {
+			printk("xz: Only LZMA2 blocks without other filters are supported.\n");
+			goto error;
+		}
+		const unsigned char *p = data + 1;
+		if ((data[0] & 0x40) && (p = xz_skip_vli(p, end, &value)) == NULL)
+			goto corrupt;	/* compressed size */
+		if ((data[0] & 0x80) && (p = xz_skip_vli(p, end, &value)) == NULL)
+			goto corrupt;	/* uncompressed size */
+		if ((p = xz_skip_vli(p, end, &value)) == NULL || value != XZ_FILTER_LZMA2)
+			goto corrupt;
+		if ((p = xz_skip_vli(p, end, &value)) == NULL || value != 1 || p >= end || *p++ > 40)
+			goto corrupt;	/* dictionary size, doesn't matter with a flat output buffer */
+		while (p < end) {
+			if (*p++ != 0)
+				goto corrupt;
+		}
+
+		blockLen = lzma2_decode(in, &state, dst + out, dstn - out);
+		if (blockLen < 0)
+			goto corrupt;
+
+		/* compressed data is padded to a multiple of 4 bytes */
+		while (in->pos & 3) {
+			data = xz_input_get(in, 1);
+			if (data == NULL || data[0] != 0)
+				goto corrupt;
+		}
+
+		data = xz_input_get(in, checkSizes[checkType]);
+		if (data == NULL)
+			goto corrupt;
+		if (checkType == 1 && crc32_update(0, dst + out, blockLen) != read_le32(data)) {
+			printk("xz: Block CRC32 mismatch.\n");
+			goto error;
+		}
+		out += blockLen;
+	}
+
+	free(state.Probs);
+	return out;
+
+corrupt:
+	printk("xz: Corrupt or truncated data.\n");
+error:
+	free(state.Probs);
+	return 0;
+}
+
+size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	if (srcn >= XZ_STREAM_HEADER_SIZE && memcmp(src, xz_magic, sizeof(xz_magic)) == 0) {
+		xz_input_t in;
+		memset(&in, 0, sizeof(in));
+		in.buf = src;
+		in.avail = srcn;
+		in.dst = dst;
+		return xz_decode(xz_input_get(&in, XZ_STREAM_HEADER_SIZE), &in, dst, dstn);
+	}
+
+	if (srcn < LZMA_HEADER_SIZE)
+		return 0;
+
+	return lzma_decode(src, NULL, src + LZMA_HEADER_SIZE, srcn - LZMA_HEADER_SIZE, dst, dstn);
+}
+
+typedef struct {
+	ILzmaInCallback cb; /* must be first, LzmaDecode passes this back to us */
+	decomp_read_func read;
+	void *ctx;
+	unsigned char *chunk;
+} lzma_stream_reader_t;
+
+static int lzma_stream_read(void *object, const unsigned char **buffer, SizeT *bufferSize)
+{
+	lzma_stream_reader_t *reader = object;
+
+	*buffer = reader->chunk;
+	*bufferSize = reader->read(reader->ctx, reader->chunk, LZMA_STREAM_CHUNK_SIZE);
+	return LZMA_RESULT_OK;
+}
+
+size_t ulzman_stream(decomp_read_func read, void *ctx, void *dst, size_t dstn)
+{
+	/* both headers start with at least XZ_STREAM_HEADER_SIZE bytes */
+	unsigned char header[LZMA_HEADER_SIZE];
+	size_t outSize;
+
+	if (read(ctx, header, XZ_STREAM_HEADER_SIZE) != XZ_STREAM_HEADER_SIZE)
+		return 0;
+
+	if (memcmp(header, xz_magic, sizeof(xz_magic)) == 0) {
+		xz_input_t in;
+		memset(&in, 0, sizeof(in));
+		in.read = read;
+		in.ctx = ctx;
+		in.pos = XZ_STREAM_HEADER_SIZE;
+		in.chunk = malloc(LZMA2_MAX_PACKED_SIZE);
+		if (in.chunk == NULL)
+			return 0;
+
+		outSize = xz_decode(header, &in, dst, dstn);
+		free(in.chunk);
+		return outSize;
+	}
+
+	lzma_stream_reader_t reader;
+	if (read(ctx, &header[XZ_STREAM_HEADER_SIZE], sizeof(header) - XZ_STREAM_HEADER_SIZE) != sizeof(header) - XZ_STREAM_HEADER_SIZE)
+		return 0;
+
+	reader.cb.Read = lzma_stream_read;
+	reader.read = read;
+	reader.ctx = ctx;
+	reader.chunk = malloc(LZMA_STREAM_CHUNK_SIZE);
+	if (reader.chunk == NULL)
+		return 0;
+
+	/* no initial input, everything comes through the callback */
+	outSize = lzma_decode(header, &reader.cb, NULL, 0, dst, dstn);
+	free(reader.chunk);
+	return outSize;
+}
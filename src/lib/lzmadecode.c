@@ -21,6 +21,7 @@
 
 #include "lzmadecode.h"
 #include <stdint.h>
+#include <string.h>
 
 #define kNumTopBits 24
 #define kTopValue ((UInt32)1 << kNumTopBits)
@@ -51,7 +52,13 @@
 }
 
 
-#define RC_TEST { if (Buffer == BufferLim) return LZMA_RESULT_DATA_ERROR; }
+#define RC_TEST { if (Buffer == BufferLim) {				\
+	SizeT inChunkSize = 0;						\
+	if (InCallback == 0 || InCallback->Read(InCallback,		\
+		&Buffer, &inChunkSize) != LZMA_RESULT_OK			\
+		|| inChunkSize == 0)						\
+		return LZMA_RESULT_DATA_ERROR;				\
+	BufferLim = Buffer + inChunkSize; } }
 
 #define RC_INIT(buffer, bufferSize) Buffer = buffer; \
 	BufferLim = buffer + bufferSize; RC_INIT2
@@ -183,23 +190,46 @@ int LzmaDecodeProperties(CLzmaProperties *propsRes,
 
 #define kLzmaStreamWasFinishedId (-1)
 
+void LzmaDecoderInit(CLzmaDecoderState *vs)
+{
+	UInt32 i;
+	UInt32 numProbs = LzmaGetNumProbs(&vs->Properties);
+	for (i = 0; i < numProbs; i++)
+		vs->Probs[i] = kBitModelTotal >> 1;
+
+	vs->State = 0;
+	for (i = 0; i < 4; i++)
+		vs->Reps[i] = 1;
+}
+
+/* Plain literals are most of the symbols in typical data, so their 8 bits
+ * are decoded without a loop. */
+#define RC_GET_LITERAL_BIT(probs, symbol)	\
+{						\
+	CProb *probLit = probs + symbol;	\
+	RC_GET_BIT(probLit, symbol)		\
+}
+
 int LzmaDecode(CLzmaDecoderState *vs,
 	const unsigned char *inStream, SizeT inSize, SizeT *inSizeProcessed,
-	unsigned char *outStream, SizeT outSize, SizeT *outSizeProcessed)
+	unsigned char *outStream, SizeT outPos, SizeT outSize,
+	SizeT *outSizeProcessed)
 {
 	CProb *p = vs->Probs;
-	SizeT nowPos = 0;
-	Byte previousByte = 0;
+	SizeT nowPos = outPos;
+	Byte previousByte = (outPos > 0) ? outStream[outPos - 1] : 0;
 	UInt32 posStateMask = (1 << (vs->Properties.pb)) - 1;
 	UInt32 literalPosMask = (1 << (vs->Properties.lp)) - 1;
 	int lc = vs->Properties.lc;
 
 
-	int state = 0;
-	UInt32 rep0 = 1, rep1 = 1, rep2 = 1, rep3 = 1;
+	int state = vs->State;
+	UInt32 rep0 = vs->Reps[0], rep1 = vs->Reps[1];
+	UInt32 rep2 = vs->Reps[2], rep3 = vs->Reps[3];
 	int len = 0;
 	const Byte *Buffer;
 	const Byte *BufferLim;
+	ILzmaInCallback *InCallback = vs->InCallback;
 	int look_ahead_ptr = 4;
 	union {
 		Byte raw[4];
@@ -207,18 +237,14 @@ int LzmaDecode(CLzmaDecoderState *vs,
 	} look_ahead;
 	UInt32 Range;
 	UInt32 Code;
+	/* When decoding in place (input at the tail of the output buffer) the
+	 * output must never reach input that hasn't been read yet, which
+	 * always starts at Buffer. Separate buffers never trip this check. */
+	const int inPlace = (inStream >= outStream + outPos);
 
 	*inSizeProcessed = 0;
 	*outSizeProcessed = 0;
 
-	{
-		UInt32 i;
-		UInt32 numProbs = Literal + ((UInt32)LZMA_LIT_SIZE << (lc
-						+ vs->Properties.lp));
-		for (i = 0; i < numProbs; i++)
-			p[i] = kBitModelTotal >> 1;
-	}
-
 	RC_INIT(inStream, inSize);
 
 
@@ -235,7 +261,16 @@ int LzmaDecode(CLzmaDecoderState *vs,
 				((((nowPos) & literalPosMask) << lc)
 				+ (previousByte >> (8 - lc))));
 
-			if (state >= kNumLitStates) {
+			if (state < kNumLitStates) {
+				RC_GET_LITERAL_BIT(prob, symbol)
+				RC_GET_LITERAL_BIT(prob, symbol)
+				RC_GET_LITERAL_BIT(prob, symbol)
+				RC_GET_LITERAL_BIT(prob, symbol)
+				RC_GET_LITERAL_BIT(prob, symbol)
+				RC_GET_LITERAL_BIT(prob, symbol)
+				RC_GET_LITERAL_BIT(prob, symbol)
+				RC_GET_LITERAL_BIT(prob, symbol)
+			} else {
 				int matchByte;
 				matchByte = outStream[nowPos - rep0];
 				do {
@@ -250,13 +285,16 @@ int LzmaDecode(CLzmaDecoderState *vs,
 						if (bit == 0)
 							break)
 				} while (symbol < 0x100);
-			}
-			while (symbol < 0x100) {
-				CProb *probLit = prob + symbol;
-				RC_GET_BIT(probLit, symbol)
+
+				while (symbol < 0x100) {
+					CProb *probLit = prob + symbol;
+					RC_GET_BIT(probLit, symbol)
+				}
 			}
 			previousByte = (Byte)symbol;
 
+			if (inPlace && outStream + nowPos >= Buffer)
+				return LZMA_RESULT_DATA_ERROR;
 			outStream[nowPos++] = previousByte;
 			if (state < 4)
 				state = 0;
@@ -285,7 +323,8 @@ int LzmaDecode(CLzmaDecoderState *vs,
 					IfBit0(prob) {
 						UpdateBit0(prob);
 
-						if (nowPos == 0)
+						if (nowPos == 0 || (inPlace &&
+							outStream + nowPos >= Buffer))
 							return LZMA_RESULT_DATA_ERROR;
 
 						state = state < kNumLitStates
@@ -414,18 +453,42 @@ int LzmaDecode(CLzmaDecoderState *vs,
 			if (rep0 > nowPos)
 				return LZMA_RESULT_DATA_ERROR;
 
-
-			do {
-				previousByte = outStream[nowPos - rep0];
-				len--;
-				outStream[nowPos++] = previousByte;
-			} while (len != 0 && nowPos < outSize);
+			{
+				SizeT copyLen = outSize - nowPos;
+				Byte *dest = outStream + nowPos;
+				const Byte *src = dest - rep0;
+
+				if (copyLen > (SizeT)len)
+					copyLen = len;
+				if (inPlace && dest + copyLen > Buffer)
+					return LZMA_RESULT_DATA_ERROR;
+				len -= copyLen;
+				nowPos += copyLen;
+
+				/* long matches that don't overlap themselves
+				 * are worth a call to the word-wide memcpy */
+				if (copyLen >= 16 && rep0 >= copyLen)
+					memcpy(dest, src, copyLen);
+				else {
+					do {
+						*dest++ = *src++;
+					} while (--copyLen != 0);
+				}
+				previousByte = outStream[nowPos - 1];
+			}
 		}
 	}
 	RC_NORMALIZE;
 
+	vs->State = state;
+	vs->Reps[0] = rep0;
+	vs->Reps[1] = rep1;
+	vs->Reps[2] = rep2;
+	vs->Reps[3] = rep3;
+
 
+	/* only meaningful without an input callback */
 	*inSizeProcessed = (SizeT)(Buffer - inStream);
-	*outSizeProcessed = nowPos;
+	*outSizeProcessed = nowPos - outPos;
 	return LZMA_RESULT_OK;
 }
@@ -52,14 +52,31 @@ int LzmaDecodeProperties(CLzmaProperties *propsRes,
 
 #define kLzmaNeedInitId (-2)
 
+/* Optional input callback (as in the SDK's _LZMA_IN_CB mode). When set, it is
+ * called to refill the input every time inStream runs out, and should return
+ * the next chunk of compressed data (bufferSize 0 at end of input). */
+typedef struct _ILzmaInCallback {
+	int (*Read)(void *object, const unsigned char **buffer, SizeT *bufferSize);
+} ILzmaInCallback;
+
 typedef struct _CLzmaDecoderState {
 	CLzmaProperties Properties;
-	CProb *Probs;
+	CProb *Probs; /* LzmaGetNumProbs(&Properties) entries */
+	ILzmaInCallback *InCallback;
+	int State;
+	UInt32 Reps[4];
 } CLzmaDecoderState;
 
+/* Resets the probabilities and the match state, Properties must be set. */
+void LzmaDecoderInit(CLzmaDecoderState *vs);
 
+/* Decodes into outStream[outPos] up to outStream[outSize], everything before
+ * outPos is the dictionary. The match state carries over from the previous
+ * call unless LzmaDecoderInit is called in between, as LZMA2 chunks need.
+ * outSizeProcessed is the number of bytes decoded by this call. */
 int LzmaDecode(CLzmaDecoderState *vs,
 	const unsigned char *inStream, SizeT inSize, SizeT *inSizeProcessed,
-	unsigned char *outStream, SizeT outSize, SizeT *outSizeProcessed);
+	unsigned char *outStream, SizeT outPos, SizeT outSize,
+	SizeT *outSizeProcessed);
 
 #endif
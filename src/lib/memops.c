@@ -0,0 +1,163 @@
+#include "memops.h"
+#include <stdint.h>
+
+/* Portable C versions of memops.s, taking the same paths in the same order:
+bytes until dst is word aligned, then 32 byte blocks (one LDM/STM pair there),
+words and the last bytes. A src that is still misaligned gets its words built
+from two aligned loads and shifts, and memmove copies from the end down when a
+forward copy would overwrite source bytes it hasn't read yet. They build on
+the host for the differential tests and benchmark in tests/, the firmware only
+links the assembly ones. Little endian only, like the BPMP. */
+
+#define BLOCK_WORDS 8
+
+void* memcpy_ref(void* dst, const void* src, size_t len)
+{
+   uint8_t* d = dst;
+   const uint8_t* s = src;
+   if (len >= 8)
+   {
+      while (((uintptr_t)d & 3) != 0)
+      {
+         *d++ = *s++;
+         len--;
+      }
+
+      const unsigned srcMisalign = (uintptr_t)s & 3;
+      if (srcMisalign == 0)
+      {
+         while (len >= BLOCK_WORDS*4)
+         {
+            const uint32_t* sw = (const uint32_t*)s;
+            uint32_t block[BLOCK_WORDS];
+            for (int i=0; i<BLOCK_WORDS; i++)
+               block[i] = sw[i];
+            for (int i=0; i<BLOCK_WORDS; i++)
+               ((uint32_t*)d)[i] = block[i];
+
+            d += BLOCK_WORDS*4;
+            s += BLOCK_WORDS*4;
+            len -= BLOCK_WORDS*4;
+         }
+         while (len >= 4)
+         {
+            *(uint32_t*)d = *(const uint32_t*)s;
+            d += 4;
+            s += 4;
+            len -= 4;
+         }
+      }
+      else
+      {
+         const unsigned shift = srcMisalign*8;
+         const uint32_t* sw = (const uint32_t*)(s - srcMisalign);
+         uint32_t curr = *sw++;
+         while (len >= 4)
+         {
+            const uint32_t next = *sw++;
+            *(uint32_t*)d = (curr >> shift) | (next << (32-shift));
+            curr = next;
+            d += 4;
+            len -= 4;
+         }
+         s = (const uint8_t*)sw - 4 + srcMisalign;
+      }
+   }
+
+   while (len > 0)
+   {
+      *d++ = *s++;
+      len--;
+   }
+   return dst;
+}
+
+void* memmove_ref(void* dst, const void* src, size_t len)
+{
+   uint8_t* d = dst;
+   const uint8_t* s = src;
+   if (d <= s || (size_t)(d - s) >= len)
+      return memcpy_ref(dst, src, len);
+
+   d += len;
+   s += len;
+   if (len >= 8 && (((uintptr_t)d ^ (uintptr_t)s) & 3) == 0)
+   {
+      while (((uintptr_t)d & 3) != 0)
+      {
+         *--d = *--s;
+         len--;
+      }
+      while (len >= BLOCK_WORDS*4)
+      {
+         d -= BLOCK_WORDS*4;
+         s -= BLOCK_WORDS*4;
+         const uint32_t* sw = (const uint32_t*)s;
+         uint32_t block[BLOCK_WORDS];
+         for (int i=0; i<BLOCK_WORDS; i++)
+            block[i] = sw[i];
+         for (int i=0; i<BLOCK_WORDS; i++)
+            ((uint32_t*)d)[i] = block[i];
+
+         len -= BLOCK_WORDS*4;
+      }
+      while (len >= 4)
+      {
+         d -= 4;
+         s -= 4;
+         *(uint32_t*)d = *(const uint32_t*)s;
+         len -= 4;
+      }
+   }
+
+   while (len > 0)
+   {
+      *--d = *--s;
+      len--;
+   }
+   return dst;
+}
+
+void* memset_ref(void* dst, int val, size_t len)
+{
+   uint8_t* d = dst;
+   const uint8_t byteVal = (uint8_t)val;
+   if (len >= 8)
+   {
+      const uint32_t wordVal = byteVal * 0x01010101u;
+      while (((uintptr_t)d & 3) != 0)
+      {
+         *d++ = byteVal;
+         len--;
+      }
+      while (len >= BLOCK_WORDS*4)
+      {
+         for (int i=0; i<BLOCK_WORDS; i++)
+            ((uint32_t*)d)[i] = wordVal;
+
+         d += BLOCK_WORDS*4;
+         len -= BLOCK_WORDS*4;
+      }
+      while (len >= 4)
+      {
+         *(uint32_t*)d = wordVal;
+         d += 4;
+         len -= 4;
+      }
+   }
+
+   while (len > 0)
+   {
+      *d++ = byteVal;
+      len--;
+   }
+   return dst;
+}
+
+#ifndef __arm__
+/* memops.s has memzero as an entry point into memset */
+void memzero(void* dst, size_t len)
+{
+   memset_ref(dst, 0, len);
+}
+#endif
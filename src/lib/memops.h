@@ -0,0 +1,20 @@
+#ifndef _MEMOPS_H_
+#define _MEMOPS_H_
+
+#include <stddef.h>
+
+/* memops.s also provides memcpy, memmove and memset (declared in string.h as
+   usual), replacing newlib's size-optimised ones at link time. All of them are
+   ARM mode and move 32 bytes per LDM/STM pair once the pointers are aligned. */
+
+/* Zeroes len bytes, same as memset(dst, 0, len). Meant for the large tails of
+   LOAD/COPY destinations, which can be tens of megabytes. */
+void memzero(void* dst, size_t len);
+
+/* C versions of the memops.s routines that take the same paths, see memops.c.
+   Only used by the host tests, the firmware build drops them. */
+void* memcpy_ref(void* dst, const void* src, size_t len);
+void* memmove_ref(void* dst, const void* src, size_t len);
+void* memset_ref(void* dst, int val, size_t len);
+
+#endif
@@ -0,0 +1,196 @@
+/* memcpy, memmove and memset for the BPMP (ARM7TDMI). They are ARM mode so the
+   bulk of every copy is one LDM/STM pair moving 32 bytes, the linker adds the
+   interworking veneers for the thumb callers. Anything shorter than a block
+   goes a word and then a byte at a time. ARMv4 has no unaligned loads, so when
+   src and dst disagree on their alignment the words are assembled from two
+   aligned loads with shifts. Only whole words containing at least one wanted
+   byte are ever read. */
+
+.syntax unified
+.arm
+
+/* dst is aligned, lr holds the aligned word containing the next src byte and
+   r1 points right after it. Each output word is the top of lr and the bottom
+   of the following source word. Falls back to the byte loop for the rest. */
+.macro COPY_SHIFTED shift
+    subs    r2, r2, #4
+    blo     2f
+1:
+    mov     r4, lr, lsr #\shift
+    ldr     lr, [r1], #4
+    orr     r4, r4, lr, lsl #(32-\shift)
+    str     r4, [r0], #4
+    subs    r2, r2, #4
+    bhs     1b
+2:
+    add     r2, r2, #4
+    sub     r1, r1, #(4-\shift/8)
+    pop     {r4, lr}
+    b       .Lcpy_bytes
+.endm
+
+.section .text.memcpy, "ax", %progbits
+.balign 4
+.global memcpy
+.type memcpy, %function
+memcpy:
+    mov     ip, r0
+    cmp     r2, #8
+    blo     .Lcpy_bytes
+    tst     r0, #3
+    beq     .Lcpy_dst_aligned
+.Lcpy_align_dst:
+    ldrb    r3, [r1], #1
+    strb    r3, [r0], #1
+    sub     r2, r2, #1
+    tst     r0, #3
+    bne     .Lcpy_align_dst
+.Lcpy_dst_aligned:
+    ands    r3, r1, #3
+    bne     .Lcpy_src_unaligned
+    push    {r4-r10}
+    subs    r2, r2, #32
+    blo     2f
+1:
+    ldmia   r1!, {r3-r10}
+    stmia   r0!, {r3-r10}
+    subs    r2, r2, #32
+    bhs     1b
+2:
+    pop     {r4-r10}
+    add     r2, r2, #32
+.Lcpy_words:
+    subs    r2, r2, #4
+    ldrhs   r3, [r1], #4
+    strhs   r3, [r0], #4
+    bhs     .Lcpy_words
+    add     r2, r2, #4
+.Lcpy_bytes:
+    subs    r2, r2, #1
+    ldrbhs  r3, [r1], #1
+    strbhs  r3, [r0], #1
+    bhs     .Lcpy_bytes
+    mov     r0, ip
+    bx      lr
+
+.Lcpy_src_unaligned:
+    push    {r4, lr}
+    bic     r1, r1, #3
+    ldr     lr, [r1], #4
+    cmp     r3, #2
+    beq     .Lcpy_shift16
+    bhi     .Lcpy_shift24
+    COPY_SHIFTED 8
+.Lcpy_shift16:
+    COPY_SHIFTED 16
+.Lcpy_shift24:
+    COPY_SHIFTED 24
+.size memcpy, .-memcpy
+
+/* Forward copying is safe whenever dst is below src or past the end of it,
+   that is left to memcpy. Otherwise copy from the end down. */
+.section .text.memmove, "ax", %progbits
+.balign 4
+.global memmove
+.type memmove, %function
+memmove:
+    subs    r3, r0, r1
+    cmphi   r2, r3
+    bls     memcpy
+    mov     ip, r0
+    add     r0, r0, r2
+    add     r1, r1, r2
+    cmp     r2, #8
+    blo     .Lmov_bytes
+    eor     r3, r0, r1
+    tst     r3, #3
+    bne     .Lmov_bytes
+    tst     r0, #3
+    beq     .Lmov_aligned
+.Lmov_align_dst:
+    ldrb    r3, [r1, #-1]!
+    strb    r3, [r0, #-1]!
+    sub     r2, r2, #1
+    tst     r0, #3
+    bne     .Lmov_align_dst
+.Lmov_aligned:
+    push    {r4-r10}
+    subs    r2, r2, #32
+    blo     2f
+1:
+    ldmdb   r1!, {r3-r10}
+    stmdb   r0!, {r3-r10}
+    subs    r2, r2, #32
+    bhs     1b
+2:
+    pop     {r4-r10}
+    add     r2, r2, #32
+.Lmov_words:
+    subs    r2, r2, #4
+    ldrhs   r3, [r1, #-4]!
+    strhs   r3, [r0, #-4]!
+    bhs     .Lmov_words
+    add     r2, r2, #4
+.Lmov_bytes:
+    subs    r2, r2, #1
+    ldrbhs  r3, [r1, #-1]!
+    strbhs  r3, [r0, #-1]!
+    bhs     .Lmov_bytes
+    mov     r0, ip
+    bx      lr
+.size memmove, .-memmove
+
+.section .text.memset, "ax", %progbits
+.balign 4
+.global memzero
+.type memzero, %function
+memzero:
+    mov     r2, r1
+    mov     r1, #0
+.global memset
+.type memset, %function
+memset:
+    mov     ip, r0
+    and     r1, r1, #0xFF
+    cmp     r2, #8
+    blo     .Lset_bytes
+    orr     r1, r1, r1, lsl #8
+    orr     r1, r1, r1, lsl #16
+    tst     r0, #3
+    beq     .Lset_aligned
+.Lset_align_dst:
+    strb    r1, [r0], #1
+    sub     r2, r2, #1
+    tst     r0, #3
+    bne     .Lset_align_dst
+.Lset_aligned:
+    push    {r4-r8, lr}
+    mov     r3, r1
+    mov     r4, r1
+    mov     r5, r1
+    mov     r6, r1
+    mov     r7, r1
+    mov     r8, r1
+    mov     lr, r1
+    subs    r2, r2, #32
+    blo     2f
+1:
+    stmia   r0!, {r1, r3-r8, lr}
+    subs    r2, r2, #32
+    bhs     1b
+2:
+    pop     {r4-r8, lr}
+    add     r2, r2, #32
+.Lset_words:
+    subs    r2, r2, #4
+    strhs   r1, [r0], #4
+    bhs     .Lset_words
+    add     r2, r2, #4
+.Lset_bytes:
+    subs    r2, r2, #1
+    strbhs  r1, [r0], #1
+    bhs     .Lset_bytes
+    mov     r0, ip
+    bx      lr
+.size memset, .-memset
+.size memzero, .-memzero
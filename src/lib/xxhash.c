@@ -0,0 +1,130 @@
+#include "xxhash.h"
+
+#define PRIME1 2654435761U
+#define PRIME2 2246822519U
+#define PRIME3 3266489917U
+#define PRIME4 668265263U
+#define PRIME5 374761393U
+
+/* The input has no alignment guarantees but the BPMP can't do unaligned
+loads, so whole 16 byte stripes are read as words only when the pointer
+allows it and assembled from bytes otherwise. Assumes a little-endian CPU. */
+
+static inline uint32_t rotl32(uint32_t x, unsigned int r)
+{
+   return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t read_le32(const uint8_t* p)
+{
+   return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t xxh32_round(uint32_t acc, uint32_t input)
+{
+   acc += input * PRIME2;
+   return rotl32(acc, 13) * PRIME1;
+}
+
+static const uint8_t* consume_stripes(uint32_t acc[4], const uint8_t* p, size_t numStripes)
+{
+   uint32_t v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+   if (((uintptr_t)p & 3) == 0)
+   {
+      const uint32_t* w = (const uint32_t*)p;
+      while (numStripes-- > 0)
+      {
+         v1 = xxh32_round(v1, w[0]);
+         v2 = xxh32_round(v2, w[1]);
+         v3 = xxh32_round(v3, w[2]);
+         v4 = xxh32_round(v4, w[3]);
+         w += 4;
+      }
+      p = (const uint8_t*)w;
+   }
+   else
+   {
+      while (numStripes-- > 0)
+      {
+         v1 = xxh32_round(v1, read_le32(p));
+         v2 = xxh32_round(v2, read_le32(p+4));
+         v3 = xxh32_round(v3, read_le32(p+8));
+         v4 = xxh32_round(v4, read_le32(p+12));
+         p += 16;
+      }
+   }
+   acc[0] = v1; acc[1] = v2; acc[2] = v3; acc[3] = v4;
+   return p;
+}
+
+void xxh32_init(XXH32_STATE* state, uint32_t seed)
+{
+   state->acc[0] = seed + PRIME1 + PRIME2;
+   state->acc[1] = seed + PRIME2;
+   state->acc[2] = seed;
+   state->acc[3] = seed - PRIME1;
+   state->seed = seed;
+   state->totalLen = 0;
+   state->stripeLen = 0;
+}
+
+void xxh32_update(XXH32_STATE* state, const void* buf, size_t len)
+{
+   const uint8_t* p = buf;
+   state->totalLen += (uint32_t)len;
+
+   if (state->stripeLen > 0)
+   {
+      while (len > 0 && state->stripeLen < sizeof(state->stripe))
+      {
+         state->stripe[state->stripeLen++] = *p++;
+         len--;
+      }
+      if (state->stripeLen < sizeof(state->stripe))
+         return;
+
+      consume_stripes(state->acc, state->stripe, 1);
+      state->stripeLen = 0;
+   }
+
+   p = consume_stripes(state->acc, p, len / 16);
+   len %= 16;
+   while (len-- > 0)
+      state->stripe[state->stripeLen++] = *p++;
+}
+
+uint32_t xxh32_digest(const XXH32_STATE* state)
+{
+   uint32_t h;
+   if (state->totalLen >= 16)
+   {
+      h = rotl32(state->acc[0], 1) + rotl32(state->acc[1], 7) +
+          rotl32(state->acc[2], 12) + rotl32(state->acc[3], 18);
+   }
+   else
+      h = state->seed + PRIME5;
+
+   h += state->totalLen;
+
+   const uint8_t* p = state->stripe;
+   uint32_t len = state->stripeLen;
+   for (; len >= 4; len -= 4, p += 4)
+      h = rotl32(h + read_le32(p) * PRIME3, 17) * PRIME4;
+   for (; len > 0; len--, p++)
+      h = rotl32(h + *p * PRIME5, 11) * PRIME1;
+
+   h ^= h >> 15;
+   h *= PRIME2;
+   h ^= h >> 13;
+   h *= PRIME3;
+   h ^= h >> 16;
+   return h;
+}
+
+uint32_t xxh32(const void* buf, size_t len, uint32_t seed)
+{
+   XXH32_STATE state;
+   xxh32_init(&state, seed);
+   xxh32_update(&state, buf, len);
+   return xxh32_digest(&state);
+}
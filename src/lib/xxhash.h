@@ -0,0 +1,26 @@
+#ifndef _XXHASH_H_
+#define _XXHASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Incremental xxHash32 as used by the LZ4 frame format for its header, block
+   and content checksums. Start with xxh32_init, feed the data in pieces of any
+   size with xxh32_update, and xxh32_digest gives the hash of all of it. */
+typedef struct XXH32_STATE_s
+{
+   uint32_t acc[4];
+   uint32_t seed;
+   uint32_t totalLen;
+   uint8_t stripe[16];
+   uint32_t stripeLen;
+} XXH32_STATE;
+
+void xxh32_init(XXH32_STATE* state, uint32_t seed);
+void xxh32_update(XXH32_STATE* state, const void* buf, size_t len);
+uint32_t xxh32_digest(const XXH32_STATE* state);
+
+/* One shot version of the above */
+uint32_t xxh32(const void* buf, size_t len, uint32_t seed);
+
+#endif
@@ -20,8 +20,14 @@
 #include "usb_output.h"
 #include "storage.h"
 #include "lib/ff.h"
+#include "lib/diskio.h"
 #include "lib/decomp.h"
+#include "lib/blzdecode.h"
+#include "lib/memops.h"
 #include "iniparse.h"
+#include "mlplan.h"
+#include "execplan.h"
+#include "sectexec.h"
 #include "cbmem.h"
 #include <alloca.h>
 #include <strings.h>
@@ -71,6 +77,15 @@ static void deinitialize_storage()
     }
 }
 
+static int name_has_extension(const char* nameStr, size_t nameLen, const char* extension)
+{
+    const size_t extLen = strlen(extension);
+    if (nameLen < extLen)
+        return 0;
+
+    return strcasecmp(&nameStr[nameLen-extLen], extension) == 0;
+}
+
 static NOINLINE int display_file_picker(char* outFilenameBuf, size_t* outFilesizeBuf, int currSelection)
 {
     typedef struct fileEntry_s
@@ -118,11 +133,7 @@ static NOINLINE int display_file_picker(char* outFilenameBuf, size_t* outFilesiz
                     nameLen = strlen(fno.altname);
                 }
 
-                static const char REQUIRED_EXTENSION[] = ".ini";
-                if (nameLen < ARRAY_SIZE(REQUIRED_EXTENSION)-1)
-                    continue;
-
-                if (strcasecmp(&nameStr[nameLen-(ARRAY_SIZE(REQUIRED_EXTENSION)-1)], REQUIRED_EXTENSION))
+                if (!name_has_extension(nameStr, nameLen, ".ini") && !name_has_extension(nameStr, nameLen, MLPLAN_EXTENSION))
                     continue;
 
                 if (lastFile == NULL)
@@ -248,8 +259,8 @@ static NOINLINE int display_file_picker(char* outFilenameBuf, size_t* outFilesiz
     return 0; 
 }
 
-static NOINLINE int read_and_parse_ini(const char* pickedName, size_t pickedSize, IniParsedInfo_t* outInfoPtr)
-{    
+static int read_whole_file(const char* pickedName, size_t pickedSize, char* outBytes, UINT* outBytesRead)
+{
     FIL fp;
     memset(&fp, 0, sizeof(fp));
 
@@ -262,9 +273,8 @@ static NOINLINE int read_and_parse_ini(const char* pickedName, size_t pickedSize
     }
     else
     {
-        char* iniBytes = alloca(pickedSize+1);
         UINT bytesRead = 0;
-        res = f_read(&fp, iniBytes, pickedSize, &bytesRead);
+        res = f_read(&fp, outBytes, pickedSize, &bytesRead);
         f_close(&fp);
 
         if (res != FR_OK)
@@ -276,62 +286,605 @@ static NOINLINE int read_and_parse_ini(const char* pickedName, size_t pickedSize
         else if (bytesRead != pickedSize)
             printk("Warning, only read %u out of %u bytes from file '%s' on sd card\n", bytesRead, pickedSize, pickedName);
 
-        iniBytes[bytesRead] = 0;
-        printk("Read %u bytes from '%s', parsing...", bytesRead, pickedName);
+        *outBytesRead = bytesRead;
+        return 1;
+    }
+}
+
+static NOINLINE int read_ini_file(const char* pickedName, size_t pickedSize, char* iniBytes, UINT* outBytesRead)
+{    
+    UINT bytesRead = 0;
+    if (!read_whole_file(pickedName, pickedSize, iniBytes, &bytesRead))
+        return 0;
+
+    iniBytes[bytesRead] = 0;
+    printk("Read %u bytes from '%s', parsing...", bytesRead, pickedName);
+    video_clear_line();
+
+    *outBytesRead = bytesRead;
+    return 1;
+}
+
+//the plan is used in place, so planBytes has to stay valid until its sections are executed
+static int read_and_load_plan(const char* pickedName, size_t pickedSize, void* planBytes, IniParsedInfo_t* outInfoPtr)
+{
+    UINT bytesRead = 0;
+    if (!read_whole_file(pickedName, pickedSize, planBytes, &bytesRead))
+        return 0;
+
+    printk("Read %u bytes from '%s', loading plan...", bytesRead, pickedName);
+    video_clear_line();
+
+    return mlplan_load(planBytes, bytesRead, outInfoPtr, (ErrPrintFunc)printk);
+}
+
+static const u32 DOTS_PER_LINE = 90;
+
+//Tegra/Horizon configuration goes to 0x80000000+, package2 goes to 0xA9800000, we place our heap in between.
+//It holds the sector cache, the fast seek table and the decoder buffers while sections run, the largest being
+//the 4 MiB block buffer of LZ4 frames, so sections may not write there
+static const u32 HEAP_BASE = 0x90020000;
+static const u32 HEAP_SIZE = 0x800000;
+
+static bool overlaps_heap(u32 dst, u64 len)
+{
+    return len != 0 && dst < HEAP_BASE + HEAP_SIZE && dst + len > HEAP_BASE;
+}
+
+//after early training, BOOT trains the remaining rates from the same table, and skips that if it got overwritten
+static bool overlaps_mtc_table(u32 dst, u64 len, u32* outStart, u32* outSize)
+{
+    return len != 0 && mtc_get_table_extent(outStart, outSize) && dst < *outStart + *outSize && dst + len > *outStart;
+}
+
+static int check_section_dst(const char* sectname, u32 dst, u64 len)
+{
+    u32 tableStart = 0;
+    u32 tableSize = 0;
+    if (overlaps_heap(dst, len))
+    {
+        printk("ERROR '%s' [0x%08x,0x%08x] overlaps the heap at [0x%08x,0x%08x]", sectname, dst, (u32)len, HEAP_BASE, HEAP_SIZE);
+        video_clear_line();
+        return 0;
+    }
+    if (overlaps_mtc_table(dst, len, &tableStart, &tableSize))
+    {
+        printk("ERROR '%s' [0x%08x,0x%08x] overlaps the MTC table BOOT trains from at [0x%08x,0x%08x]",
+                sectname, dst, (u32)len, tableStart, tableSize);
         video_clear_line();
+        return 0;
+    }
 
-        *outInfoPtr = parse_memloader_ini(iniBytes, bytesRead, malloc, (ErrPrintFunc)printk);
-        return 1;
+    return 1;
+}
+
+static const char* get_comp_type_name(u32 compType)
+{
+    if (compType == 0)
+        return "COPY";
+    else if (compType == 1)
+        return "UNLZMA";
+    else if (compType == 2)
+        return "UNLZ4";
+    else if (compType == 3)
+        return "UNBLZ";
+    else
+        return "UNKNOWN";
+}
+
+typedef struct
+{
+    FIL* fp;
+    const char* filename;
+    size_t startPos;
+    size_t currPos;
+    size_t endPos;
+    u32 progressDotBlockSize;
+    int numProgressDots;
+    bool failed;
+} LoadReader_t;
+
+//number of sectors from the file position to the end of its run of contiguous clusters, 0 if unknown
+static u32 load_file_contiguous_sectors(FIL* fp, DWORD* outSector)
+{
+    if (fp->cltbl == NULL)
+        return 0;
+
+    FATFS* fs = fp->obj.fs;
+    const DWORD* tbl = fp->cltbl + 1;
+    DWORD cl = (DWORD)(fp->fptr / FF_MIN_SS / fs->csize);
+    for (;;)
+    {
+        const DWORD ncl = *tbl++;
+        if (ncl == 0)
+            return 0;
+        if (cl < ncl)
+        {
+            const DWORD sectInClust = (DWORD)(fp->fptr / FF_MIN_SS) & (fs->csize - 1);
+            *outSector = fs->database + fs->csize * (*tbl + cl - 2) + sectInClust;
+            return (ncl - cl) * fs->csize - sectInClust;
+        }
+        cl -= ncl; tbl++;
     }
 }
 
+//decomp_read_func compatible, reads from the current file position up to endPos
+static size_t load_reader_read(void* ctx, void* buf, size_t len)
+{
+    static const size_t READ_BLOCK_SIZE = 4*1024;
+    static const u32 MAX_DIRECT_READ_SECTORS = 0xFFFF; //most blocks a single CMD18 can transfer
+    LoadReader_t* rdr = ctx;
+    if (rdr->failed)
+        return 0;
+    if (len > rdr->endPos - rdr->currPos)
+        len = rdr->endPos - rdr->currPos;
+
+    u8* currMemAddr = buf;
+    size_t totalRead = 0;
+    while (totalRead < len)
+    {
+        size_t bytesToRead = len - totalRead;
+        const size_t sectorOffset = rdr->currPos % FF_MIN_SS;
+
+        //whole sectors within a run of contiguous clusters go straight from the card in one command,
+        //the DMA engine needs the destination 8-byte aligned for that
+        DWORD sector = 0;
+        u32 numSectors = 0;
+        if (sectorOffset == 0 && bytesToRead >= FF_MIN_SS && ((u32)currMemAddr & 7) == 0)
+            numSectors = load_file_contiguous_sectors(rdr->fp, &sector);
+
+        UINT bytesRead = 0;
+        FRESULT res = FR_OK;
+        if (numSectors > 0)
+        {
+            if (numSectors > bytesToRead / FF_MIN_SS)
+                numSectors = bytesToRead / FF_MIN_SS;
+            if (numSectors > MAX_DIRECT_READ_SECTORS)
+                numSectors = MAX_DIRECT_READ_SECTORS;
+
+            bytesToRead = numSectors * FF_MIN_SS;
+            if (disk_read(rdr->fp->obj.fs->pdrv, currMemAddr, sector, numSectors) != RES_OK)
+                res = FR_DISK_ERR;
+            else if ((res = f_lseek(rdr->fp, rdr->currPos + bytesToRead)) == FR_OK)
+                bytesRead = bytesToRead;
+        }
+        else
+        {
+            //stop at the next sector boundary so the following reads can take the direct path
+            if (sectorOffset != 0 && bytesToRead > FF_MIN_SS - sectorOffset)
+                bytesToRead = FF_MIN_SS - sectorOffset;
+            else if (bytesToRead > READ_BLOCK_SIZE)
+                bytesToRead = READ_BLOCK_SIZE;
+
+            res = f_read(rdr->fp, currMemAddr, bytesToRead, &bytesRead);
+        }
+
+        if (res != FR_OK)
+        {
+            printk("ERROR %d reading %u bytes from offset %u in file '%s'", res, bytesToRead, rdr->currPos, rdr->filename);
+            video_clear_line();
+            rdr->failed = true;
+            break;
+        }
+        else if (bytesRead == 0)
+            break;
+
+        rdr->currPos += bytesRead;
+        currMemAddr += bytesRead;
+        totalRead += bytesRead;
+
+        int newProgressDots = (rdr->currPos-rdr->startPos)/rdr->progressDotBlockSize;
+        while (newProgressDots > rdr->numProgressDots)
+        {
+            video_puts(".");
+            rdr->numProgressDots++;
+        }
+    }
+
+    return totalRead;
+}
+
+//LOAD sections often all read from the same file (e.g. cbfs2ini output), so keep the last one open.
+//That saves the directory lookup, and the fast seek table built on open makes f_lseek independent of the FAT chain
+typedef struct
+{
+    char filename[FF_LFN_BUF + 1];
+    FIL fp;
+    DWORD* clmt; //cluster link map for fast seek, NULL if unavailable
+    bool isOpen;
+} LoadFileCache_t;
+
+static LoadFileCache_t loadFileCache;
+
+static void load_file_cache_close()
+{
+    if (loadFileCache.isOpen)
+    {
+        f_close(&loadFileCache.fp);
+        loadFileCache.isOpen = false;
+    }
+    if (loadFileCache.clmt != NULL)
+    {
+        free(loadFileCache.clmt);
+        loadFileCache.clmt = NULL;
+    }
+}
+
+//walks the FAT chain once so every later f_lseek in this file is a table lookup instead.
+//The table lives on the heap, which check_section_dst keeps every section from writing over
+static FRESULT load_file_create_clmt(FIL* fp)
+{
+    static const DWORD INITIAL_CLMT_ITEMS = 64;
+
+    DWORD numItems = INITIAL_CLMT_ITEMS;
+    for (;;)
+    {
+        //the heap is bounded, without room for the table seeks just walk the FAT chain like before
+        loadFileCache.clmt = malloc(numItems * sizeof(DWORD));
+        if (loadFileCache.clmt == NULL)
+            return FR_OK;
+
+        loadFileCache.clmt[0] = numItems;
+        fp->cltbl = loadFileCache.clmt;
+
+        FRESULT res = f_lseek(fp, CREATE_LINKMAP);
+        if (res == FR_OK)
+            return FR_OK;
+
+        //first item now holds the number required
+        numItems = loadFileCache.clmt[0];
+        fp->cltbl = NULL;
+        free(loadFileCache.clmt);
+        loadFileCache.clmt = NULL;
+
+        if (res != FR_NOT_ENOUGH_CORE)
+            return res;
+    }
+}
+
+static FRESULT load_file_cache_open(const char* filename, FIL** outFp)
+{
+    if (loadFileCache.isOpen && strcasecmp(loadFileCache.filename, filename) == 0)
+    {
+        *outFp = &loadFileCache.fp;
+        return FR_OK;
+    }
+
+    load_file_cache_close();
+    const size_t nameLen = strlen(filename);
+    if (nameLen >= sizeof(loadFileCache.filename))
+        return FR_INVALID_NAME;
+
+    memset(&loadFileCache.fp, 0, sizeof(loadFileCache.fp));
+    FRESULT res = f_open(&loadFileCache.fp, filename, FA_READ | FA_OPEN_EXISTING);
+    if (res != FR_OK)
+        return res;
+
+    loadFileCache.isOpen = true;
+    res = load_file_create_clmt(&loadFileCache.fp);
+    if (res != FR_OK)
+    {
+        load_file_cache_close();
+        return res;
+    }
+
+    memcpy(loadFileCache.filename, filename, nameLen+1);
+    *outFp = &loadFileCache.fp;
+    return FR_OK;
+}
+
+static int get_mbr_partition(sdmmc_storage_t* stor, u8 partNum, u32* outStart, u32* outSize)
+{
+    u64 mbr[FF_MIN_SS/sizeof(u64)]; //DMA needs 8 byte alignment
+    if (!sdmmc_storage_read(stor, 0, 1, mbr))
+        return 0;
+
+    const u8* mbrBytes = (const u8*)mbr;
+    if (mbrBytes[510] != 0x55 || mbrBytes[511] != 0xAA)
+        return 0;
+
+    const u8* entry = &mbrBytes[0x1BE + (partNum-1)*16];
+    if (entry[4] == 0) //partition type, empty entry
+        return 0;
+
+    memcpy(outStart, &entry[8], sizeof(u32));
+    memcpy(outSize, &entry[12], sizeof(u32));
+    return 1;
+}
+
+//reads sectors straight from the card, for images kept at a fixed place outside the filesystem
+static NOINLINE int execute_raw_load_section(IniLoadSection_t* sect)
+{
+    static const u32 MAX_READ_SECTORS = 0xFFFF; //most blocks a single CMD18 can transfer
+
+    printk("LOAD '%s' (part%u[0x%08x,0x%08x]) -> 0x%08x", sect->sectname, sect->part, sect->lba, sect->sectors, sect->dst);
+    video_clear_line();
+
+    if (sect->compType != 0)
+    {
+        printk("ERROR raw sector LOADs can't be decompressed, use COPY afterwards");
+        video_clear_line();
+        return 0;
+    }
+    if ((sect->dst & 7) != 0)
+    {
+        printk("ERROR dst 0x%08x must be 8-byte aligned for raw sector reads", sect->dst);
+        video_clear_line();
+        return 0;
+    }
+
+    sdmmc_storage_t* stor = get_storage_for_index(0);
+    u32 firstSector = sect->lba;
+    u32 numSectors = sect->sectors;
+    if (sect->part != 0)
+    {
+        u32 partStart = 0;
+        u32 partSize = 0;
+        if (!get_mbr_partition(stor, sect->part, &partStart, &partSize))
+        {
+            printk("ERROR MBR partition %u not found on the card", sect->part);
+            video_clear_line();
+            return 0;
+        }
+        if (sect->lba >= partSize || numSectors > partSize - sect->lba)
+        {
+            printk("ERROR sectors [0x%08x,0x%08x] outside of partition %u size 0x%08x", sect->lba, numSectors, sect->part, partSize);
+            video_clear_line();
+            return 0;
+        }
+
+        if (numSectors == 0)
+            numSectors = partSize - sect->lba;
+
+        firstSector += partStart;
+    }
+    else if (numSectors == 0)
+    {
+        printk("ERROR LOAD section needs either if= or sectors=");
+        video_clear_line();
+        return 0;
+    }
+    if (numSectors > (0u - sect->dst) / FF_MIN_SS)
+    {
+        printk("ERROR 0x%08x sectors don't fit at dst 0x%08x", numSectors, sect->dst);
+        video_clear_line();
+        return 0;
+    }
+    if (!check_section_dst(sect->sectname, sect->dst, (u64)numSectors * FF_MIN_SS))
+        return 0;
+
+    u32 progressDotSectors = numSectors/DOTS_PER_LINE;
+    if (progressDotSectors < 1)
+        progressDotSectors = 1;
+
+    int numProgressDots = 0;
+    u8* currMemAddr = (u8*)sect->dst;
+    for (u32 sectorsRead = 0; sectorsRead < numSectors;)
+    {
+        u32 sectorsToRead = numSectors - sectorsRead;
+        if (sectorsToRead > MAX_READ_SECTORS)
+            sectorsToRead = MAX_READ_SECTORS;
+
+        if (!sdmmc_storage_read(stor, firstSector + sectorsRead, sectorsToRead, currMemAddr))
+        {
+            printk("ERROR reading %u sectors from sector %u", sectorsToRead, firstSector + sectorsRead);
+            video_clear_line();
+            return 0;
+        }
+
+        sectorsRead += sectorsToRead;
+        currMemAddr += sectorsToRead * FF_MIN_SS;
+
+        int newProgressDots = sectorsRead/progressDotSectors;
+        while (newProgressDots > numProgressDots)
+        {
+            video_puts(".");
+            numProgressDots++;
+        }
+    }
+
+    video_clear_line();
+    return 1;
+}
+
+static NOINLINE int execute_load_section(IniLoadSection_t* sect)
+{
+    if (sect->filename == NULL)
+        return execute_raw_load_section(sect);
+
+    if (sect->compType == 0)
+        printk("LOAD '%s' (%s[0x%08x,0x%08x]) -> 0x%08x", sect->sectname, sect->filename, sect->skip, sect->count, sect->dst);
+    else
+    {
+        printk("LOAD+%s '%s' (%s[0x%08x,0x%08x]) -> [0x%08x,0x%08x]", get_comp_type_name(sect->compType), 
+                sect->sectname, sect->filename, sect->skip, sect->count, sect->dst, sect->dstlen);
+    }
+    video_clear_line();
+
+    FIL* fp = NULL;
+    FRESULT res = load_file_cache_open(sect->filename, &fp);
+    if (res != FR_OK)
+    {
+        printk("ERROR %d opening file '%s', does it exist?", res, sect->filename);
+        video_clear_line();
+        return 0;
+    }
+    const size_t fileSize = (size_t)f_size(fp);
+
+    if (fileSize < sect->skip)
+    {
+        printk("ERROR file '%s' is smaller than the start offset %u!", sect->filename, sect->skip);
+        video_clear_line();
+        return 0;
+    }
+
+    size_t firstExtent = sect->skip;
+    size_t lastExtent = fileSize;
+    size_t bytesToZero = 0;
+    if (sect->count != 0)
+    {
+        lastExtent = sect->skip + sect->count;
+        if (lastExtent > fileSize)
+        {
+            bytesToZero = lastExtent - fileSize;
+            lastExtent = fileSize;
+        }
+    }
+
+    const u64 dstLen = (sect->compType != 0) ? sect->dstlen : (u64)(lastExtent - firstExtent) + bytesToZero;
+    if (!check_section_dst(sect->sectname, sect->dst, dstLen))
+        return 0;
+
+    res = f_lseek(fp, firstExtent);
+    if (res != FR_OK)
+    {
+        printk("ERROR %d seeking to %u in file '%s'", res, firstExtent, sect->filename);
+        video_clear_line();
+        load_file_cache_close();
+        return 0;
+    }
+
+    LoadReader_t rdr;
+    memset(&rdr, 0, sizeof(rdr));
+    rdr.fp = fp;
+    rdr.filename = sect->filename;
+    rdr.startPos = firstExtent;
+    rdr.currPos = firstExtent;
+    rdr.endPos = lastExtent;
+    rdr.progressDotBlockSize = (lastExtent-firstExtent)/DOTS_PER_LINE;
+    if (rdr.progressDotBlockSize < 1)
+        rdr.progressDotBlockSize = 1;
+
+    size_t len = 0;
+    const int retVal = load_section_fill(sect, load_reader_read, &rdr, lastExtent-firstExtent, bytesToZero, &len);
+    if (!retVal && !rdr.failed)
+    {
+        if (sect->compType == 0)
+            printk("ERROR unexpected end of file '%s' at offset %u", sect->filename, rdr.currPos);
+        else
+            printk("ERROR!");
+    }
+    else if (retVal && sect->compType != 0)
+        printk("OK! (%u bytes)", len);
+
+    if (retVal == 0)
+        load_file_cache_close();
+
+    video_clear_line();
+    return retVal;
+}
+
 static NOINLINE int execute_copy_section(IniCopySection_t* sect)
 {
     int retVal = 0;
 
-    const char* opTypeName = "UNKNOWN";
-    if (sect->compType == 0)
-        opTypeName = "COPY";
-    else if (sect->compType == 1)
-        opTypeName = "UNLZMA";
-    else if (sect->compType == 2)
-        opTypeName = "UNLZ4";
+    const char* opTypeName = get_comp_type_name(sect->compType);
 
     printk("%s '%s' [0x%08x,0x%08x] -> [0x%08x,0x%08x]...", opTypeName, sect->sectname, 
             sect->src, sect->srclen, sect->dst, sect->dstlen);
 
-    if (sect->compType == 0)
+    //decoding LZMA or LZ4 in place needs the compressed data at the tail of dst, ending at least margin bytes
+    //past it, otherwise the output would catch up with input that hasn't been read yet
+    const u64 srcEnd = (u64)sect->src + sect->srclen;
+    const u64 dstEnd = (u64)sect->dst + sect->dstlen;
+    if ((sect->compType == 1 || sect->compType == 2) && sect->src < dstEnd && sect->dst < srcEnd &&
+        (sect->src < sect->dst || srcEnd < dstEnd + sect->margin))
     {
-        if (sect->srclen > 0)
-            memcpy((void*)sect->dst, (void*)sect->src, sect->srclen);
+        printk("ERROR in-place source must start inside dst and end at or after 0x%08x!", (u32)(dstEnd + sect->margin));
+        video_clear_line();
+        return 0;
+    }
 
-        if (sect->dstlen > sect->srclen)
-            memset((u8*)sect->dst+sect->srclen, 0, sect->dstlen-sect->srclen);
+    const u32 dstLen = (sect->compType == 0 && sect->srclen > sect->dstlen) ? sect->srclen : sect->dstlen;
+    if (!check_section_dst(sect->sectname, sect->dst, dstLen))
+        return 0;
 
+    //a COPY that only zero fills has nothing to copy, but that still counts as done
+    size_t len = 0;
+    retVal = copy_section_run(sect, &len);
+    if (!retVal)
+        printk("ERROR!");
+    else if (sect->compType == 0)
         printk("OK!");
-        retVal = (int)sect->srclen;
-    }
     else
+        printk("OK! (%u bytes)", len);
+
+    video_clear_line();
+    return retVal;
+}
+
+//how many bytes a LOAD will write at its dst, 0 if that isn't given by the section itself.
+//Finding out would mean a directory lookup or an MBR read per LOAD, so those just keep their ini order instead.
+//64-bit since sectors alone can add up to more than 4 GiB, build_exec_plan refuses a LOAD that ends past that
+static u64 get_load_write_size(const IniLoadSection_t* sect)
+{
+    if (sect->filename == NULL)
+        return (u64)sect->sectors * FF_MIN_SS;
+    else if (sect->compType != 0)
+        return sect->dstlen;
+
+    return sect->count;
+}
+
+static NOINLINE int execute_load_and_copy_sections(const IniParsedInfo_t* infos)
+{
+    int numLoads = 0;
+    int numCopies = 0;
+    for (IniLoadSectionNode_t* nod=infos->loads; nod!=NULL; nod=nod->next)
+        numLoads++;
+    for (IniCopySectionNode_t* nod=infos->copies; nod!=NULL; nod=nod->next)
+        numCopies++;
+
+    u64* loadSizes = alloca(numLoads * sizeof(u64));
     {
-        size_t len = 0;
-        memset((void*)sect->dst, 0, sect->dstlen);
+        int i = 0;
+        for (IniLoadSectionNode_t* nod=infos->loads; nod!=NULL; nod=nod->next)
+            loadSizes[i++] = get_load_write_size(&nod->curr);
+    }
 
-        if (sect->compType == 1)
-            len = ulzman((void*)sect->src, sect->srclen, (void*)sect->dst, sect->dstlen);
-        else if (sect->compType == 2)
-            len = ulz4fn((void*)sect->src, sect->srclen, (void*)sect->dst, sect->dstlen);
+    ExecStep_t* steps = alloca((numLoads + numCopies) * sizeof(ExecStep_t));
+    const int numSteps = build_exec_plan(infos, loadSizes, steps, (ErrPrintFunc)printk);
+    if (numSteps < 0)
+    {
+        video_clear_line();
+        return 0;
+    }
 
-        if (len == 0)
-            printk("ERROR!");
+    int retVal = 1;
+    for (int i=0; i<numSteps && retVal; i++)
+    {
+        if (steps[i].type == EXEC_STEP_LOAD)
+            retVal = execute_load_section(steps[i].load) ? 1 : 0;
         else
-            printk("OK! (%u bytes)", len);
-
-        retVal = (int)len;
+            retVal = execute_copy_section(steps[i].copy) ? 1 : 0;
     }
-    video_clear_line();
+    load_file_cache_close();
+
+    DISK_CACHE_STATS cacheStats;
+    disk_cache_stats(&cacheStats);
+    dbg_print("Sector cache: %u hits, %u misses\n", cacheStats.hits, cacheStats.misses);
+
     return retVal;
 }
 
+static NOINLINE int execute_early_training(int maxMemoryFreq)
+{
+    //nothing can service periodic training while we are still loading, so only go up to rates that don't need it
+    const int targetMemoryFreq = ABS(maxMemoryFreq) * 1000;
+    printk("TRAIN memory up to %d kHz before loading...", targetMemoryFreq);
+    video_clear_line();
+
+    const u32 startMs = get_tmr_ms();
+    const int newMemoryFreq = mtc_perform_memory_training(targetMemoryFreq);
+    if (newMemoryFreq == 0)
+        printk("ERROR training memory, loading at boot clock!");
+    else
+        printk("Memory now running at %d kHz (took %u ms)", ABS(newMemoryFreq), get_tmr_ms() - startMs);
+
+    video_clear_line();
+    return newMemoryFreq;
+}
+
 static NOINLINE int execute_boot_section(IniBootSection_t* sect, unsigned char* usbBuffer, size_t usbBufLen)
 {
     printk("BOOT section '%s'\n\tpc=0x%08x", sect->sectname, sect->pc);
@@ -373,6 +926,7 @@ static NOINLINE int execute_boot_section(IniBootSection_t* sect, unsigned char*
     else if (sect->codeArch != 0) //cant run periodic training if going to jump to other code on BPMP
         targetMemoryFreq = (targetMemoryFreq < 0) ? (-targetMemoryFreq) : targetMemoryFreq;
 
+    //if memory was already trained before loading, this only switches further up if allowed to
     targetMemoryFreq = mtc_perform_memory_training(targetMemoryFreq);
     u32 lastPeriodicMs = get_tmr_ms();
 
@@ -455,6 +1009,55 @@ static NOINLINE int execute_boot_section(IniBootSection_t* sect, unsigned char*
     return 1;
 }
 
+//runs the sections of the picked ini or plan. Everything they point into is alloca'd here, so it is all
+//released when this returns to the picker instead of piling up in main's frame with every failed attempt
+static NOINLINE void execute_picked_file(const char* pickedName, size_t pickedSize)
+{
+    IniParsedInfo_t infos;
+    memset(&infos, 0, sizeof(IniParsedInfo_t));
+    if (name_has_extension(pickedName, strlen(pickedName), MLPLAN_EXTENSION))
+    {
+        void* planBytes = alloca(pickedSize);
+        read_and_load_plan(pickedName, pickedSize, planBytes, &infos);
+    }
+    else
+    {
+        //the parsed sections point into the ini text and the arena, both stay on this stack frame until BOOT
+        char* iniBytes = alloca(pickedSize+1);
+        UINT iniLen = 0;
+        if (read_ini_file(pickedName, pickedSize, iniBytes, &iniLen))
+        {
+            IniArena_t arena;
+            arena.size = memloader_ini_arena_size(iniBytes, iniLen);
+            arena.base = alloca(arena.size);
+            arena.used = 0;
+            infos = parse_memloader_ini(iniBytes, iniLen, &arena, (ErrPrintFunc)printk);
+        }
+    }
+
+    bool operationFailed = false;
+
+    if (infos.globals.earlyMemoryFreq != 0)
+        execute_early_training(infos.globals.earlyMemoryFreq);
+
+    const u32 loadStartMs = get_tmr_ms();
+    if (!execute_load_and_copy_sections(&infos))
+        operationFailed = true;
+
+    if (!operationFailed && (infos.loads != NULL || infos.copies != NULL))
+    {
+        printk("LOAD and COPY took %u ms", get_tmr_ms() - loadStartMs);
+        video_clear_line();
+    }
+    for (IniBootSectionNode_t* nod=infos.boots; nod!=NULL; nod=nod->next)
+    {
+        if (operationFailed) break;
+        
+        if (!execute_boot_section(&nod->curr, NULL, 0))
+            operationFailed = true;
+    }
+}
+
 int main(void) 
 {
     u32* lfb_base;    
@@ -467,8 +1070,7 @@ int main(void)
     lfb_base = display_init_framebuffer();
     video_init(lfb_base);
 
-    //Tegra/Horizon configuration goes to 0x80000000+, package2 goes to 0xA9800000, we place our heap in between.
-	heap_init(0x90020000);
+	heap_init(HEAP_BASE, HEAP_SIZE);
     //Init the CBFS memory store in case we are booting coreboot
     cbmem_initialize_empty();
 
@@ -484,7 +1086,6 @@ int main(void)
     FATFS fs;
     memset(&fs, 0, sizeof(FATFS));
 
-    static const u32 DOTS_PER_LINE = 90;
     int pickerRow = video_get_row();
 	if (!initialize_mount(&fs, 0))
     {
@@ -514,179 +1115,7 @@ int main(void)
             {
                 selectedFile = myRes-1;
 
-                IniParsedInfo_t infos;
-                memset(&infos, 0, sizeof(IniParsedInfo_t));
-                myRes = read_and_parse_ini(pickedName, pickedSize, &infos);
-                if (myRes > 0)
-                {
-                    IniParsedInfo_t stackInfos;
-                    memset(&stackInfos, 0, sizeof(IniParsedInfo_t));
-
-                    #define STACK_STRDUP(srcString, dstPtr) \
-                    if (srcString != NULL) {\
-                        size_t nameLen = strlen(srcString); \
-                        dstPtr = alloca(nameLen+1); \
-                        memcpy(dstPtr, srcString, nameLen+1); } \
-                    else { dstPtr = NULL; }
-
-                    #define ALLOCA_NODE(currNodePtr, firstNodePtr, nodeType) \
-                    if (currNodePtr == NULL) { \
-                        firstNodePtr = alloca(sizeof(nodeType)); \
-                        currNodePtr = firstNodePtr; } else { \
-                        currNodePtr->next = alloca(sizeof(nodeType)); \
-                        currNodePtr = currNodePtr->next; } \
-                        currNodePtr->next = NULL
-
-                    IniLoadSectionNode_t* currLoad = NULL;
-                    for (IniLoadSectionNode_t* nod=infos.loads; nod!=NULL; nod=nod->next)
-                    {
-                        ALLOCA_NODE(currLoad, stackInfos.loads, IniLoadSectionNode_t);
-                        memcpy(&currLoad->curr, &nod->curr, sizeof(nod->curr));
-                        STACK_STRDUP(nod->curr.sectname, currLoad->curr.sectname);
-                        STACK_STRDUP(nod->curr.filename, currLoad->curr.filename);
-                    }
-                    IniCopySectionNode_t* currCopy = NULL;
-                    for (IniCopySectionNode_t* nod=infos.copies; nod!=NULL; nod=nod->next)
-                    {
-                        ALLOCA_NODE(currCopy, stackInfos.copies, IniCopySectionNode_t);
-                        memcpy(&currCopy->curr, &nod->curr, sizeof(nod->curr));
-                        STACK_STRDUP(nod->curr.sectname, currCopy->curr.sectname);
-                    }
-                    IniBootSectionNode_t* currBoot = NULL;
-                    for (IniBootSectionNode_t* nod=infos.boots; nod!=NULL; nod=nod->next)
-                    {
-                        ALLOCA_NODE(currBoot, stackInfos.boots, IniBootSectionNode_t);
-                        memcpy(&currBoot->curr, &nod->curr, sizeof(nod->curr));
-                        STACK_STRDUP(nod->curr.sectname, currBoot->curr.sectname);
-                    }
-                    free_memloader_info(&infos, free);
-                    memcpy(&infos, &stackInfos, sizeof(infos));
-
-                    #undef STACK_STRDUP
-                    #undef ALLOCA_NODE
-                }
-
-                bool operationFailed = false;
-
-                for (IniLoadSectionNode_t* nod=infos.loads; nod!=NULL; nod=nod->next)
-                {
-                    if (operationFailed) break;
-
-                    printk("LOAD '%s' (%s[0x%08x,0x%08x]) -> 0x%08x", nod->curr.sectname, nod->curr.filename, nod->curr.skip, nod->curr.count, nod->curr.dst);
-                    video_clear_line();
-
-                    size_t fileSize = 0;
-                    {
-                        FILINFO finfo;
-                        memset(&finfo, 0, sizeof(finfo));
-                        FRESULT res = f_stat(nod->curr.filename, &finfo);
-                        if (res != FR_OK)
-                        {
-                            printk("ERROR %d inspecting file '%s', does it exist?", res, nod->curr.filename);
-                            video_clear_line();
-                            operationFailed = true;
-                            break;
-                        }
-                        fileSize = (size_t)finfo.fsize;
-                    }          
-
-                    if (fileSize < nod->curr.skip)
-                    {
-                        printk("ERROR file '%s' is smaller than the start offset %u!", nod->curr.filename, nod->curr.skip);
-                        operationFailed = true;
-                        break;
-                    }
-
-                    size_t firstExtent = nod->curr.skip;
-                    size_t lastExtent = fileSize;
-                    size_t bytesToZero = 0;
-                    if (nod->curr.count != 0)
-                    {
-                        lastExtent = nod->curr.skip + nod->curr.count;
-                        if (lastExtent > fileSize)
-                        {
-                            bytesToZero = lastExtent - fileSize;
-                            lastExtent = fileSize;
-                        }
-                    }
-
-                    FIL fp;
-                    memset(&fp, 0, sizeof(fp));
-                    FRESULT res = f_open(&fp, nod->curr.filename, FA_READ | FA_OPEN_EXISTING);
-                    if (res != FR_OK)
-                    {
-                        printk("ERROR %d opening file '%s'", res, nod->curr.filename);
-                        video_clear_line();
-                        operationFailed = true;
-                        break;
-                    }
-                    else
-                    {
-                        res = f_lseek(&fp, firstExtent);
-                        if (res != FR_OK)
-                        {
-                            printk("ERROR %d seeking to %u in file '%s'", res, firstExtent, nod->curr.filename);
-                            video_clear_line();
-                            operationFailed = true;
-                            f_close(&fp);
-                            break;
-                        }
-
-                        int numProgressDots = 0;
-                        u32 progressDotBlockSize = (lastExtent-firstExtent)/DOTS_PER_LINE;
-                        if (progressDotBlockSize < 1)
-                            progressDotBlockSize = 1;
-                        
-                        u8* currMemAddr = (void*)nod->curr.dst;
-                        for (size_t currFilePos = firstExtent; currFilePos<lastExtent;)
-                        {
-                            static const size_t READ_BLOCK_SIZE = 4*1024;
-                            size_t bytesToRead = lastExtent-currFilePos;
-                            if (bytesToRead > READ_BLOCK_SIZE)
-                                bytesToRead = READ_BLOCK_SIZE;
-
-                            UINT bytesRead = 0;
-                            res = f_read(&fp, currMemAddr, bytesToRead, &bytesRead);
-                            if (res != FR_OK)
-                            {
-                                printk("ERROR %d reading %u bytes from offset %u in file '%s'", res, bytesToRead, currFilePos, nod->curr.filename);
-                                video_clear_line();
-                                operationFailed = true;
-                                break;
-                            }
-
-                            currFilePos += bytesRead;
-                            currMemAddr += bytesRead;
-
-                            int newProgressDots = (currFilePos-firstExtent)/progressDotBlockSize;
-                            while (newProgressDots > numProgressDots)
-                            {
-                                video_puts(".");
-                                numProgressDots++;
-                            }
-                        }
-                        f_close(&fp);
-
-                        if (!operationFailed && bytesToZero > 0)
-                            memset(currMemAddr, 0, bytesToZero);
-
-                        video_clear_line();
-                    }
-                }
-                for (IniCopySectionNode_t* nod=infos.copies; nod!=NULL; nod=nod->next)
-                {
-                    if (operationFailed) break;
-
-                    if (!execute_copy_section(&nod->curr))
-                        operationFailed = true;
-                }
-                for (IniBootSectionNode_t* nod=infos.boots; nod!=NULL; nod=nod->next)
-                {
-                    if (operationFailed) break;
-                    
-                    if (!execute_boot_section(&nod->curr, NULL, 0))
-                        operationFailed = true;
-                }
+                execute_picked_file(pickedName, pickedSize);
             }
             else
                 break;
@@ -745,9 +1174,10 @@ int main(void)
                 CMD_RECV,
                 CMD_COPY,
                 CMD_BOOT,
+                CMD_FREQ,
                 CMD_COUNT
             } lastCommand = CMD_NONE;
-            static const u32 BYTES_TO_RECV[CMD_COUNT] = { 4, 8, 20, 4 };
+            static const u32 BYTES_TO_RECV[CMD_COUNT] = { 4, 8, 20, 4, 4 };
             
             video_clear_line();
             while (retVal == 0)
@@ -767,6 +1197,7 @@ int main(void)
                 static const char RECV_COMMAND_STRING[] = "RECV";
                 static const char COPY_COMMAND_STRING[] = "COPY";
                 static const char BOOT_COMMAND_STRING[] = "BOOT";
+                static const char FREQ_COMMAND_STRING[] = "FREQ";
                 if (lastCommand == CMD_NONE)
                 {
                     if (bytesTransferred == ARRAY_SIZE(RECV_COMMAND_STRING)-1 && !strcmp((char*)usbBuffer, RECV_COMMAND_STRING))
@@ -775,6 +1206,8 @@ int main(void)
                         lastCommand = CMD_COPY;
                     else if (bytesTransferred == ARRAY_SIZE(BOOT_COMMAND_STRING)-1 && !strcmp((char*)usbBuffer, BOOT_COMMAND_STRING))
                         lastCommand = CMD_BOOT;
+                    else if (bytesTransferred == ARRAY_SIZE(FREQ_COMMAND_STRING)-1 && !strcmp((char*)usbBuffer, FREQ_COMMAND_STRING))
+                        lastCommand = CMD_FREQ;
                     else
                     {
                         printk("Unknown command %s received with size %u bytes, retrying.\n", (char*)usbBuffer, bytesTransferred);
@@ -788,6 +1221,19 @@ int main(void)
 
                     printk("RECV 0x%08x bytes -> 0x%08x", xferLength, startAddr);
                     video_clear_line();
+                    //the host sends the data regardless, so only warn
+                    u32 tableStart = 0;
+                    u32 tableSize = 0;
+                    if (overlaps_heap(startAddr, xferLength))
+                    {
+                        printk("Warning, this overlaps the heap at [0x%08x,0x%08x]", HEAP_BASE, HEAP_SIZE);
+                        video_clear_line();
+                    }
+                    else if (overlaps_mtc_table(startAddr, xferLength, &tableStart, &tableSize))
+                    {
+                        printk("Warning, this overlaps the MTC table BOOT trains from at [0x%08x,0x%08x]", tableStart, tableSize);
+                        video_clear_line();
+                    }
 
                     int numProgressDots = 0;
                     u32 progressDotBlockSize = xferLength/DOTS_PER_LINE;
@@ -831,6 +1277,7 @@ int main(void)
                     copySect.srclen = __builtin_bswap32(*(u32*)(&usbBuffer[8]));
                     copySect.dst = __builtin_bswap32(*(u32*)(&usbBuffer[12]));
                     copySect.dstlen = __builtin_bswap32(*(u32*)(&usbBuffer[16]));
+                    copySect.margin = 0;
 
                     execute_copy_section(&copySect);
                     lastCommand = CMD_NONE;
@@ -852,6 +1299,13 @@ int main(void)
                     execute_boot_section(&bootSect, usbBuffer, USB_BLOCK_SIZE);
                     lastCommand = CMD_NONE;
                 }
+                else if (lastCommand == CMD_FREQ && bytesTransferred == BYTES_TO_RECV[CMD_FREQ])
+                {
+                    //same MHz units as maxMemoryFreq, trains before further RECV/COPY
+                    const int maxMemoryFreq = (int)__builtin_bswap32(*(u32*)(&usbBuffer[0]));
+                    execute_early_training(maxMemoryFreq);
+                    lastCommand = CMD_NONE;
+                }
                 else
                 {
                     printk("\rUnknown command buffer received of len %u, contents: %02x%02x%02x%02x\n\n", bytesTransferred, 
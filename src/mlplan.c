@@ -0,0 +1,135 @@
+#include "mlplan.h"
+#include <string.h>
+
+//plan nodes become the parsed nodes in place, which only works if the layouts match exactly
+_Static_assert(sizeof(void*) == sizeof(uint32_t), "boot plans store pointers as 32-bit offsets");
+_Static_assert(sizeof(MlpLoadNode_t) == sizeof(IniLoadSectionNode_t), "MlpLoadNode_t layout mismatch");
+_Static_assert(offsetof(MlpLoadNode_t, part) == offsetof(IniLoadSectionNode_t, curr.part), "MlpLoadNode_t layout mismatch");
+_Static_assert(offsetof(MlpLoadNode_t, next) == offsetof(IniLoadSectionNode_t, next), "MlpLoadNode_t layout mismatch");
+_Static_assert(sizeof(MlpCopyNode_t) == sizeof(IniCopySectionNode_t), "MlpCopyNode_t layout mismatch");
+_Static_assert(offsetof(MlpCopyNode_t, margin) == offsetof(IniCopySectionNode_t, curr.margin), "MlpCopyNode_t layout mismatch");
+_Static_assert(offsetof(MlpCopyNode_t, next) == offsetof(IniCopySectionNode_t, next), "MlpCopyNode_t layout mismatch");
+_Static_assert(sizeof(MlpBootNode_t) == sizeof(IniBootSectionNode_t), "MlpBootNode_t layout mismatch");
+_Static_assert(offsetof(MlpBootNode_t, maxMemoryFreq) == offsetof(IniBootSectionNode_t, curr.maxMemoryFreq), "MlpBootNode_t layout mismatch");
+_Static_assert(offsetof(MlpBootNode_t, next) == offsetof(IniBootSectionNode_t, next), "MlpBootNode_t layout mismatch");
+
+//nodes have to come after the previous one in the file, so a corrupt plan can't make a list loop
+static int node_offset_valid(uint32_t offset, uint32_t minOffset, uint32_t nodeSize, uint32_t totalSize)
+{
+	return (offset >= minOffset) && ((offset & 3) == 0) && (offset <= totalSize) && (totalSize - offset >= nodeSize);
+}
+
+static char* string_from_offset(uint8_t* planBase, uint32_t offset)
+{
+	return (offset == 0) ? NULL : (char*)&planBase[offset];
+}
+
+int mlplan_load(void* planBytes, size_t numBytes, IniParsedInfo_t* outInfo, ErrPrintFunc printer)
+{
+	uint8_t* planBase = planBytes;
+	const MlpHeader_t* header = planBytes;
+	memset(outInfo, 0, sizeof(IniParsedInfo_t));
+
+	if (numBytes < sizeof(MlpHeader_t) || memcmp(header->magic, MLPLAN_MAGIC, sizeof(header->magic)) != 0)
+	{
+		printer("Not a boot plan file, magic mismatch\n");
+		return 0;
+	}
+	if (header->version != MLPLAN_VERSION)
+	{
+		printer("Boot plan version %u is not supported, expected %u\n", header->version, MLPLAN_VERSION);
+		return 0;
+	}
+	const uint32_t totalSize = header->totalSize;
+	if (header->headerSize < sizeof(MlpHeader_t) || totalSize <= header->headerSize || totalSize > numBytes || planBase[totalSize-1] != 0)
+	{
+		printer("Boot plan is truncated (header says %u bytes, file has %u)\n", totalSize, numBytes);
+		return 0;
+	}
+
+	uint32_t minOffset = header->headerSize;
+	uint32_t badOffset = 0;
+
+	//filename is the only string that may be missing, every sectname gets printed as is
+	IniLoadSectionNode_t** loadLink = &outInfo->loads;
+	for (uint32_t offset = header->loads; offset != 0;)
+	{
+		const MlpLoadNode_t* planNode = (const MlpLoadNode_t*)&planBase[offset];
+		if (!node_offset_valid(offset, minOffset, sizeof(MlpLoadNode_t), totalSize) ||
+			planNode->sectname == 0 || planNode->sectname >= totalSize || planNode->filename >= totalSize)
+		{
+			badOffset = offset;
+			goto corrupt;
+		}
+
+		const uint32_t sectname = planNode->sectname;
+		const uint32_t filename = planNode->filename;
+		const uint32_t next = planNode->next;
+
+		IniLoadSectionNode_t* node = (IniLoadSectionNode_t*)&planBase[offset];
+		node->curr.sectname = string_from_offset(planBase, sectname);
+		node->curr.filename = string_from_offset(planBase, filename);
+		node->next = NULL;
+		*loadLink = node;
+		loadLink = &node->next;
+
+		minOffset = offset + sizeof(MlpLoadNode_t);
+		offset = next;
+	}
+
+	IniCopySectionNode_t** copyLink = &outInfo->copies;
+	for (uint32_t offset = header->copies; offset != 0;)
+	{
+		const MlpCopyNode_t* planNode = (const MlpCopyNode_t*)&planBase[offset];
+		if (!node_offset_valid(offset, minOffset, sizeof(MlpCopyNode_t), totalSize) ||
+			planNode->sectname == 0 || planNode->sectname >= totalSize)
+		{
+			badOffset = offset;
+			goto corrupt;
+		}
+
+		const uint32_t sectname = planNode->sectname;
+		const uint32_t next = planNode->next;
+
+		IniCopySectionNode_t* node = (IniCopySectionNode_t*)&planBase[offset];
+		node->curr.sectname = string_from_offset(planBase, sectname);
+		node->next = NULL;
+		*copyLink = node;
+		copyLink = &node->next;
+
+		minOffset = offset + sizeof(MlpCopyNode_t);
+		offset = next;
+	}
+
+	IniBootSectionNode_t** bootLink = &outInfo->boots;
+	for (uint32_t offset = header->boots; offset != 0;)
+	{
+		const MlpBootNode_t* planNode = (const MlpBootNode_t*)&planBase[offset];
+		if (!node_offset_valid(offset, minOffset, sizeof(MlpBootNode_t), totalSize) ||
+			planNode->sectname == 0 || planNode->sectname >= totalSize)
+		{
+			badOffset = offset;
+			goto corrupt;
+		}
+
+		const uint32_t sectname = planNode->sectname;
+		const uint32_t next = planNode->next;
+
+		IniBootSectionNode_t* node = (IniBootSectionNode_t*)&planBase[offset];
+		node->curr.sectname = string_from_offset(planBase, sectname);
+		node->next = NULL;
+		*bootLink = node;
+		bootLink = &node->next;
+
+		minOffset = offset + sizeof(MlpBootNode_t);
+		offset = next;
+	}
+
+	outInfo->globals.earlyMemoryFreq = header->earlyMemoryFreq;
+	return 1;
+
+corrupt:
+	printer("Boot plan node at offset 0x%08x is out of order, out of bounds or has no name\n", badOffset);
+	memset(outInfo, 0, sizeof(IniParsedInfo_t));
+	return 0;
+}
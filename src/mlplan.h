@@ -0,0 +1,79 @@
+#ifndef _MLPLAN_H_
+#define _MLPLAN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "iniparse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Compiled boot plan (.mlp), the same sections as an ini but ready to execute without any parsing.
+//Nodes are laid out exactly like the Ini*SectionNode_t structs on the 32-bit target, except every
+//pointer is stored as a byte offset from the start of the plan (0 for NULL, which only filename may be).
+//Loading a plan only turns those offsets into pointers in place. All values are little endian.
+#define MLPLAN_EXTENSION ".mlp"
+#define MLPLAN_MAGIC "MLPB"
+#define MLPLAN_VERSION 2
+
+typedef struct MlpHeader_s
+{
+	char magic[4];
+	uint16_t version;
+	uint16_t headerSize;
+	uint32_t totalSize; //including this header, the last byte must be 0 so strings stay terminated
+	int16_t earlyMemoryFreq;
+	uint16_t reserved;
+	uint32_t loads; //offset of the first node of each list
+	uint32_t copies;
+	uint32_t boots;
+} MlpHeader_t;
+
+typedef struct MlpLoadNode_s
+{
+	uint32_t sectname;
+	uint32_t filename;
+	uint32_t skip;
+	uint32_t count;
+	uint32_t dst;
+	uint32_t compType;
+	uint32_t dstlen;
+	uint32_t lba;
+	uint32_t sectors;
+	uint8_t part;
+	uint8_t reserved[3];
+	uint32_t next;
+} MlpLoadNode_t;
+
+typedef struct MlpCopyNode_s
+{
+	uint32_t sectname;
+	uint32_t compType;
+	uint32_t src;
+	uint32_t srclen;
+	uint32_t dst;
+	uint32_t dstlen;
+	uint32_t margin;
+	uint32_t next;
+} MlpCopyNode_t;
+
+typedef struct MlpBootNode_s
+{
+	uint32_t sectname;
+	uint32_t pc;
+	uint8_t codeArch;
+	int8_t pwroffHoldTime;
+	int16_t maxMemoryFreq;
+	uint32_t next;
+} MlpBootNode_t;
+
+//checks the plan and relocates it in place, outInfo then points into planBytes so it must outlive it
+int mlplan_load(void* planBytes, size_t numBytes, IniParsedInfo_t* outInfo, ErrPrintFunc printer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
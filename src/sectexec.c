@@ -0,0 +1,81 @@
+#include "sectexec.h"
+#include "lib/blzdecode.h"
+#include "lib/memops.h"
+#include <string.h>
+
+int load_section_fill(const IniLoadSection_t* sect, decomp_read_func read, void* ctx, size_t srcLen, size_t zeroLen, size_t* outLen)
+{
+	*outLen = 0;
+	if (sect->compType == 0)
+	{
+		const size_t bytesRead = read(ctx, (void*)(uintptr_t)sect->dst, srcLen);
+		*outLen = bytesRead;
+		if (bytesRead != srcLen)
+			return 0;
+
+		if (zeroLen > 0)
+			memzero((uint8_t*)(uintptr_t)sect->dst+bytesRead, zeroLen);
+
+		return 1;
+	}
+
+	//compressed data is decoded as it's read, straight to dst without a staging copy,
+	//except BLZ which decodes backwards, so it's read to dst whole and expanded right there
+	size_t len = 0;
+	if (sect->compType == 1)
+		len = ulzman_stream(read, ctx, (void*)(uintptr_t)sect->dst, sect->dstlen);
+	else if (sect->compType == 2)
+		len = ulz4fn_stream(read, ctx, (void*)(uintptr_t)sect->dst, sect->dstlen);
+	else if (sect->compType == 3 && srcLen <= sect->dstlen &&
+			 read(ctx, (void*)(uintptr_t)sect->dst, srcLen) == srcLen)
+		len = blz_uncompress((void*)(uintptr_t)sect->dst, srcLen, sect->dstlen);
+
+	if (len == 0 || len > sect->dstlen)
+		return 0;
+
+	if (sect->dstlen > len)
+		memzero((uint8_t*)(uintptr_t)sect->dst+len, sect->dstlen-len);
+
+	*outLen = len;
+	return 1;
+}
+
+int copy_section_run(const IniCopySection_t* sect, size_t* outLen)
+{
+	*outLen = 0;
+	if (sect->compType == 0)
+	{
+		if (sect->srclen > 0)
+			memmove((void*)(uintptr_t)sect->dst, (void*)(uintptr_t)sect->src, sect->srclen);
+
+		if (sect->dstlen > sect->srclen)
+			memzero((uint8_t*)(uintptr_t)sect->dst+sect->srclen, sect->dstlen-sect->srclen);
+
+		*outLen = sect->srclen;
+		return 1;
+	}
+
+	//decoders only ever write the start of dst they produce, so only the rest needs zeroing
+	size_t len = 0;
+	if (sect->compType == 1)
+		len = ulzman((void*)(uintptr_t)sect->src, sect->srclen, (void*)(uintptr_t)sect->dst, sect->dstlen);
+	else if (sect->compType == 2)
+		len = ulz4fn((void*)(uintptr_t)sect->src, sect->srclen, (void*)(uintptr_t)sect->dst, sect->dstlen);
+	else if (sect->compType == 3 && sect->srclen <= sect->dstlen)
+	{
+		//BLZ expands backwards over its own input, so it starts from the compressed data at dst
+		if (sect->src != sect->dst)
+			memmove((void*)(uintptr_t)sect->dst, (void*)(uintptr_t)sect->src, sect->srclen);
+
+		len = blz_uncompress((void*)(uintptr_t)sect->dst, sect->srclen, sect->dstlen);
+	}
+
+	if (len == 0 || len > sect->dstlen)
+		return 0;
+
+	if (sect->dstlen > len)
+		memzero((uint8_t*)(uintptr_t)sect->dst+len, sect->dstlen-len);
+
+	*outLen = len;
+	return 1;
+}
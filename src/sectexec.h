@@ -0,0 +1,29 @@
+#ifndef _SECTEXEC_H_
+#define _SECTEXEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "iniparse.h"
+#include "lib/decomp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//The memory side of LOAD and COPY sections, without any storage or display code so the host tests run the same thing.
+//Both return 1 on success and 0 on failure, outLen gets the bytes read or decoded either way (0 is a valid length,
+//a COPY that only zero fills its dst copies nothing).
+
+//Puts the srcLen bytes of a LOAD section that come through read at its dst. Uncompressed data is followed by zeroLen
+//zero bytes, compressed data is decoded into dstlen bytes and the rest of those zero filled.
+int load_section_fill(const IniLoadSection_t* sect, decomp_read_func read, void* ctx, size_t srcLen, size_t zeroLen, size_t* outLen);
+
+//Copies or decodes a COPY section's src to its dst and zero fills the rest of dstlen.
+int copy_section_run(const IniCopySection_t* sect, size_t* outLen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
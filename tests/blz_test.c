@@ -0,0 +1,188 @@
+#include "blzdecode.h"
+#include "blzstream.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//Checks blz_uncompress against a byte at a time decoder in the Horizon kernel's order, on a hand-built stream
+//and on random ones full of matches that overlap their own source. With --bench it times both instead.
+
+static const size_t FOOTER_SIZE = 12;
+
+static uint64_t rngState = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rng_next(void)
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 7;
+	rngState ^= rngState << 17;
+	return (uint32_t)(rngState >> 32);
+}
+
+static uint32_t read_le32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+//the kernel's loop, every match copied one byte at a time from its top down, with the same bounds checks
+static size_t blz_uncompress_ref(uint8_t* buf, size_t compSize, size_t bufSize)
+{
+	if (compSize < FOOTER_SIZE || compSize > bufSize)
+		return 0;
+
+	const uint32_t cmpAndHdrSize = read_le32(&buf[compSize - FOOTER_SIZE]);
+	const uint32_t headerSize = read_le32(&buf[compSize - FOOTER_SIZE + 4]);
+	const uint32_t addlSize = read_le32(&buf[compSize - FOOTER_SIZE + 8]);
+	if (cmpAndHdrSize > compSize || headerSize < FOOTER_SIZE || headerSize > cmpAndHdrSize || addlSize > bufSize - compSize)
+		return 0;
+
+	const size_t start = compSize - cmpAndHdrSize;
+	const size_t end = compSize + addlSize;
+	size_t in = start + cmpAndHdrSize - headerSize;
+	size_t out = end;
+	while (out > start)
+	{
+		if (in == start)
+			return 0;
+
+		const uint8_t control = buf[--in];
+		for (int i=0; i<8 && out > start; i++)
+		{
+			if ((control & (0x80 >> i)) == 0)
+			{
+				if (in == start)
+					return 0;
+
+				buf[--out] = buf[--in];
+				continue;
+			}
+
+			if (in - start < 2)
+				return 0;
+
+			in -= 2;
+			const unsigned int seg = buf[in] | ((unsigned int)buf[in + 1] << 8);
+			size_t len = (seg >> 12) + 3;
+			const size_t dist = (seg & 0xFFF) + 3;
+			if (len > out - start)
+				len = out - start;
+			if (out - len < in || out - len + len + dist > end)
+				return 0;
+
+			for (size_t j=0; j<len; j++)
+			{
+				out--;
+				buf[out] = buf[out + dist];
+			}
+		}
+	}
+
+	return compSize + addlSize;
+}
+
+static bool check_fixed_stream(void)
+{
+	//"ABC" then a match of 15 bytes 3 back, decoded top down
+	uint8_t consumed[16];
+	StreamWriter_t wr = { consumed, 0, 0, 8 };
+	put_literal(&wr, 'C');
+	put_literal(&wr, 'B');
+	put_literal(&wr, 'A');
+	put_match(&wr, 15, 3);
+
+	static const char EXPECTED[] = "ABCABCABCABCABCABC";
+	uint8_t buf[sizeof(EXPECTED)];
+	uint8_t refBuf[sizeof(EXPECTED)];
+	const size_t compSize = finish_stream(&wr, buf, sizeof(EXPECTED) - 1);
+	memcpy(refBuf, buf, sizeof(buf));
+
+	const size_t outLen = blz_uncompress(buf, compSize, sizeof(EXPECTED) - 1);
+	const size_t refLen = blz_uncompress_ref(refBuf, compSize, sizeof(EXPECTED) - 1);
+	const bool ok = outLen == sizeof(EXPECTED) - 1 && refLen == outLen &&
+					memcmp(buf, EXPECTED, outLen) == 0 && memcmp(refBuf, EXPECTED, outLen) == 0;
+	if (!ok)
+		printf("overlapping match: got %u bytes '%.*s', reference %u bytes '%.*s'\n",
+			(unsigned)outLen, (int)(sizeof(EXPECTED) - 1), buf, (unsigned)refLen, (int)(sizeof(EXPECTED) - 1), refBuf);
+
+	return ok;
+}
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run_bench(void)
+{
+	static const size_t OUT_LEN = 4*1024*1024;
+	static const int ROUNDS = 20;
+
+	StreamWriter_t wr = { malloc(OUT_LEN), 0, 0, 8 };
+	uint8_t* stream = malloc(OUT_LEN);
+	uint8_t* buf = malloc(OUT_LEN);
+	const size_t compSize = make_random_stream(stream, OUT_LEN, &wr, rng_next);
+
+	for (int which=0; which<2; which++)
+	{
+		double best = 1e9;
+		for (int r=0; r<ROUNDS; r++)
+		{
+			memcpy(buf, stream, compSize);
+			const double t = now_seconds();
+			const size_t outLen = (which == 0) ? blz_uncompress_ref(buf, compSize, OUT_LEN) : blz_uncompress(buf, compSize, OUT_LEN);
+			const double elapsed = now_seconds() - t;
+			if (outLen != OUT_LEN)
+				return 1;
+			if (elapsed < best)
+				best = elapsed;
+		}
+		printf("%-16s %8.1f MB/s of output\n", (which == 0) ? "blz byte loop" : "blz_uncompress", OUT_LEN / best / 1e6);
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	static const int ITERATIONS = 20000;
+	static const size_t MAX_OUT = 8192;
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+		return run_bench();
+
+	if (!check_fixed_stream())
+		return 1;
+
+	StreamWriter_t wr = { malloc(MAX_OUT * 2), 0, 0, 8 };
+	uint8_t* buf = malloc(MAX_OUT);
+	uint8_t* refBuf = malloc(MAX_OUT);
+	int numDecoded = 0;
+	for (int i=0; i<ITERATIONS; i++)
+	{
+		const size_t outLen = 1 + rng_next() % MAX_OUT;
+		memset(buf, 0, MAX_OUT);
+		const size_t compSize = make_random_stream(buf, outLen, &wr, rng_next);
+		if (compSize > outLen)
+			continue; //mostly literals, doesn't fit its own output
+
+		//trailing bytes only tell if something wrote past the output
+		memset(&buf[outLen], 0xA5, MAX_OUT - outLen);
+		memcpy(refBuf, buf, MAX_OUT);
+		const size_t gotLen = blz_uncompress(buf, compSize, outLen);
+		const size_t refLen = blz_uncompress_ref(refBuf, compSize, outLen);
+		if (gotLen != refLen || memcmp(buf, refBuf, MAX_OUT) != 0)
+		{
+			printf("iteration %d: %u bytes from %u, decoder returned %u, reference %u\n",
+				i, (unsigned)outLen, (unsigned)compSize, (unsigned)gotLen, (unsigned)refLen);
+			return 1;
+		}
+		numDecoded += (refLen != 0);
+	}
+
+	printf("blz_uncompress matches the byte loop on the overlapping match and %d random streams (%d decoded)\n", ITERATIONS, numDecoded);
+	return 0;
+}
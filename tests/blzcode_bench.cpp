@@ -0,0 +1,106 @@
+#include "Types.h"
+#include "blz.h"
+#include "../src/lib/blzdecode.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// BLZ_Code against the brute force search it replaced, on a made up KIP .text segment, in both modes.
+// Every output has to decode back with the firmware's decoder, and the normal mode outputs have to be identical.
+
+ByteVector BLZ_Code_old(u8* raw_buffer, unsigned int raw_len, bool best);
+
+static u64 rngState = 0x9E3779B97F4A7C15ull;
+
+static u32 RngNext()
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 7;
+	rngState ^= rngState << 17;
+	return u32(rngState >> 32);
+}
+
+// AArch64 code mostly: 4 byte words, a lot of them repeated with a changed register or offset,
+// plus some string and data tables of bytes from a small range
+static ByteVector MakeSegment(size_t len)
+{
+	ByteVector seg(len);
+	size_t pos = 0;
+	while (pos < len)
+	{
+		const u32 kind = RngNext() % 8;
+		size_t run = 4 * (1 + RngNext() % 16);
+		if (run > len - pos)
+			run = len - pos;
+
+		if (kind == 0)
+		{
+			for (size_t i=0; i<run; i++)
+				seg[pos + i] = byte(' ' + RngNext() % 64);
+		}
+		else if (kind < 3 || pos < 4096)
+		{
+			for (size_t i=0; i<run; i++)
+				seg[pos + i] = byte(RngNext());
+		}
+		else
+		{
+			const size_t from = (pos - 4 - 4 * (RngNext() % (std::min<size_t>(pos, 0x1000) / 4))) & ~size_t(3);
+			memcpy(&seg[pos], &seg[from], run);
+			seg[pos + (RngNext() % run & ~size_t(3))] ^= byte(RngNext() & 0x1F);
+		}
+		pos += run;
+	}
+	return seg;
+}
+
+static bool Decodes(const ByteVector& comp, const ByteVector& raw)
+{
+	ByteVector buf(raw.size());
+	if (comp.size() > buf.size())
+		return false;
+
+	memcpy(buf.data(), comp.data(), comp.size());
+	return blz_uncompress(buf.data(), comp.size(), buf.size()) == raw.size() && buf == raw;
+}
+
+static ByteVector TimeCode(ByteVector (*code)(u8*, unsigned int, bool), ByteVector& raw, bool best, double& outSecs)
+{
+	const auto start = std::chrono::steady_clock::now();
+	ByteVector comp = code(raw.data(), unsigned(raw.size()), best);
+	outSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return comp;
+}
+
+int main(int argc, char* argv[])
+{
+	// about the size of the FS KIP's .text
+	const size_t SEGMENT_SIZE = 1024*1024;
+	ByteVector raw = MakeSegment(SEGMENT_SIZE);
+	printf("%zu KiB segment\n", raw.size() / 1024);
+
+	int failed = 0;
+	for (const bool best : { false, true })
+	{
+		double oldSecs = 0;
+		double newSecs = 0;
+		const ByteVector oldComp = TimeCode(BLZ_Code_old, raw, best, oldSecs);
+		const ByteVector newComp = TimeCode(BLZ_Code, raw, best, newSecs);
+
+		const bool oldOk = Decodes(oldComp, raw);
+		const bool newOk = Decodes(newComp, raw);
+		printf("%-6s old %8.3f s %8zu bytes%s, new %8.3f s %8zu bytes%s, %.1fx faster\n", best ? "best" : "normal",
+			oldSecs, oldComp.size(), oldOk ? "" : " (DOESN'T DECODE)", newSecs, newComp.size(), newOk ? "" : " (DOESN'T DECODE)",
+			oldSecs / newSecs);
+
+		if (!oldOk || !newOk)
+			failed = 1;
+		if (!best && oldComp != newComp)
+		{
+			printf("normal mode output differs from the old encoder's\n");
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
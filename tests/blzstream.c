@@ -0,0 +1,74 @@
+#include "blzstream.h"
+
+static const size_t FOOTER_SIZE = 12;
+
+static void write_le32(uint8_t* p, uint32_t val)
+{
+	p[0] = (uint8_t)val; p[1] = (uint8_t)(val >> 8); p[2] = (uint8_t)(val >> 16); p[3] = (uint8_t)(val >> 24);
+}
+
+static void put_token_bit(StreamWriter_t* wr, bool isMatch)
+{
+	if (wr->controlBit == 8)
+	{
+		wr->controlPos = wr->len++;
+		wr->bytes[wr->controlPos] = 0;
+		wr->controlBit = 0;
+	}
+	if (isMatch)
+		wr->bytes[wr->controlPos] |= (uint8_t)(0x80 >> wr->controlBit);
+	wr->controlBit++;
+}
+
+void put_literal(StreamWriter_t* wr, uint8_t val)
+{
+	put_token_bit(wr, false);
+	wr->bytes[wr->len++] = val;
+}
+
+void put_match(StreamWriter_t* wr, size_t len, size_t dist)
+{
+	const unsigned int seg = (unsigned int)(((len - 3) << 12) | (dist - 3));
+	put_token_bit(wr, true);
+	wr->bytes[wr->len++] = (uint8_t)(seg >> 8); //consumed as a pair, the high byte sits above
+	wr->bytes[wr->len++] = (uint8_t)seg;
+}
+
+size_t finish_stream(const StreamWriter_t* wr, uint8_t* buf, size_t outLen)
+{
+	for (size_t i=0; i<wr->len; i++)
+		buf[wr->len - 1 - i] = wr->bytes[i];
+
+	const size_t compSize = wr->len + FOOTER_SIZE;
+	write_le32(&buf[wr->len], (uint32_t)compSize);
+	write_le32(&buf[wr->len + 4], (uint32_t)FOOTER_SIZE);
+	write_le32(&buf[wr->len + 8], (uint32_t)(outLen - compSize));
+	return compSize;
+}
+
+size_t make_random_stream(uint8_t* buf, size_t outLen, StreamWriter_t* wr, uint32_t (*rng)(void))
+{
+	wr->len = 0;
+	wr->controlBit = 8;
+	size_t produced = 0;
+	while (produced < outLen)
+	{
+		const size_t left = outLen - produced;
+		if (produced < 3 || (rng() % 4) == 0)
+		{
+			put_literal(wr, (uint8_t)(rng() % 5 + 'A'));
+			produced++;
+			continue;
+		}
+
+		size_t maxDist = (produced < 0x1002) ? produced : 0x1002;
+		size_t dist = (rng() % 2) ? 3 + rng() % 4 : 3 + rng() % (maxDist - 2);
+		if (dist > maxDist)
+			dist = maxDist;
+		size_t len = 3 + rng() % 16;
+		put_match(wr, len, dist);
+		produced += (len < left) ? len : left;
+	}
+
+	return finish_stream(wr, buf, outLen);
+}
@@ -0,0 +1,28 @@
+#ifndef _BLZSTREAM_H_
+#define _BLZSTREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Builds BLZ streams token by token for the host tests, from the top of the output down like the decoder reads them.
+
+typedef struct
+{
+	uint8_t* bytes; //in the order the decoder consumes them, so reversed
+	size_t len;
+	size_t controlPos;
+	int controlBit; //8 before the first token
+} StreamWriter_t;
+
+void put_literal(StreamWriter_t* wr, uint8_t val);
+void put_match(StreamWriter_t* wr, size_t len, size_t dist);
+
+//lays the tokens out as the compressed area followed by the footer, returns compSize
+size_t finish_stream(const StreamWriter_t* wr, uint8_t* buf, size_t outLen);
+
+//random tokens for outLen bytes of output, mostly matches so the output outgrows the input fast enough.
+//Returns compSize, which can still be more than outLen for short outputs.
+size_t make_random_stream(uint8_t* buf, size_t outLen, StreamWriter_t* wr, uint32_t (*rng)(void));
+
+#endif
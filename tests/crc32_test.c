@@ -0,0 +1,132 @@
+#include "crc32.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//Checks crc32_update, built with the CRC32_SLICES this binary was compiled with, against the bit at a time
+//crc32b it replaced: at every start alignment, for every short length and some long ones, and split into pieces
+//at random points. With --bench it times both instead.
+
+static uint64_t rngState = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rng_next(void)
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 7;
+	rngState ^= rngState << 17;
+	return (uint32_t)(rngState >> 32);
+}
+
+//the crc32b from before the lookup tables
+static unsigned int crc32_bitwise(const unsigned char* message, unsigned int msgLen)
+{
+	unsigned int crc = 0xFFFFFFFF;
+	for (unsigned int i=0; i<msgLen; i++)
+	{
+		crc = crc ^ message[i];
+		for (int j=7; j>=0; j--)
+		{
+			const unsigned int mask = -(crc & 1);
+			crc = (crc >> 1) ^ (0xEDB88320 & mask);
+		}
+	}
+	return ~crc;
+}
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run_bench(const unsigned char* buf, unsigned int len)
+{
+	static const int ROUNDS = 10;
+
+	double bestRef = 1e9;
+	double best = 1e9;
+	unsigned int sink = 0;
+	for (int r=0; r<ROUNDS; r++)
+	{
+		double t = now_seconds();
+		sink ^= crc32_bitwise(buf, len);
+		double elapsed = now_seconds() - t;
+		if (elapsed < bestRef)
+			bestRef = elapsed;
+
+		t = now_seconds();
+		sink ^= crc32_update(0, buf, len);
+		elapsed = now_seconds() - t;
+		if (elapsed < best)
+			best = elapsed;
+	}
+
+	printf("crc32 bitwise          %8.1f MB/s\n", len / bestRef / 1e6);
+	printf("crc32_update slice-by-%d %7.1f MB/s (%.1fx)\n", CRC32_SLICES, len / best / 1e6, bestRef / best);
+	return (sink == 0x12345678) ? 2 : 0; //keeps the calls from being optimized out
+}
+
+int main(int argc, char* argv[])
+{
+	static const unsigned int BUF_SIZE = 4*1024*1024;
+	static const unsigned int MAX_SHORT_LEN = 300;
+	static const int SPLIT_ROUNDS = 20000;
+
+	unsigned char* buf = malloc(BUF_SIZE + 8);
+	for (unsigned int i=0; i<BUF_SIZE + 8; i++)
+		buf[i] = (unsigned char)rng_next();
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+		return run_bench(buf, BUF_SIZE);
+
+	if (crc32b((unsigned char*)"123456789", 9) != 0xCBF43926)
+	{
+		printf("crc32b(\"123456789\") = 0x%08x, expected 0xcbf43926\n", crc32b((unsigned char*)"123456789", 9));
+		return 1;
+	}
+
+	for (unsigned int align=0; align<8; align++)
+	{
+		for (unsigned int len=0; len<=MAX_SHORT_LEN; len++)
+		{
+			if (crc32b(&buf[align], len) != crc32_bitwise(&buf[align], len))
+			{
+				printf("slice-by-%d: %u bytes at alignment %u don't match\n", CRC32_SLICES, len, align);
+				return 1;
+			}
+		}
+		const unsigned int longLen = BUF_SIZE - align - (rng_next() % 64);
+		if (crc32b(&buf[align], longLen) != crc32_bitwise(&buf[align], longLen))
+		{
+			printf("slice-by-%d: %u bytes at alignment %u don't match\n", CRC32_SLICES, longLen, align);
+			return 1;
+		}
+	}
+
+	for (int i=0; i<SPLIT_ROUNDS; i++)
+	{
+		const unsigned int start = rng_next() % 8;
+		const unsigned int len = rng_next() % 4096;
+		unsigned int crc = 0;
+		for (unsigned int pos=0; pos<len;)
+		{
+			unsigned int piece = 1 + rng_next() % 37;
+			if (piece > len - pos)
+				piece = len - pos;
+
+			crc = crc32_update(crc, &buf[start + pos], piece);
+			pos += piece;
+		}
+		if (crc != crc32_bitwise(&buf[start], len))
+		{
+			printf("slice-by-%d: %u bytes at alignment %u fed in pieces don't match\n", CRC32_SLICES, len, start);
+			return 1;
+		}
+	}
+
+	printf("slice-by-%d matches the bitwise crc32 at every alignment and in %d split updates\n", CRC32_SLICES, SPLIT_ROUNDS);
+	return 0;
+}
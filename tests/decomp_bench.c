@@ -0,0 +1,223 @@
+#include "lib/decomp.h"
+#include <lz4frame.h>
+#include <lz4hc.h>
+#include <lzma.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//Decompression throughput of the section decoders on the host, in MB/s of output like cbfs2ini's cost model
+//counts it. The payload is made to compress about as well as firmware code does.
+
+size_t ulz4fn_old(const void* src, size_t srcn, void* dst, size_t dstn);
+
+static const size_t PAYLOAD_SIZE = 8*1024*1024;
+static const int ROUNDS = 5;
+
+static uint64_t rngState = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rng_next(void)
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 7;
+	rngState ^= rngState << 17;
+	return (uint32_t)(rngState >> 32);
+}
+
+//random bytes mixed with slightly changed repeats of earlier stretches
+static void make_payload(uint8_t* buf, size_t len)
+{
+	size_t pos = 0;
+	while (pos < len)
+	{
+		size_t run = 4 + rng_next() % 60;
+		if (run > len - pos)
+			run = len - pos;
+
+		if (pos < 4096 || rng_next() % 3 == 0)
+		{
+			for (size_t i=0; i<run; i++)
+				buf[pos + i] = (uint8_t)(rng_next() & rng_next());
+		}
+		else
+		{
+			const size_t from = pos - 1 - rng_next() % ((pos < 65536) ? pos : 65536);
+			for (size_t i=0; i<run; i++)
+				buf[pos + i] = buf[from + i];
+
+			buf[pos + rng_next() % run] ^= (uint8_t)rng_next();
+		}
+		pos += run;
+	}
+}
+
+//elf2ini's settings, except for the block mode when the old decoder has to read it and the checksums
+static size_t compress_lz4(const uint8_t* src, size_t srcLen, uint8_t** outData, int linked, int checksums)
+{
+	LZ4F_preferences_t prefs;
+	memset(&prefs, 0, sizeof(prefs));
+	prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+	prefs.frameInfo.blockMode = linked ? LZ4F_blockLinked : LZ4F_blockIndependent;
+	prefs.frameInfo.contentSize = srcLen;
+	prefs.frameInfo.contentChecksumFlag = checksums ? LZ4F_contentChecksumEnabled : LZ4F_noContentChecksum;
+	prefs.frameInfo.blockChecksumFlag = checksums ? LZ4F_blockChecksumEnabled : LZ4F_noBlockChecksum;
+	prefs.compressionLevel = LZ4HC_CLEVEL_MAX;
+
+	const size_t outSize = LZ4F_compressFrameBound(srcLen, &prefs);
+	*outData = malloc(outSize);
+	const size_t outLen = LZ4F_compressFrame(*outData, outSize, src, srcLen, &prefs);
+	return LZ4F_isError(outLen) ? 0 : outLen;
+}
+
+//elf2ini's settings without the extreme flag, which makes the encoder a lot slower but the output barely smaller
+static size_t compress_lzma(const uint8_t* src, size_t srcLen, uint8_t** outData)
+{
+	lzma_options_lzma options;
+	if (lzma_lzma_preset(&options, 9))
+		return 0;
+	if (options.dict_size > srcLen)
+		options.dict_size = (uint32_t)srcLen;
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	if (lzma_alone_encoder(&strm, &options) != LZMA_OK)
+		return 0;
+
+	const size_t outSize = srcLen + srcLen/2 + 64*1024;
+	*outData = malloc(outSize);
+	strm.next_in = src;
+	strm.avail_in = srcLen;
+	strm.next_out = *outData;
+	strm.avail_out = outSize;
+	const lzma_ret ret = lzma_code(&strm, LZMA_FINISH);
+	const size_t outLen = outSize - strm.avail_out;
+	lzma_end(&strm);
+	if (ret != LZMA_STREAM_END)
+		return 0;
+
+	//the real size instead of the end marker
+	for (size_t i=0; i<8; i++)
+		(*outData)[5 + i] = (uint8_t)((uint64_t)srcLen >> (8*i));
+
+	return outLen;
+}
+
+//the .xz input ulzman also takes, LZMA2 with a CRC32 per block
+static size_t compress_xz(const uint8_t* src, size_t srcLen, uint8_t** outData)
+{
+	const size_t outSize = lzma_stream_buffer_bound(srcLen);
+	size_t outLen = 0;
+	*outData = malloc(outSize);
+	if (lzma_easy_buffer_encode(9, LZMA_CHECK_CRC32, NULL, src, srcLen, *outData, &outLen, outSize) != LZMA_OK)
+		return 0;
+
+	return outLen;
+}
+
+typedef struct
+{
+	const uint8_t* src;
+	size_t pos;
+	size_t len;
+} MemReader_t;
+
+static size_t mem_reader_read(void* ctx, void* buf, size_t len)
+{
+	MemReader_t* rdr = ctx;
+	if (len > rdr->len - rdr->pos)
+		len = rdr->len - rdr->pos;
+
+	memcpy(buf, &rdr->src[rdr->pos], len);
+	rdr->pos += len;
+	return len;
+}
+
+typedef size_t (*DecodeFunc_t)(const void* src, size_t srcn, void* dst, size_t dstn);
+
+static size_t lz4_read_stream(const void* src, size_t srcn, void* dst, size_t dstn)
+{
+	MemReader_t rdr = { src, 0, srcn };
+	return ulz4fn_stream(mem_reader_read, &rdr, dst, dstn);
+}
+
+static size_t lzma_read_stream(const void* src, size_t srcn, void* dst, size_t dstn)
+{
+	MemReader_t rdr = { src, 0, srcn };
+	return ulzman_stream(mem_reader_read, &rdr, dst, dstn);
+}
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//best of ROUNDS, or a negative number if the output didn't match
+static double time_decode(DecodeFunc_t decode, const uint8_t* comp, size_t compLen, const uint8_t* plain, uint8_t* dst)
+{
+	double best = 1e9;
+	for (int r=0; r<ROUNDS; r++)
+	{
+		memset(dst, 0, PAYLOAD_SIZE);
+		const double t = now_seconds();
+		const size_t len = decode(comp, compLen, dst, PAYLOAD_SIZE);
+		const double elapsed = now_seconds() - t;
+		if (len != PAYLOAD_SIZE || memcmp(dst, plain, PAYLOAD_SIZE) != 0)
+			return -1;
+		if (elapsed < best)
+			best = elapsed;
+	}
+	return PAYLOAD_SIZE / best / (1024.0 * 1024.0);
+}
+
+static int report(const char* name, double mbs, size_t compLen)
+{
+	if (mbs < 0)
+	{
+		printf("%-34s didn't decode to the payload\n", name);
+		return 1;
+	}
+	printf("%-34s %8.1f MB/s (ratio %.2f)\n", name, mbs, (double)PAYLOAD_SIZE / compLen);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	uint8_t* plain = malloc(PAYLOAD_SIZE);
+	uint8_t* dst = malloc(PAYLOAD_SIZE);
+	make_payload(plain, PAYLOAD_SIZE);
+
+	uint8_t* indep = NULL;
+	uint8_t* linked = NULL;
+	uint8_t* checked = NULL;
+	const size_t indepLen = compress_lz4(plain, PAYLOAD_SIZE, &indep, 0, 0);
+	const size_t linkedLen = compress_lz4(plain, PAYLOAD_SIZE, &linked, 1, 0);
+	const size_t checkedLen = compress_lz4(plain, PAYLOAD_SIZE, &checked, 1, 1);
+	uint8_t* lzma = NULL;
+	uint8_t* xz = NULL;
+	const size_t lzmaLen = compress_lzma(plain, PAYLOAD_SIZE, &lzma);
+	const size_t xzLen = compress_xz(plain, PAYLOAD_SIZE, &xz);
+	if (indepLen == 0 || linkedLen == 0 || checkedLen == 0 || lzmaLen == 0 || xzLen == 0)
+		return 1;
+
+	const double lz4Speed = time_decode(ulz4fn, linked, linkedLen, plain, dst);
+	const double lzmaSpeed = time_decode(ulzman, lzma, lzmaLen, plain, dst);
+	int failed = 0;
+	printf("%zu MiB payload, MB/s of output\n", PAYLOAD_SIZE >> 20);
+	failed |= report("lz4 old ulz4fn, independent", time_decode(ulz4fn_old, indep, indepLen, plain, dst), indepLen);
+	failed |= report("lz4 ulz4fn, independent", time_decode(ulz4fn, indep, indepLen, plain, dst), indepLen);
+	failed |= report("lz4 ulz4fn, linked", lz4Speed, linkedLen);
+	failed |= report("lz4 ulz4fn, linked with checksums", time_decode(ulz4fn, checked, checkedLen, plain, dst), checkedLen);
+	failed |= report("lz4 ulz4fn_stream, linked", time_decode(lz4_read_stream, linked, linkedLen, plain, dst), linkedLen);
+
+	failed |= report("lzma ulzman", lzmaSpeed, lzmaLen);
+	failed |= report("lzma ulzman_stream", time_decode(lzma_read_stream, lzma, lzmaLen, plain, dst), lzmaLen);
+	failed |= report("xz ulzman", time_decode(ulzman, xz, xzLen, plain, dst), xzLen);
+
+	//cbfs2ini only needs the two speeds relative to the card's, its defaults have lz4 20 times faster than lzma
+	if (!failed)
+		printf("lz4 decodes %.1f times as fast as lzma\n", lz4Speed / lzmaSpeed);
+	return failed;
+}
@@ -0,0 +1,705 @@
+#include "iniparse.h"
+#include "execplan.h"
+#include "ff.h"
+#include "diskio.h"
+#include "ramdisk.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+
+//Replays the card reads memloader does for an ini through the firmware's FatFs and diskio.c sector cache,
+//against a FAT32 image in RAM, and reports how many of FatFs' single sector reads the cache served.
+//The image is built from the ini and the files its LOADs name, taken relative to the ini, or given with --image.
+//LOADs run in the firmware's plan order with the same file cache, fast seek table and direct reads as main.c,
+//and every byte read is compared with the file. Compressed LOADs are replayed as a plain read of their source.
+//--other-files puts that many files ahead of them in the root directory, --min-hit-rate fails below that rate.
+//With --far-seek it then seeks to the end of the largest LOAD file with and without the fast seek table.
+
+static const uint32_t SECTOR_SIZE = 512;
+static const uint32_t FAT32_MIN_CLUSTERS = 65526; //FatFs takes anything with fewer clusters as FAT16
+static const uint32_t FAT_EOC = 0x0FFFFFFF;
+
+typedef struct
+{
+	const char* name;
+	uint8_t* data;
+	uint32_t size;
+	uint32_t firstCluster;
+	uint32_t lastCluster;
+	uint32_t clustersLeft;
+	uint32_t bytesWritten;
+} ImageFile_t;
+
+typedef struct
+{
+	uint8_t* bytes;
+	uint32_t numSectors;
+	uint32_t sectorsPerCluster;
+	uint32_t dataStart;
+	uint32_t* fat;
+} FatImage_t;
+
+static char iniDir[4096];
+
+static uint8_t* read_host_file(const char* filename, uint32_t* outSize)
+{
+	char path[sizeof(iniDir) + 256];
+	snprintf(path, sizeof(path), "%s%s", iniDir, filename);
+	FILE* fp = fopen(path, "rb");
+	if (fp == NULL)
+	{
+		printf("Can't open '%s'\n", path);
+		return NULL;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	const long fileSize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	uint8_t* bytes = malloc(fileSize + 1);
+	if (bytes != NULL && fread(bytes, 1, fileSize, fp) != (size_t)fileSize)
+	{
+		free(bytes);
+		bytes = NULL;
+	}
+	fclose(fp);
+
+	if (bytes != NULL)
+		*outSize = (uint32_t)fileSize;
+	return bytes;
+}
+
+static uint8_t* cluster_bytes(const FatImage_t* img, uint32_t cluster)
+{
+	return &img->bytes[(size_t)(img->dataStart + (cluster - 2) * img->sectorsPerCluster) * SECTOR_SIZE];
+}
+
+static void put_u16(uint8_t* p, uint32_t val) { p[0] = (uint8_t)val; p[1] = (uint8_t)(val >> 8); }
+static void put_u32(uint8_t* p, uint32_t val) { put_u16(p, val); put_u16(p + 2, val >> 16); }
+
+//one long name entry set followed by the short entry, the short name is made up since FatFs matches the long one
+static uint8_t* write_dir_entry(uint8_t* ent, const ImageFile_t* file, int index)
+{
+	static const int LFN_CHAR_OFFSETS[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+
+	char shortName[12];
+	snprintf(shortName, sizeof(shortName), "MLR~%04d   ", index % 10000);
+	uint8_t checksum = 0;
+	for (int i=0; i<11; i++)
+		checksum = (uint8_t)(((checksum & 1) << 7) + (checksum >> 1) + (uint8_t)shortName[i]);
+
+	const int nameLen = (int)strlen(file->name);
+	const int numLfn = (nameLen + 12) / 13;
+	for (int seq=numLfn; seq>=1; seq--, ent+=32)
+	{
+		ent[0] = (uint8_t)(seq | ((seq == numLfn) ? 0x40 : 0));
+		ent[11] = 0x0F;
+		ent[13] = checksum;
+		for (int i=0; i<13; i++)
+		{
+			const int pos = (seq - 1) * 13 + i;
+			const uint32_t ch = (pos < nameLen) ? (uint8_t)file->name[pos] : ((pos == nameLen) ? 0 : 0xFFFF);
+			put_u16(&ent[LFN_CHAR_OFFSETS[i]], ch);
+		}
+	}
+
+	memcpy(ent, shortName, 11);
+	ent[11] = 0x20; //archive
+	put_u16(&ent[20], file->firstCluster >> 16);
+	put_u16(&ent[26], file->firstCluster);
+	put_u32(&ent[28], file->size);
+	return ent + 32;
+}
+
+//fragmentClusters > 0 hands out that many clusters to each file in turn, instead of giving every file one run
+static bool build_fat32_image(FatImage_t* img, ImageFile_t* files, int numFiles, uint32_t clusterKb, uint32_t fragmentClusters)
+{
+	static const uint32_t RESERVED_SECTORS = 32;
+
+	img->sectorsPerCluster = clusterKb * 1024 / SECTOR_SIZE;
+	const uint32_t clusterSize = img->sectorsPerCluster * SECTOR_SIZE;
+
+	uint32_t rootEntries = 1; //the empty one that ends the listing
+	uint32_t dataClusters = 0;
+	for (int i=0; i<numFiles; i++)
+	{
+		for (const char* c=files[i].name; *c; c++)
+		{
+			if (*c == '/' || (uint8_t)*c >= 0x80)
+			{
+				printf("'%s' needs to be in the root and ASCII to be put in the built image, use --image\n", files[i].name);
+				return false;
+			}
+		}
+		rootEntries += 1 + (uint32_t)(strlen(files[i].name) + 12) / 13;
+		files[i].clustersLeft = (files[i].size + clusterSize - 1) / clusterSize;
+		dataClusters += files[i].clustersLeft;
+	}
+	const uint32_t rootClusters = (rootEntries * 32 + clusterSize - 1) / clusterSize;
+
+	uint32_t numClusters = rootClusters + dataClusters;
+	if (numClusters < FAT32_MIN_CLUSTERS)
+		numClusters = FAT32_MIN_CLUSTERS;
+
+	const uint32_t fatSectors = ((numClusters + 2) * 4 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	img->dataStart = RESERVED_SECTORS + 2 * fatSectors;
+	const uint64_t numSectors = img->dataStart + (uint64_t)numClusters * img->sectorsPerCluster;
+	if (numSectors > UINT32_MAX)
+		return false;
+
+	img->numSectors = (uint32_t)numSectors;
+	img->bytes = mmap(NULL, numSectors * SECTOR_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (img->bytes == MAP_FAILED)
+		return false;
+
+	uint8_t* bs = img->bytes;
+	memcpy(bs, "\xEB\x58\x90" "MSWIN4.1", 11);
+	put_u16(&bs[11], SECTOR_SIZE);
+	bs[13] = (uint8_t)img->sectorsPerCluster;
+	put_u16(&bs[14], RESERVED_SECTORS);
+	bs[16] = 2; //FAT copies
+	bs[21] = 0xF8;
+	put_u16(&bs[24], 63);
+	put_u16(&bs[26], 255);
+	put_u32(&bs[32], img->numSectors);
+	put_u32(&bs[36], fatSectors);
+	put_u32(&bs[44], 2); //root directory cluster
+	put_u16(&bs[48], 1);
+	put_u16(&bs[50], 6);
+	bs[64] = 0x80;
+	bs[66] = 0x29;
+	memcpy(&bs[71], "NO NAME    FAT32   ", 19);
+	put_u16(&bs[510], 0xAA55);
+
+	img->fat = (uint32_t*)&img->bytes[RESERVED_SECTORS * SECTOR_SIZE];
+	img->fat[0] = 0x0FFFFFF8;
+	img->fat[1] = FAT_EOC;
+
+	uint32_t nextCluster = 2;
+	for (uint32_t i=0; i<rootClusters; i++, nextCluster++)
+		img->fat[nextCluster] = (i + 1 < rootClusters) ? nextCluster + 1 : FAT_EOC;
+
+	for (bool allocated=true; allocated;)
+	{
+		allocated = false;
+		for (int i=0; i<numFiles; i++)
+		{
+			ImageFile_t* file = &files[i];
+			for (uint32_t n=0; file->clustersLeft > 0 && (fragmentClusters == 0 || n < fragmentClusters); n++)
+			{
+				const uint32_t cluster = nextCluster++;
+				if (file->lastCluster != 0)
+					img->fat[file->lastCluster] = cluster;
+				else
+					file->firstCluster = cluster;
+
+				file->lastCluster = cluster;
+				file->clustersLeft--;
+				img->fat[cluster] = FAT_EOC;
+
+				uint32_t len = file->size - file->bytesWritten;
+				if (len > clusterSize)
+					len = clusterSize;
+				memcpy(cluster_bytes(img, cluster), &file->data[file->bytesWritten], len);
+				file->bytesWritten += len;
+				allocated = true;
+			}
+		}
+	}
+	memcpy(&img->fat[fatSectors * SECTOR_SIZE / 4], img->fat, fatSectors * SECTOR_SIZE);
+
+	uint8_t* ent = cluster_bytes(img, 2);
+	for (int i=0; i<numFiles; i++)
+		ent = write_dir_entry(ent, &files[i], i + 1);
+
+	return true;
+}
+
+static bool load_image_file(FatImage_t* img, const char* filename)
+{
+	FILE* fp = fopen(filename, "rb");
+	if (fp == NULL)
+	{
+		printf("Can't open '%s'\n", filename);
+		return false;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	const long imageSize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	img->numSectors = (uint32_t)(imageSize / SECTOR_SIZE);
+	img->bytes = malloc((size_t)img->numSectors * SECTOR_SIZE);
+	const bool ok = img->bytes != NULL && fread(img->bytes, SECTOR_SIZE, img->numSectors, fp) == img->numSectors;
+	fclose(fp);
+	return ok;
+}
+
+//same as get_load_write_size in main.c
+static uint64_t get_load_write_size(const IniLoadSection_t* sect)
+{
+	if (sect->filename == NULL)
+		return (uint64_t)sect->sectors * SECTOR_SIZE;
+	else if (sect->compType != 0)
+		return sect->dstlen;
+
+	return sect->count;
+}
+
+//same as load_file_contiguous_sectors in main.c
+static uint32_t file_contiguous_sectors(FIL* fp, DWORD* outSector)
+{
+	if (fp->cltbl == NULL)
+		return 0;
+
+	FATFS* fs = fp->obj.fs;
+	const DWORD* tbl = fp->cltbl + 1;
+	DWORD cl = (DWORD)(fp->fptr / FF_MIN_SS / fs->csize);
+	for (;;)
+	{
+		const DWORD ncl = *tbl++;
+		if (ncl == 0)
+			return 0;
+		if (cl < ncl)
+		{
+			const DWORD sectInClust = (DWORD)(fp->fptr / FF_MIN_SS) & (fs->csize - 1);
+			*outSector = fs->database + fs->csize * (*tbl + cl - 2) + sectInClust;
+			return (ncl - cl) * fs->csize - sectInClust;
+		}
+		cl -= ncl; tbl++;
+	}
+}
+
+//the read loop of load_reader_read in main.c, without the progress dots
+static FRESULT replay_read(FIL* fp, uint8_t* buf, uint32_t len, uint32_t* outRead)
+{
+	static const uint32_t READ_BLOCK_SIZE = 4*1024;
+	static const uint32_t MAX_DIRECT_READ_SECTORS = 0xFFFF;
+
+	uint32_t totalRead = 0;
+	while (totalRead < len)
+	{
+		uint32_t bytesToRead = len - totalRead;
+		const uint32_t sectorOffset = (uint32_t)(fp->fptr % FF_MIN_SS);
+
+		DWORD sector = 0;
+		uint32_t numSectors = 0;
+		if (sectorOffset == 0 && bytesToRead >= FF_MIN_SS && ((uintptr_t)&buf[totalRead] & 7) == 0)
+			numSectors = file_contiguous_sectors(fp, &sector);
+
+		UINT bytesRead = 0;
+		FRESULT res = FR_OK;
+		if (numSectors > 0)
+		{
+			if (numSectors > bytesToRead / FF_MIN_SS)
+				numSectors = bytesToRead / FF_MIN_SS;
+			if (numSectors > MAX_DIRECT_READ_SECTORS)
+				numSectors = MAX_DIRECT_READ_SECTORS;
+
+			bytesToRead = numSectors * FF_MIN_SS;
+			if (disk_read(fp->obj.fs->pdrv, &buf[totalRead], sector, numSectors) != RES_OK)
+				res = FR_DISK_ERR;
+			else if ((res = f_lseek(fp, fp->fptr + bytesToRead)) == FR_OK)
+				bytesRead = bytesToRead;
+		}
+		else
+		{
+			if (sectorOffset != 0 && bytesToRead > FF_MIN_SS - sectorOffset)
+				bytesToRead = FF_MIN_SS - sectorOffset;
+			else if (bytesToRead > READ_BLOCK_SIZE)
+				bytesToRead = READ_BLOCK_SIZE;
+
+			res = f_read(fp, &buf[totalRead], bytesToRead, &bytesRead);
+		}
+
+		if (res != FR_OK)
+			return res;
+		else if (bytesRead == 0)
+			break;
+
+		totalRead += bytesRead;
+	}
+
+	*outRead = totalRead;
+	return FR_OK;
+}
+
+//same as load_file_create_clmt in main.c
+static FRESULT create_clmt(FIL* fp)
+{
+	DWORD numItems = 64;
+	for (;;)
+	{
+		fp->cltbl = malloc(numItems * sizeof(DWORD));
+		fp->cltbl[0] = numItems;
+
+		FRESULT res = f_lseek(fp, CREATE_LINKMAP);
+		if (res == FR_OK)
+			return FR_OK;
+
+		numItems = fp->cltbl[0];
+		free(fp->cltbl);
+		fp->cltbl = NULL;
+
+		if (res != FR_NOT_ENOUGH_CORE)
+			return res;
+	}
+}
+
+static void close_file(FIL* fp, bool* isOpen)
+{
+	if (*isOpen)
+		f_close(fp);
+	free(fp->cltbl);
+	fp->cltbl = NULL;
+	*isOpen = false;
+}
+
+static int replay_load(const IniLoadSection_t* sect, FIL* fp, char* openName, bool* isOpen)
+{
+	if (!*isOpen || strcasecmp(openName, sect->filename) != 0)
+	{
+		close_file(fp, isOpen);
+		memset(fp, 0, sizeof(*fp));
+		FRESULT res = f_open(fp, sect->filename, FA_READ | FA_OPEN_EXISTING);
+		if (res == FR_OK)
+		{
+			*isOpen = true;
+			res = create_clmt(fp);
+		}
+		if (res != FR_OK)
+		{
+			printf("LOAD '%s': error %d opening '%s'\n", sect->sectname, res, sect->filename);
+			return 0;
+		}
+		snprintf(openName, FF_LFN_BUF + 1, "%s", sect->filename);
+	}
+
+	const uint32_t fileSize = (uint32_t)f_size(fp);
+	uint32_t endPos = fileSize;
+	if (sect->count != 0 && sect->skip + sect->count < fileSize)
+		endPos = sect->skip + sect->count;
+	if (sect->skip > endPos)
+	{
+		printf("LOAD '%s': file '%s' is smaller than the start offset %u\n", sect->sectname, sect->filename, sect->skip);
+		return 0;
+	}
+
+	uint8_t* buf = malloc(endPos - sect->skip + 8);
+	uint32_t bytesRead = 0;
+	FRESULT res = f_lseek(fp, sect->skip);
+	if (res == FR_OK)
+		res = replay_read(fp, buf, endPos - sect->skip, &bytesRead);
+
+	uint32_t expectSize = 0;
+	uint8_t* expect = (res == FR_OK) ? read_host_file(sect->filename, &expectSize) : NULL;
+	const bool matches = expect != NULL && bytesRead == endPos - sect->skip && expectSize == fileSize &&
+						 memcmp(buf, &expect[sect->skip], bytesRead) == 0;
+	free(expect);
+	free(buf);
+
+	if (res != FR_OK)
+		printf("LOAD '%s': error %d reading '%s'\n", sect->sectname, res, sect->filename);
+	else if (!matches)
+		printf("LOAD '%s': bytes read from '%s' don't match the file\n", sect->sectname, sect->filename);
+
+	return matches;
+}
+
+//One seek to the last sector of a file, the way a LOAD with a large skip does it, then that sector is read and
+//checked. Returns the single sector reads FatFs made for the table and the seek, which are all FAT sectors.
+static bool far_seek(const char* filename, bool useClmt, uint32_t* outTableReads, uint32_t* outSeekReads, uint32_t* outTableCommands, uint32_t* outSeekCommands)
+{
+	FIL fp;
+	memset(&fp, 0, sizeof(fp));
+	if (f_open(&fp, filename, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+		return false;
+
+	DISK_CACHE_STATS before, afterTable, afterSeek;
+	RamdiskStats_t cardBefore, cardAfterTable, cardAfter;
+	disk_cache_stats(&before);
+	ramdisk_stats(&cardBefore);
+	FRESULT res = useClmt ? create_clmt(&fp) : FR_OK;
+	disk_cache_stats(&afterTable);
+	ramdisk_stats(&cardAfterTable);
+
+	const uint32_t fileSize = (uint32_t)f_size(&fp);
+	const uint32_t pos = (fileSize > 0) ? (fileSize - 1) & ~(FF_MIN_SS - 1) : 0;
+	if (res == FR_OK)
+		res = f_lseek(&fp, pos);
+	disk_cache_stats(&afterSeek);
+	ramdisk_stats(&cardAfter);
+
+	uint8_t buf[FF_MIN_SS];
+	UINT bytesRead = 0;
+	if (res == FR_OK)
+		res = f_read(&fp, buf, sizeof(buf), &bytesRead);
+
+	uint32_t expectSize = 0;
+	uint8_t* expect = (res == FR_OK) ? read_host_file(filename, &expectSize) : NULL;
+	const bool matches = expect != NULL && expectSize == fileSize && bytesRead == fileSize - pos &&
+						 memcmp(buf, &expect[pos], bytesRead) == 0;
+	free(expect);
+	f_close(&fp);
+	free(fp.cltbl);
+
+	*outTableReads = (afterTable.hits + afterTable.misses) - (before.hits + before.misses);
+	*outSeekReads = (afterSeek.hits + afterSeek.misses) - (afterTable.hits + afterTable.misses);
+	*outTableCommands = cardAfterTable.commands - cardBefore.commands;
+	*outSeekCommands = cardAfter.commands - cardAfterTable.commands;
+	return matches;
+}
+
+//the FAT sectors the fast seek table saves on a far seek into the largest LOAD file, each seek after a remount
+//so the card commands are those of a cold sector cache
+static int report_far_seek(FATFS* fs, const IniParsedInfo_t* info)
+{
+	const char* largest = NULL;
+	FSIZE_t largestSize = 0;
+	for (IniLoadSectionNode_t* nod=info->loads; nod!=NULL; nod=nod->next)
+	{
+		FILINFO fno;
+		if (nod->curr.filename != NULL && f_stat(nod->curr.filename, &fno) == FR_OK && fno.fsize > largestSize)
+		{
+			largest = nod->curr.filename;
+			largestSize = fno.fsize;
+		}
+	}
+	if (largest == NULL)
+		return 0;
+
+	uint32_t plainTable, plainSeek, plainTableCommands, plainCommands, clmtTable, clmtSeek, clmtTableCommands, clmtCommands;
+	if (f_mount(fs, "", 1) != FR_OK || !far_seek(largest, false, &plainTable, &plainSeek, &plainTableCommands, &plainCommands) ||
+		f_mount(fs, "", 1) != FR_OK || !far_seek(largest, true, &clmtTable, &clmtSeek, &clmtTableCommands, &clmtCommands))
+	{
+		printf("seek   to the end of '%s' read the wrong bytes\n", largest);
+		return -8;
+	}
+
+	printf("seek   to the end of '%s': %u FAT sector reads (%u card commands) without the fast seek table,\n", largest, plainSeek, plainCommands);
+	printf("       %u with it (%u card commands) after %u to build it (%u card commands), %u saved per seek\n",
+		   clmtSeek, clmtCommands, clmtTable, clmtTableCommands, plainSeek - clmtSeek);
+
+	//a file that fits in its first cluster has no chain to follow either way
+	if (plainSeek > 0 && clmtSeek >= plainSeek)
+	{
+		printf("the fast seek table saved no FAT reads\n");
+		return -8;
+	}
+	return 0;
+}
+
+static void print_stats(const char* what, const DISK_CACHE_STATS* from, const DISK_CACHE_STATS* to)
+{
+	const uint32_t hits = to->hits - from->hits;
+	const uint32_t misses = to->misses - from->misses;
+	const double hitRate = (hits + misses > 0) ? 100.0 * hits / (hits + misses) : 0.0;
+	printf("%-6s %7u single sector reads, %7u hits, %7u misses (%.1f%% hit rate)\n", what, hits + misses, hits, misses, hitRate);
+}
+
+int main(int argc, char* argv[])
+{
+	const char* iniFilename = NULL;
+	const char* imageFilename = NULL;
+	uint32_t clusterKb = 32;
+	uint32_t fragmentClusters = 0;
+	bool farSeek = false;
+	uint32_t otherFiles = 0;
+	double minHitRate = -1;
+	for (int i=1; i<argc; i++)
+	{
+		if (strncmp(argv[i], "--image=", 8) == 0)
+			imageFilename = &argv[i][8];
+		else if (strncmp(argv[i], "--cluster-kb=", 13) == 0)
+			clusterKb = (uint32_t)strtoul(&argv[i][13], NULL, 0);
+		else if (strncmp(argv[i], "--fragment=", 11) == 0)
+			fragmentClusters = (uint32_t)strtoul(&argv[i][11], NULL, 0);
+		else if (strcmp(argv[i], "--far-seek") == 0)
+			farSeek = true;
+		else if (strncmp(argv[i], "--other-files=", 14) == 0)
+			otherFiles = (uint32_t)strtoul(&argv[i][14], NULL, 0);
+		else if (strncmp(argv[i], "--min-hit-rate=", 15) == 0)
+			minHitRate = strtod(&argv[i][15], NULL);
+		else
+			iniFilename = argv[i];
+	}
+
+	if (iniFilename == NULL || clusterKb == 0 || clusterKb > 64 || (clusterKb & (clusterKb - 1)) != 0)
+	{
+		fprintf(stderr, "Usage: diskreplay [--image=card.img | [--cluster-kb=32] [--fragment=clusters] [--other-files=N]] [--far-seek] [--min-hit-rate=percent] plan.ini\n");
+		return -1;
+	}
+
+	const char* lastSlash = strrchr(iniFilename, '/');
+	const char* iniName = (lastSlash != NULL) ? lastSlash + 1 : iniFilename;
+	if (lastSlash != NULL)
+		snprintf(iniDir, sizeof(iniDir), "%.*s/", (int)(lastSlash - iniFilename), iniFilename);
+
+	uint32_t iniSize = 0;
+	uint8_t* iniBytes = read_host_file(iniName, &iniSize);
+	if (iniBytes == NULL)
+		return -2;
+
+	//the ini is parsed here only to know which files go in the image, the replay reads it back from there.
+	//Parsing cuts the text up in place, so that works on a copy
+	FatImage_t img;
+	memset(&img, 0, sizeof(img));
+	if (imageFilename != NULL)
+	{
+		if (!load_image_file(&img, imageFilename))
+			return -3;
+	}
+	else
+	{
+		char* iniText = malloc(iniSize + 1);
+		memcpy(iniText, iniBytes, iniSize);
+		iniText[iniSize] = 0;
+
+		IniArena_t arena;
+		arena.size = memloader_ini_arena_size(iniText, (int)iniSize);
+		arena.base = malloc(arena.size);
+		arena.used = 0;
+		const IniParsedInfo_t info = parse_memloader_ini(iniText, (int)iniSize, &arena, (ErrPrintFunc)printf);
+
+		int numFiles = 1 + otherFiles;
+		for (IniLoadSectionNode_t* nod=info.loads; nod!=NULL; nod=nod->next)
+			numFiles++;
+
+		//what else sits in the root of a card, ahead of the boot files in the directory
+		ImageFile_t* files = calloc(numFiles, sizeof(ImageFile_t));
+		for (numFiles=0; numFiles<(int)otherFiles; numFiles++)
+		{
+			char* name = malloc(32);
+			snprintf(name, 32, "unrelated_file_%04d.bin", numFiles % 10000);
+			files[numFiles].name = name;
+		}
+		files[numFiles].name = iniName;
+		files[numFiles].data = iniBytes;
+		files[numFiles].size = iniSize;
+		numFiles++;
+		for (IniLoadSectionNode_t* nod=info.loads; nod!=NULL; nod=nod->next)
+		{
+			const char* name = nod->curr.filename;
+			if (name == NULL)
+				continue;
+			while (*name == '/')
+				name++;
+
+			bool known = false;
+			for (int i=0; i<numFiles && !known; i++)
+				known = strcasecmp(files[i].name, name) == 0;
+			if (known)
+				continue;
+
+			files[numFiles].name = name;
+			files[numFiles].data = read_host_file(name, &files[numFiles].size);
+			if (files[numFiles].data == NULL)
+				return -3;
+			numFiles++;
+		}
+
+		if (!build_fat32_image(&img, files, numFiles, clusterKb, fragmentClusters))
+		{
+			printf("Can't build the FAT32 image\n");
+			return -3;
+		}
+		printf("Built a FAT32 image of %u files, %u KB clusters%s\n", numFiles, clusterKb, (fragmentClusters != 0) ? ", fragmented" : "");
+	}
+
+	ramdisk_attach(img.bytes, img.numSectors);
+	FATFS fs;
+	memset(&fs, 0, sizeof(fs));
+	if (f_mount(&fs, "", 1) != FR_OK)
+	{
+		printf("Can't mount the image\n");
+		return -4;
+	}
+
+	DISK_CACHE_STATS startStats;
+	disk_cache_stats(&startStats);
+
+	//the file picker lists the root and then reads the picked ini
+	DIR dir;
+	FILINFO fno;
+	if (f_opendir(&dir, "/") == FR_OK)
+	{
+		while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0] != 0);
+		f_closedir(&dir);
+	}
+
+	FIL fp;
+	memset(&fp, 0, sizeof(fp));
+	char* imageIni = malloc(iniSize + 1);
+	UINT iniLen = 0;
+	if (f_open(&fp, iniName, FA_READ | FA_OPEN_EXISTING) != FR_OK || f_read(&fp, imageIni, iniSize, &iniLen) != FR_OK)
+	{
+		printf("Can't read '%s' from the image\n", iniName);
+		return -5;
+	}
+	f_close(&fp);
+	imageIni[iniLen] = 0;
+
+	DISK_CACHE_STATS iniStats;
+	disk_cache_stats(&iniStats);
+
+	IniArena_t arena;
+	arena.size = memloader_ini_arena_size(imageIni, (int)iniLen);
+	arena.base = malloc(arena.size);
+	arena.used = 0;
+	const IniParsedInfo_t info = parse_memloader_ini(imageIni, (int)iniLen, &arena, (ErrPrintFunc)printf);
+
+	int numLoads = 0;
+	int numCopies = 0;
+	for (IniLoadSectionNode_t* nod=info.loads; nod!=NULL; nod=nod->next)
+		numLoads++;
+	for (IniCopySectionNode_t* nod=info.copies; nod!=NULL; nod=nod->next)
+		numCopies++;
+
+	uint64_t* loadSizes = calloc(numLoads + 1, sizeof(uint64_t));
+	int i = 0;
+	for (IniLoadSectionNode_t* nod=info.loads; nod!=NULL; nod=nod->next, i++)
+		loadSizes[i] = get_load_write_size(&nod->curr);
+
+	ExecStep_t* steps = calloc(numLoads + numCopies + 1, sizeof(ExecStep_t));
+	const int numSteps = build_exec_plan(&info, loadSizes, steps, (ErrPrintFunc)printf);
+	if (numSteps < 0)
+		return -6;
+
+	//raw sector LOADs read the card directly and never go through FatFs or the cache
+	char openName[FF_LFN_BUF + 1] = { 0 };
+	bool isOpen = false;
+	memset(&fp, 0, sizeof(fp));
+	int retVal = 0;
+	for (i=0; i<numSteps && retVal == 0; i++)
+	{
+		if (steps[i].type == EXEC_STEP_LOAD && steps[i].load->filename != NULL && !replay_load(steps[i].load, &fp, openName, &isOpen))
+			retVal = -7;
+	}
+	close_file(&fp, &isOpen);
+
+	DISK_CACHE_STATS endStats;
+	disk_cache_stats(&endStats);
+	RamdiskStats_t cardStats;
+	ramdisk_stats(&cardStats);
+
+	print_stats("ini", &startStats, &iniStats);
+	print_stats("LOADs", &iniStats, &endStats);
+	print_stats("total", &startStats, &endStats);
+	printf("card   %7u read commands (%u single sector), %llu sectors\n", cardStats.commands, cardStats.singleCommands, (unsigned long long)cardStats.sectors);
+
+	const uint32_t totalReads = (endStats.hits - startStats.hits) + (endStats.misses - startStats.misses);
+	if (retVal == 0 && minHitRate >= 0 && (totalReads == 0 || 100.0 * (endStats.hits - startStats.hits) / totalReads < minHitRate))
+	{
+		printf("the hit rate is below %.1f%%\n", minHitRate);
+		retVal = -9;
+	}
+
+	if (retVal == 0 && farSeek)
+		retVal = report_far_seek(&fs, &info);
+
+	return retVal;
+}
@@ -0,0 +1,20 @@
+#ifndef _HOSTFATFS_H_
+#define _HOSTFATFS_H_
+
+//Force included into host builds of FatFs. Its integer.h takes DWORD as unsigned long, which is 64-bit here,
+//so define the types first with the sizes FatFs requires and integer.h sees them as already done.
+#define FF_INTEGER
+
+#include <stdint.h>
+
+typedef int			INT;
+typedef unsigned int	UINT;
+typedef unsigned char	BYTE;
+typedef int16_t		SHORT;
+typedef uint16_t	WORD;
+typedef uint16_t	WCHAR;
+typedef int32_t		LONG;
+typedef uint32_t	DWORD;
+typedef uint64_t	QWORD;
+
+#endif
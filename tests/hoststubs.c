@@ -0,0 +1,30 @@
+#include "lib/printk.h"
+#include <stdio.h>
+
+//the firmware prints to the screen and the debug uart, on the host both go to stdout
+
+void vprintk(char *fmt, va_list args)
+{
+	vprintf(fmt, args);
+}
+
+void printk(char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	vprintk(fmt, args);
+	va_end(args);
+}
+
+void dbg_vprint(char* fmt, va_list args)
+{
+	vprintf(fmt, args);
+}
+
+void dbg_print(char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	dbg_vprint(fmt, args);
+	va_end(args);
+}
@@ -0,0 +1,107 @@
+#include "iniparse.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//Parse throughput on generated inis of growing size, a mix of load, copy and boot sections like cbfs2ini and
+//elf2ini write. sections/s has to stay about the same from the smallest to the largest, anything that grows
+//faster than linearly with the section count shows up as a drop.
+
+static int ignore_print(const char* format, ...)
+{
+	(void)format;
+	return 0;
+}
+
+static char* generate_ini(int numSections, size_t* outLen)
+{
+	const size_t maxLen = (size_t)numSections * 200 + 64;
+	char* ini = malloc(maxLen);
+	size_t len = (size_t)snprintf(ini, maxLen, "earlyMemoryFreq=1600\n\n");
+	for (int i=0; i<numSections; i++)
+	{
+		const int kind = i % 8;
+		if (kind < 5)
+		{
+			len += snprintf(&ini[len], maxLen - len,
+							"[load:fallback/archive_%d]\nif=coreboot.rom\nskip=0x%08x\ncount=0x%08x\ndst=0x%08x\n\n",
+							i, i*0x1000, 0x1000, 0x80000000u + i*0x1000);
+		}
+		else if (kind < 7)
+		{
+			len += snprintf(&ini[len], maxLen - len,
+							"[copy:fallback/stage_%d]\ntype=2\nsrc=0x%08x\nsrclen=0x%08x\ndst=0x%08x\ndstlen=0x%08x\n\n",
+							i, 0x90000000u + i*0x1000, 0x800, 0xA0000000u + i*0x2000, 0x2000);
+		}
+		else
+			len += snprintf(&ini[len], maxLen - len, "[boot:entry_%d]\npc=0x%08x\n\n", i, 0x80000000u + i*0x1000);
+	}
+
+	*outLen = len;
+	return ini;
+}
+
+static double now_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+	static const int SECTION_COUNTS[] = { 100, 1000, 10000, 50000 };
+	(void)argc; (void)argv;
+
+	printf("%9s %10s %8s %14s %10s %12s\n", "sections", "bytes", "runs", "sections/s", "MB/s", "ns/section");
+	for (size_t c=0; c<sizeof(SECTION_COUNTS)/sizeof(SECTION_COUNTS[0]); c++)
+	{
+		const int numSections = SECTION_COUNTS[c];
+		size_t iniLen = 0;
+		char* ini = generate_ini(numSections, &iniLen);
+		char* work = malloc(iniLen + 1);
+
+		IniArena_t arena;
+		arena.size = memloader_ini_arena_size(ini, (int)iniLen);
+		arena.base = malloc(arena.size);
+
+		//the parser terminates strings in place, so every run starts from a fresh copy that isn't timed
+		const int numRuns = 2000000 / numSections;
+		double parseSeconds = 0;
+		int parsedSections = 0;
+		for (int run=0; run<numRuns; run++)
+		{
+			memcpy(work, ini, iniLen + 1);
+			arena.used = 0;
+
+			const double start = now_seconds();
+			const IniParsedInfo_t info = parse_memloader_ini(work, (int)iniLen, &arena, ignore_print);
+			parseSeconds += now_seconds() - start;
+
+			parsedSections = 0;
+			for (IniLoadSectionNode_t* nod=info.loads; nod!=NULL; nod=nod->next)
+				parsedSections++;
+			for (IniCopySectionNode_t* nod=info.copies; nod!=NULL; nod=nod->next)
+				parsedSections++;
+			for (IniBootSectionNode_t* nod=info.boots; nod!=NULL; nod=nod->next)
+				parsedSections++;
+		}
+
+		if (parsedSections != numSections)
+		{
+			printf("Parsed %d sections out of %d\n", parsedSections, numSections);
+			return 1;
+		}
+
+		const double totalSections = (double)numSections * numRuns;
+		printf("%9d %10zu %8d %14.0f %10.1f %12.1f\n", numSections, iniLen, numRuns, totalSections / parseSeconds,
+			   (double)iniLen * numRuns / parseSeconds / (1 << 20), parseSeconds * 1e9 / totalSections);
+
+		free(arena.base);
+		free(work);
+		free(ini);
+	}
+
+	return 0;
+}
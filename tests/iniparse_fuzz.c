@@ -0,0 +1,167 @@
+#include "iniparse.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Fuzz target for parse_memloader_ini, as LLVMFuzzerTestOneInput for libFuzzer (build with -DINIPARSE_LIBFUZZER
+//and -fsanitize=fuzzer). Otherwise there is a main that runs every file named on the command line through it,
+//which is also what AFL wants, or without arguments mutates a seed ini for a number of rounds on its own.
+
+static int ignore_print(const char* format, ...)
+{
+	(void)format;
+	return 0;
+}
+
+//every string and node in the result is touched, so a bad pointer shows up under ASan right away
+static size_t walk_result(const IniParsedInfo_t* info)
+{
+	size_t total = 0;
+	for (const IniLoadSectionNode_t* nod=info->loads; nod!=NULL; nod=nod->next)
+	{
+		total += strlen(nod->curr.sectname) + nod->curr.dst;
+		if (nod->curr.filename != NULL)
+			total += strlen(nod->curr.filename);
+	}
+	for (const IniCopySectionNode_t* nod=info->copies; nod!=NULL; nod=nod->next)
+		total += strlen(nod->curr.sectname) + nod->curr.dst;
+	for (const IniBootSectionNode_t* nod=info->boots; nod!=NULL; nod=nod->next)
+		total += strlen(nod->curr.sectname) + nod->curr.pc;
+
+	return total;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	if (size > 1024*1024)
+		return 0;
+
+	//exactly sized allocations, so ASan catches the parser reading past the terminator or the arena
+	char* iniBytes = malloc(size + 1);
+	memcpy(iniBytes, data, size);
+	iniBytes[size] = 0;
+
+	IniArena_t arena;
+	arena.size = memloader_ini_arena_size(iniBytes, (int)size);
+	arena.base = malloc(arena.size ? arena.size : 1);
+	arena.used = 0;
+
+	const IniParsedInfo_t info = parse_memloader_ini(iniBytes, (int)size, &arena, ignore_print);
+	volatile size_t sink = walk_result(&info);
+	(void)sink;
+	if (arena.used > arena.size)
+		abort();
+
+	free(arena.base);
+	free(iniBytes);
+	return 0;
+}
+
+#ifndef INIPARSE_LIBFUZZER
+static const char SEED_INI[] =
+	"earlyMemoryFreq=1600\n"
+	"[load:PH_0]\nif=payload.bin\nskip=0x0\ncount=0x3900\ndst=0x80000000\n\n"
+	"[load:PH_1]\nif=payload.bin\ntype=2\nskip=0x3a00\ncount=0x100\ndst=0x90000000\ndstlen=0x1000\n\n"
+	"[load:RAW]\nlba=0x800\nsectors=0x100\npart=1\ndst=0xA0000000\n\n"
+	"[copy:PH_0_BSS]\ntype=0\nsrc=0x80003900\nsrclen=0\ndst=0x80003900\ndstlen=0x3700\nmargin=0x10\n\n"
+	"[boot:ENTRY]\npc=0x80000000\ncodeArch=0\npwroffHoldTime=4\nmaxMemoryFreq=-1600\n";
+
+static uint32_t rngState = 1;
+
+static uint32_t next_random()
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+//bytes that matter to the parser are picked more often than random ones
+static uint8_t random_byte()
+{
+	static const char INTERESTING[] = "[]=:\n\r\t ;#0x";
+	return (next_random() & 1) ? (uint8_t)INTERESTING[next_random() % (sizeof(INTERESTING)-1)] : (uint8_t)next_random();
+}
+
+static size_t mutate(uint8_t* buf, size_t len, size_t maxLen)
+{
+	const uint32_t numMutations = 1 + next_random() % 8;
+	for (uint32_t i=0; i<numMutations; i++)
+	{
+		const uint32_t kind = next_random() % 4;
+		const size_t pos = (len > 0) ? next_random() % len : 0;
+		if (kind == 0 && len > 0) //overwrite
+			buf[pos] = random_byte();
+		else if (kind == 1 && len < maxLen) //insert
+		{
+			memmove(&buf[pos+1], &buf[pos], len - pos);
+			buf[pos] = random_byte();
+			len++;
+		}
+		else if (kind == 2 && len > 0) //erase a run
+		{
+			const size_t runLen = 1 + next_random() % (len - pos);
+			memmove(&buf[pos], &buf[pos+runLen], len - pos - runLen);
+			len -= runLen;
+		}
+		else if (kind == 3 && len > 0 && len*2 <= maxLen) //duplicate a run, for many sections with the same name
+		{
+			const size_t runLen = 1 + next_random() % (len - pos);
+			memmove(&buf[pos+runLen], &buf[pos], len - pos);
+			len += runLen;
+		}
+	}
+
+	return len;
+}
+
+static int run_file(const char* filename)
+{
+	FILE* fp = fopen(filename, "rb");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Can't open '%s'\n", filename);
+		return -1;
+	}
+
+	static uint8_t data[1024*1024];
+	const size_t size = fread(data, 1, sizeof(data), fp);
+	fclose(fp);
+
+	LLVMFuzzerTestOneInput(data, size);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && strncmp(argv[1], "--rounds=", 9) != 0)
+	{
+		for (int i=1; i<argc; i++)
+		{
+			if (run_file(argv[i]) != 0)
+				return 1;
+		}
+		return 0;
+	}
+
+	const uint32_t numRounds = (argc > 1) ? (uint32_t)strtoul(&argv[1][9], NULL, 0) : 100000;
+	static uint8_t buf[64*1024];
+	for (uint32_t round=0; round<numRounds; round++)
+	{
+		//mutations pile up for a while before starting over from the seed
+		static size_t len = 0;
+		if (round % 64 == 0)
+		{
+			len = sizeof(SEED_INI)-1;
+			memcpy(buf, SEED_INI, len);
+		}
+
+		len = mutate(buf, len, sizeof(buf));
+		LLVMFuzzerTestOneInput(buf, len);
+	}
+
+	printf("iniparse: %u mutated inis parsed\n", numRounds);
+	return 0;
+}
+#endif
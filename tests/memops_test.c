@@ -0,0 +1,193 @@
+#include "lib/memops.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//Checks memcpy_ref, memmove_ref and memset_ref against libc over random lengths, alignments and overlaps,
+//including every byte around the destination. With --bench it measures them against libc instead.
+
+#define BUF_SIZE (16*1024)
+#define GUARD 64
+
+static uint32_t rngState = 1;
+
+static uint32_t next_random()
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+//mostly short lengths where the alignment and tail handling is, sometimes long ones for the block loops
+static size_t random_length(size_t maxLen)
+{
+	const uint32_t kind = next_random() % 4;
+	size_t len = (kind == 0) ? (next_random() % 16) : (kind == 1) ? (next_random() % 80) : next_random();
+	return len % (maxLen + 1);
+}
+
+static void fill_random(uint8_t* buf, size_t len)
+{
+	for (size_t i=0; i<len; i++)
+		buf[i] = (uint8_t)next_random();
+}
+
+static bool report_mismatch(const char* funcName, uint32_t iter, size_t dstOfs, size_t srcOfs, size_t len, const uint8_t* got, const uint8_t* expected)
+{
+	size_t firstBad = 0;
+	while (got[firstBad] == expected[firstBad])
+		firstBad++;
+
+	printf("%s mismatch in iteration %u: dst offset %zu, src offset %zu, len %zu, first bad byte at buffer offset %zu\n",
+		   funcName, iter, dstOfs, srcOfs, len, firstBad);
+	return false;
+}
+
+static bool run_tests(uint32_t numIters)
+{
+	static uint8_t init[BUF_SIZE];
+	static uint8_t got[BUF_SIZE];
+	static uint8_t expected[BUF_SIZE];
+
+	for (uint32_t iter=0; iter<numIters; iter++)
+	{
+		fill_random(init, sizeof(init));
+
+		//memcpy between two separate halves
+		{
+			const size_t half = BUF_SIZE/2;
+			const size_t len = random_length(half - 2*GUARD - 8);
+			const size_t dstOfs = GUARD + next_random() % (half - 2*GUARD - len + 1);
+			const size_t srcOfs = half + GUARD + next_random() % (half - 2*GUARD - len + 1);
+			memcpy(got, init, BUF_SIZE);
+			memcpy(expected, init, BUF_SIZE);
+			if (memcpy_ref(got + dstOfs, got + srcOfs, len) != got + dstOfs)
+				return report_mismatch("memcpy_ref return", iter, dstOfs, srcOfs, len, got, got);
+
+			memcpy(expected + dstOfs, expected + srcOfs, len);
+			if (memcmp(got, expected, BUF_SIZE) != 0)
+				return report_mismatch("memcpy_ref", iter, dstOfs, srcOfs, len, got, expected);
+		}
+
+		//memmove anywhere, half of the time with src and dst overlapping by a few bytes up to almost all of len
+		{
+			const size_t len = random_length(BUF_SIZE/2);
+			size_t srcOfs = GUARD + next_random() % (BUF_SIZE - 2*GUARD - len + 1);
+			size_t dstOfs = GUARD + next_random() % (BUF_SIZE - 2*GUARD - len + 1);
+			if ((next_random() & 1) && len > 0)
+			{
+				const size_t distance = 1 + next_random() % len;
+				if ((next_random() & 1) && srcOfs + distance + len <= BUF_SIZE - GUARD)
+					dstOfs = srcOfs + distance;
+				else if (srcOfs >= GUARD + distance)
+					dstOfs = srcOfs - distance;
+			}
+
+			memcpy(got, init, BUF_SIZE);
+			memcpy(expected, init, BUF_SIZE);
+			if (memmove_ref(got + dstOfs, got + srcOfs, len) != got + dstOfs)
+				return report_mismatch("memmove_ref return", iter, dstOfs, srcOfs, len, got, got);
+
+			memmove(expected + dstOfs, expected + srcOfs, len);
+			if (memcmp(got, expected, BUF_SIZE) != 0)
+				return report_mismatch("memmove_ref", iter, dstOfs, srcOfs, len, got, expected);
+		}
+
+		//memset with values that don't fit a byte too, only the low 8 bits count
+		{
+			const size_t len = random_length(BUF_SIZE - 2*GUARD);
+			const size_t dstOfs = GUARD + next_random() % (BUF_SIZE - 2*GUARD - len + 1);
+			const int val = (int)next_random();
+			memcpy(got, init, BUF_SIZE);
+			memcpy(expected, init, BUF_SIZE);
+			if (memset_ref(got + dstOfs, val, len) != got + dstOfs)
+				return report_mismatch("memset_ref return", iter, dstOfs, 0, len, got, got);
+
+			memset(expected + dstOfs, val, len);
+			if (memcmp(got, expected, BUF_SIZE) != 0)
+				return report_mismatch("memset_ref", iter, dstOfs, 0, len, got, expected);
+		}
+	}
+
+	printf("memops: %u iterations of memcpy_ref, memmove_ref and memset_ref match libc\n", numIters);
+	return true;
+}
+
+static double now_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef void* (*CopyFunc)(void*, const void*, size_t);
+typedef void* (*SetFunc)(void*, int, size_t);
+
+//MB/s over about 256MB worth of calls
+static double bench_copy(CopyFunc func, uint8_t* dst, const uint8_t* src, size_t len)
+{
+	const size_t numCalls = (256u << 20) / len;
+	const double start = now_seconds();
+	for (size_t i=0; i<numCalls; i++)
+	{
+		func(dst, src, len);
+		__asm__ volatile("" : : "r"(dst) : "memory");
+	}
+	return (double)numCalls * len / (now_seconds() - start) / (1 << 20);
+}
+
+static double bench_set(SetFunc func, uint8_t* dst, size_t len)
+{
+	const size_t numCalls = (256u << 20) / len;
+	const double start = now_seconds();
+	for (size_t i=0; i<numCalls; i++)
+	{
+		func(dst, (int)i, len);
+		__asm__ volatile("" : : "r"(dst) : "memory");
+	}
+	return (double)numCalls * len / (now_seconds() - start) / (1 << 20);
+}
+
+static void run_bench()
+{
+	static const size_t LENGTHS[] = { 64, 4096, 1 << 20 };
+	uint8_t* src = malloc((1 << 20) + 64);
+	uint8_t* dst = malloc((1 << 20) + 64);
+	fill_random(src, (1 << 20) + 64);
+
+	printf("%-10s %9s %9s %12s %12s\n", "func", "len", "dst+src+", "ref MB/s", "libc MB/s");
+	for (size_t i=0; i<sizeof(LENGTHS)/sizeof(LENGTHS[0]); i++)
+	{
+		const size_t len = LENGTHS[i];
+		for (int misalign=0; misalign<2; misalign++)
+		{
+			uint8_t* d = dst + misalign;
+			const uint8_t* s = src + 2*misalign;
+			printf("%-10s %9zu %6d,%-2d %12.0f %12.0f\n", "memcpy", len, misalign, 2*misalign,
+				   bench_copy(memcpy_ref, d, s, len), bench_copy(memcpy, d, s, len));
+			printf("%-10s %9zu %6d,%-2d %12.0f %12.0f\n", "memmove", len, misalign, 2*misalign,
+				   bench_copy(memmove_ref, src + 16 + misalign, src, len), bench_copy(memmove, src + 16 + misalign, src, len));
+			printf("%-10s %9zu %6d,%-2s %12.0f %12.0f\n", "memset", len, misalign, "-",
+				   bench_set(memset_ref, d, len), bench_set(memset, d, len));
+		}
+	}
+
+	free(src);
+	free(dst);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+	{
+		run_bench();
+		return 0;
+	}
+
+	const uint32_t numIters = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 200000;
+	return run_tests(numIters) ? 0 : 1;
+}
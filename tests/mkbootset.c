@@ -0,0 +1,90 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Writes the files of a Linux boot from the card and the ini that loads them, for diskreplay: a coreboot image
+//loaded in several pieces like cbfs2ini splits it, the last one first, then a kernel, an initrd and a dtb.
+//The contents are noise, only the sizes and the offsets the LOADs read from matter.
+
+typedef struct
+{
+	const char* name;
+	uint32_t size;
+} BootFile_t;
+
+typedef struct
+{
+	const char* name;
+	const char* file;
+	uint32_t skip;
+	uint32_t count;
+	uint32_t dst;
+} BootLoad_t;
+
+static const BootFile_t FILES[] =
+{
+	{ "coreboot.rom", 8*1024*1024 },
+	{ "Image", 16*1024*1024 },
+	{ "initramfs.img", 6*1024*1024 },
+	{ "tegra210-icosa.dtb", 180*1024 },
+};
+
+static const BootLoad_t LOADS[] =
+{
+	{ "payload", "coreboot.rom", 0x007A0000, 0x00060000, 0x85000000 },
+	{ "bootblock", "coreboot.rom", 0x00000000, 0x00010000, 0x40010000 },
+	{ "romstage", "coreboot.rom", 0x00010200, 0x00023E00, 0x40020000 },
+	{ "ramstage", "coreboot.rom", 0x00200000, 0x000C0000, 0x80100000 },
+	{ "bl31", "coreboot.rom", 0x00500000, 0x00040000, 0x80000000 },
+	{ "kernel", "Image", 0, 0, 0xA0080000 },
+	{ "initrd", "initramfs.img", 0, 0, 0xA4000000 },
+	{ "dtb", "tegra210-icosa.dtb", 0, 0, 0xA3F00000 },
+};
+
+int main(int argc, char* argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: mkbootset outdir\n");
+		return -1;
+	}
+
+	char path[4096];
+	uint32_t state = 1;
+	for (size_t i=0; i<sizeof(FILES)/sizeof(FILES[0]); i++)
+	{
+		uint8_t* bytes = malloc(FILES[i].size);
+		for (uint32_t j=0; j<FILES[i].size; j++)
+		{
+			state = state*1103515245 + 12345;
+			bytes[j] = (uint8_t)(state >> 16);
+		}
+
+		snprintf(path, sizeof(path), "%s/%s", argv[1], FILES[i].name);
+		FILE* fp = fopen(path, "wb");
+		if (fp == NULL || fwrite(bytes, 1, FILES[i].size, fp) != FILES[i].size)
+		{
+			fprintf(stderr, "Error writing '%s'\n", path);
+			return -2;
+		}
+		fclose(fp);
+		free(bytes);
+	}
+
+	snprintf(path, sizeof(path), "%s/boot.ini", argv[1]);
+	FILE* fp = fopen(path, "w");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Error writing '%s'\n", path);
+		return -2;
+	}
+	for (size_t i=0; i<sizeof(LOADS)/sizeof(LOADS[0]); i++)
+	{
+		fprintf(fp, "[load:%s]\nif=%s\nskip=0x%08x\ncount=0x%08x\ndst=0x%08x\n\n",
+				LOADS[i].name, LOADS[i].file, LOADS[i].skip, LOADS[i].count, LOADS[i].dst);
+	}
+	fprintf(fp, "[boot:coreboot]\npc=0x40010000\n");
+	fclose(fp);
+	return 0;
+}
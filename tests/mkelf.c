@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+//Writes a small AArch64 executable whose PT_LOADs cover what elf2ini has to deal with: text, data with a bss
+//tail and trailing zero bytes a little after it, a bss-only segment, a PT_NOTE in between and a far away segment.
+
+typedef struct
+{
+	uint32_t type;
+	uint64_t offset;
+	uint64_t vaddr;
+	uint64_t filesz;
+	uint64_t memsz;
+} Segment_t;
+
+static void put_le(uint8_t* p, uint64_t val, size_t numBytes)
+{
+	for (size_t i=0; i<numBytes; i++)
+		p[i] = (uint8_t)(val >> (8*i));
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: mkelf output.elf\n");
+		return -1;
+	}
+
+	static const Segment_t SEGMENTS[] =
+	{
+		{ 1, 0x1000, 0x80000000, 0x3000, 0x3000 },
+		{ 1, 0x4000, 0x80003800, 0x0200, 0x2000 },
+		{ 4, 0x0000, 0x00000000, 0x0000, 0x0000 },
+		{ 1, 0x4200, 0x80006000, 0x0000, 0x1000 },
+		{ 1, 0x4200, 0x90000000, 0x0100, 0x0100 },
+	};
+	const size_t numSegments = sizeof(SEGMENTS)/sizeof(SEGMENTS[0]);
+
+	static uint8_t elf[0x4300];
+	memcpy(elf, "\x7f" "ELF\x02\x01\x01", 7);
+	put_le(&elf[0x10], 2, 2); //ET_EXEC
+	put_le(&elf[0x12], 183, 2); //EM_AARCH64
+	put_le(&elf[0x14], 1, 4);
+	put_le(&elf[0x18], SEGMENTS[0].vaddr, 8);
+	put_le(&elf[0x20], 64, 8);
+	put_le(&elf[0x34], 64, 2);
+	put_le(&elf[0x36], 56, 2);
+	put_le(&elf[0x38], numSegments, 2);
+	put_le(&elf[0x3A], 64, 2);
+	for (size_t i=0; i<numSegments; i++)
+	{
+		uint8_t* ph = &elf[64 + i*56];
+		put_le(&ph[0x00], SEGMENTS[i].type, 4);
+		put_le(&ph[0x04], 5, 4);
+		put_le(&ph[0x08], SEGMENTS[i].offset, 8);
+		put_le(&ph[0x10], SEGMENTS[i].vaddr, 8);
+		put_le(&ph[0x18], SEGMENTS[i].vaddr, 8);
+		put_le(&ph[0x20], SEGMENTS[i].filesz, 8);
+		put_le(&ph[0x28], SEGMENTS[i].memsz, 8);
+		put_le(&ph[0x30], 0x1000, 8);
+	}
+
+	//compressible text, data that isn't and ends in zeroes, then the far segment
+	uint32_t state = 1;
+	for (size_t i=0x1000; i<0x4000; i++)
+		elf[i] = "mov x0, #0\nret\n"[i % 15];
+	for (size_t i=0x4000; i<0x4100; i++)
+	{
+		state = state*1103515245 + 12345;
+		elf[i] = (uint8_t)(state >> 16);
+	}
+	memset(&elf[0x4200], 0x11, 0x100);
+
+	FILE* fp = fopen(argv[1], "wb");
+	if (fp == NULL || fwrite(elf, 1, sizeof(elf), fp) != sizeof(elf))
+	{
+		fprintf(stderr, "Error writing '%s'\n", argv[1]);
+		return -2;
+	}
+	fclose(fp);
+	return 0;
+}
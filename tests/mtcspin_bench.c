@@ -0,0 +1,133 @@
+#include "crc32.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+//What one spin of the BPMP's wait loop costs in mtc_redo_periodic_training, before and after it started checking
+//the time first. mtc.c itself needs the minerva_tc headers, so the two versions are modelled here with the same
+//crc32 calls on a table of the same size. The spin cost is also how late a mailbox command gets noticed.
+
+//the size of Minerva's emc_table_t, and a table of 10 of them
+static const size_t EMC_TABLE_ENTRY_SIZE = 4928;
+static const size_t EMC_TABLE_ENTRIES = 10;
+//only changes how often a spin trains, not what a spin costs otherwise
+static const uint32_t EMC_PERIODIC_TRAIN_MS = 100;
+
+//stands in for get_tmr_ms, which reads the microsecond timer register on the BPMP
+static uint32_t get_tmr_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+//the crc32b the old loop called, before the lookup tables
+static unsigned int crc32_bitwise(const unsigned char* message, unsigned int msgLen)
+{
+	unsigned int crc = 0xFFFFFFFF;
+	for (unsigned int i=0; i<msgLen; i++)
+	{
+		crc = crc ^ message[i];
+		for (int j=7; j>=0; j--)
+		{
+			const unsigned int mask = -(crc & 1);
+			crc = (crc >> 1) ^ (0xEDB88320 & mask);
+		}
+	}
+	return ~crc;
+}
+
+static unsigned char* mtcTable;
+static unsigned int tableCrc;
+static unsigned int entryCrc;
+static int numCorrupt;
+
+//the old order: the whole table verified, then the time checked
+static uint32_t spin_old(uint32_t lastPeriodicMs, unsigned int (*crc)(const unsigned char*, unsigned int))
+{
+	if (crc(mtcTable, EMC_TABLE_ENTRY_SIZE * EMC_TABLE_ENTRIES) != tableCrc)
+	{
+		numCorrupt++;
+		return 0;
+	}
+
+	const uint32_t currTimeMs = get_tmr_ms();
+	if (currTimeMs < lastPeriodicMs + EMC_PERIODIC_TRAIN_MS)
+		return lastPeriodicMs;
+
+	return currTimeMs;
+}
+
+static unsigned int crc32_sliced(const unsigned char* message, unsigned int msgLen)
+{
+	return crc32b((unsigned char*)message, msgLen);
+}
+
+//the current order: the time first, and only the running entry once it's time to train
+static uint32_t spin_new(uint32_t lastPeriodicMs)
+{
+	const uint32_t currTimeMs = get_tmr_ms();
+	if (currTimeMs < lastPeriodicMs + EMC_PERIODIC_TRAIN_MS)
+		return lastPeriodicMs;
+
+	if (crc32b(mtcTable, EMC_TABLE_ENTRY_SIZE) != entryCrc)
+		numCorrupt++;
+
+	return currTimeMs;
+}
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+	static const double RUN_SECONDS = 0.5;
+
+	mtcTable = malloc(EMC_TABLE_ENTRY_SIZE * EMC_TABLE_ENTRIES);
+	for (size_t i=0; i<EMC_TABLE_ENTRY_SIZE * EMC_TABLE_ENTRIES; i++)
+		mtcTable[i] = (unsigned char)(i * 7 + (i >> 8));
+
+	tableCrc = crc32b(mtcTable, EMC_TABLE_ENTRY_SIZE * EMC_TABLE_ENTRIES);
+	entryCrc = crc32b(mtcTable, EMC_TABLE_ENTRY_SIZE);
+
+	printf("%zu byte MTC table, %u ms between trainings\n", EMC_TABLE_ENTRY_SIZE * EMC_TABLE_ENTRIES, EMC_PERIODIC_TRAIN_MS);
+	for (int which=0; which<3; which++)
+	{
+		uint32_t lastPeriodicMs = get_tmr_ms();
+		uint64_t numSpins = 0;
+		const double start = now_seconds();
+		double elapsed = 0;
+		do
+		{
+			//a batch between clock reads, so reading the clock here doesn't dominate the new loop
+			for (int i=0; i<64; i++)
+			{
+				if (which == 0)
+					lastPeriodicMs = spin_old(lastPeriodicMs, crc32_bitwise);
+				else if (which == 1)
+					lastPeriodicMs = spin_old(lastPeriodicMs, crc32_sliced);
+				else
+					lastPeriodicMs = spin_new(lastPeriodicMs);
+			}
+			numSpins += 64;
+			elapsed = now_seconds() - start;
+		} while (elapsed < RUN_SECONDS);
+
+		static const char* const NAMES[] = { "table crc first, bitwise crc32", "table crc first, sliced crc32", "time first" };
+		const double nsPerSpin = elapsed * 1e9 / numSpins;
+		printf("%-32s %12.1f ns per spin\n", NAMES[which], nsPerSpin);
+	}
+
+	const double start = now_seconds();
+	static const int ENTRY_CHECKS = 1000;
+	for (int i=0; i<ENTRY_CHECKS; i++)
+		numCorrupt += crc32b(mtcTable, EMC_TABLE_ENTRY_SIZE) != entryCrc;
+
+	printf("%-32s %12.1f ns per training\n", "running entry check", (now_seconds() - start) * 1e9 / ENTRY_CHECKS);
+	return numCorrupt != 0;
+}
@@ -0,0 +1,307 @@
+#define _GNU_SOURCE
+#include "iniparse.h"
+#include "execplan.h"
+#include "sectexec.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+//Runs an ini the way memloader does, with the same plan and the same LOAD/COPY code, on memory mapped at the
+//addresses the ini uses. Files are taken relative to the ini, like the firmware takes them relative to the card root.
+//With --expect-elf the memory of every PT_LOAD of that ELF must afterwards hold its file bytes followed by zeroes.
+
+//whatever was in memory before must not pass for zero fill
+static const uint8_t POISON_BYTE = 0xA5;
+
+typedef struct
+{
+	FILE* fp;
+	size_t currPos;
+	size_t endPos;
+} FileReader_t;
+
+static size_t file_reader_read(void* ctx, void* buf, size_t len)
+{
+	FileReader_t* rdr = ctx;
+	if (len > rdr->endPos - rdr->currPos)
+		len = rdr->endPos - rdr->currPos;
+
+	const size_t bytesRead = fread(buf, 1, len, rdr->fp);
+	rdr->currPos += bytesRead;
+	return bytesRead;
+}
+
+static char* read_whole_file(const char* filename, size_t* outSize)
+{
+	FILE* fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return NULL;
+
+	fseek(fp, 0, SEEK_END);
+	const long fileSize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	char* bytes = malloc(fileSize+1);
+	if (bytes != NULL && fread(bytes, 1, fileSize, fp) != (size_t)fileSize)
+	{
+		free(bytes);
+		bytes = NULL;
+	}
+	fclose(fp);
+
+	if (bytes != NULL)
+	{
+		bytes[fileSize] = 0;
+		*outSize = fileSize;
+	}
+	return bytes;
+}
+
+static char iniDir[4096];
+
+static FILE* open_plan_file(const char* filename, size_t* outSize)
+{
+	char path[sizeof(iniDir) + 256];
+	snprintf(path, sizeof(path), "%s%s", iniDir, filename);
+	FILE* fp = fopen(path, "rb");
+	if (fp == NULL)
+	{
+		printf("Can't open '%s'\n", path);
+		return NULL;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	*outSize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	return fp;
+}
+
+//same as get_load_write_size in main.c
+static uint64_t get_load_write_size(const IniLoadSection_t* sect)
+{
+	if (sect->filename == NULL)
+		return (uint64_t)sect->sectors * 512;
+	else if (sect->compType != 0)
+		return sect->dstlen;
+
+	return sect->count;
+}
+
+//bytes an unsized LOAD ends up writing, only needed here to know how much memory to map
+static uint32_t get_load_file_size(const IniLoadSection_t* sect)
+{
+	size_t fileSize = 0;
+	FILE* fp = open_plan_file(sect->filename, &fileSize);
+	if (fp == NULL)
+		return 0;
+
+	fclose(fp);
+	return (fileSize > sect->skip) ? (uint32_t)(fileSize - sect->skip) : 0;
+}
+
+static bool map_range(uint64_t start, uint64_t len)
+{
+	static const uint64_t PAGE_SIZE = 4096;
+	if (len == 0)
+		return true;
+
+	uint64_t pageStart = start & ~(PAGE_SIZE-1);
+	const uint64_t pageEnd = (start + len + PAGE_SIZE-1) & ~(PAGE_SIZE-1);
+	for (; pageStart < pageEnd; pageStart += PAGE_SIZE)
+	{
+		void* page = mmap((void*)(uintptr_t)pageStart, PAGE_SIZE, PROT_READ | PROT_WRITE,
+						  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+		if (page == MAP_FAILED)
+			continue; //already mapped for an earlier section
+
+		if (page != (void*)(uintptr_t)pageStart)
+		{
+			printf("Can't map memory at 0x%08llx\n", (unsigned long long)pageStart);
+			return false;
+		}
+		memset(page, POISON_BYTE, PAGE_SIZE);
+	}
+	return true;
+}
+
+static int run_load(const IniLoadSection_t* sect)
+{
+	if (sect->filename == NULL)
+	{
+		printf("LOAD '%s' reads raw sectors, not supported here\n", sect->sectname);
+		return 0;
+	}
+
+	size_t fileSize = 0;
+	FILE* fp = open_plan_file(sect->filename, &fileSize);
+	if (fp == NULL)
+		return 0;
+
+	//the extents work out the same as in execute_load_section
+	size_t lastExtent = fileSize;
+	size_t bytesToZero = 0;
+	if (sect->count != 0)
+	{
+		lastExtent = (size_t)sect->skip + sect->count;
+		if (lastExtent > fileSize)
+		{
+			bytesToZero = lastExtent - fileSize;
+			lastExtent = fileSize;
+		}
+	}
+
+	int retVal = 0;
+	size_t len = 0;
+	if (fileSize >= sect->skip)
+	{
+		FileReader_t rdr = { fp, sect->skip, lastExtent };
+		fseek(fp, sect->skip, SEEK_SET);
+		retVal = load_section_fill(sect, file_reader_read, &rdr, lastExtent - sect->skip, bytesToZero, &len);
+	}
+	fclose(fp);
+
+	printf("LOAD '%s' (%s[0x%08x,0x%08x]) -> 0x%08x: %s (%zu bytes)\n", sect->sectname, sect->filename,
+		   sect->skip, sect->count, sect->dst, retVal ? "OK" : "FAILED", len);
+	return retVal;
+}
+
+static int run_copy(const IniCopySection_t* sect)
+{
+	size_t len = 0;
+	const int retVal = copy_section_run(sect, &len);
+	printf("COPY '%s' type %u [0x%08x,0x%08x] -> [0x%08x,0x%08x]: %s (%zu bytes)\n", sect->sectname, sect->compType,
+		   sect->src, sect->srclen, sect->dst, sect->dstlen, retVal ? "OK" : "FAILED", len);
+	return retVal;
+}
+
+static uint64_t read_le(const uint8_t* p, size_t numBytes)
+{
+	uint64_t val = 0;
+	for (size_t i=0; i<numBytes; i++)
+		val |= (uint64_t)p[i] << (8*i);
+
+	return val;
+}
+
+static bool check_elf_memory(const char* elfFilename)
+{
+	size_t elfSize = 0;
+	const uint8_t* elf = (const uint8_t*)read_whole_file(elfFilename, &elfSize);
+	if (elf == NULL || elfSize < 64 || memcmp(elf, "\x7f" "ELF\x02\x01", 6) != 0)
+	{
+		printf("'%s' isn't a little endian 64-bit ELF\n", elfFilename);
+		return false;
+	}
+
+	const uint64_t phoff = read_le(&elf[0x20], 8);
+	const unsigned phentsize = (unsigned)read_le(&elf[0x36], 2);
+	const unsigned phnum = (unsigned)read_le(&elf[0x38], 2);
+	bool allMatch = true;
+	for (unsigned i=0; i<phnum; i++)
+	{
+		const uint8_t* ph = &elf[phoff + (uint64_t)i*phentsize];
+		if (read_le(&ph[0], 4) != 1) //PT_LOAD
+			continue;
+
+		const uint64_t offset = read_le(&ph[0x08], 8);
+		const uint8_t* vaddr = (const uint8_t*)(uintptr_t)read_le(&ph[0x10], 8);
+		const uint64_t filesz = read_le(&ph[0x20], 8);
+		const uint64_t memsz = read_le(&ph[0x28], 8);
+
+		bool match = memcmp(vaddr, &elf[offset], filesz) == 0;
+		for (uint64_t j=filesz; j<memsz && match; j++)
+			match = vaddr[j] == 0;
+
+		printf("PH_%u [%p,0x%08llx]: %s\n", i, vaddr, (unsigned long long)memsz, match ? "matches" : "MISMATCH");
+		allMatch = allMatch && match;
+	}
+
+	free((void*)elf);
+	return allMatch;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* expectElf = NULL;
+	const char* iniFilename = NULL;
+	for (int i=1; i<argc; i++)
+	{
+		if (strncmp(argv[i], "--expect-elf=", 13) == 0)
+			expectElf = &argv[i][13];
+		else
+			iniFilename = argv[i];
+	}
+
+	if (iniFilename == NULL)
+	{
+		fprintf(stderr, "Usage: planrun [--expect-elf=file.elf] plan.ini\n");
+		return -1;
+	}
+
+	const char* lastSlash = strrchr(iniFilename, '/');
+	if (lastSlash != NULL)
+		snprintf(iniDir, sizeof(iniDir), "%.*s/", (int)(lastSlash - iniFilename), iniFilename);
+
+	size_t iniSize = 0;
+	char* iniBytes = read_whole_file(iniFilename, &iniSize);
+	if (iniBytes == NULL)
+	{
+		fprintf(stderr, "Can't read '%s'\n", iniFilename);
+		return -2;
+	}
+
+	IniArena_t arena;
+	arena.size = memloader_ini_arena_size(iniBytes, (int)iniSize);
+	arena.base = malloc(arena.size);
+	arena.used = 0;
+	const IniParsedInfo_t info = parse_memloader_ini(iniBytes, (int)iniSize, &arena, (ErrPrintFunc)printf);
+
+	int numLoads = 0;
+	int numCopies = 0;
+	for (IniLoadSectionNode_t* nod=info.loads; nod!=NULL; nod=nod->next)
+		numLoads++;
+	for (IniCopySectionNode_t* nod=info.copies; nod!=NULL; nod=nod->next)
+		numCopies++;
+
+	uint64_t* loadSizes = calloc(numLoads + 1, sizeof(uint64_t));
+	int i = 0;
+	for (IniLoadSectionNode_t* nod=info.loads; nod!=NULL; nod=nod->next, i++)
+		loadSizes[i] = get_load_write_size(&nod->curr);
+
+	ExecStep_t* steps = calloc(numLoads + numCopies + 1, sizeof(ExecStep_t));
+	const int numSteps = build_exec_plan(&info, loadSizes, steps, (ErrPrintFunc)printf);
+	if (numSteps < 0)
+		return -4;
+
+	//only once the plan is accepted, it refuses sizes that couldn't be mapped
+	i = 0;
+	bool mapped = true;
+	for (IniLoadSectionNode_t* nod=info.loads; nod!=NULL; nod=nod->next, i++)
+	{
+		const uint64_t mapSize = (loadSizes[i] != 0) ? loadSizes[i] : get_load_file_size(&nod->curr);
+		mapped = mapped && map_range(nod->curr.dst, mapSize);
+	}
+	for (IniCopySectionNode_t* nod=info.copies; nod!=NULL; nod=nod->next)
+	{
+		const IniCopySection_t* sect = &nod->curr;
+		mapped = mapped && map_range(sect->src, sect->srclen) &&
+				 map_range(sect->dst, (sect->dstlen > sect->srclen) ? sect->dstlen : sect->srclen);
+	}
+	if (!mapped)
+		return -3;
+
+	for (i=0; i<numSteps; i++)
+	{
+		const int ok = (steps[i].type == EXEC_STEP_LOAD) ? run_load(steps[i].load) : run_copy(steps[i].copy);
+		if (!ok)
+			return -5;
+	}
+
+	if (expectElf != NULL && !check_elf_memory(expectElf))
+		return -6;
+
+	return 0;
+}
@@ -0,0 +1,53 @@
+#include "ramdisk.h"
+#include "storage.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t* ramdiskImage;
+static uint32_t ramdiskSectors;
+static RamdiskStats_t ramdiskStats;
+static sdmmc_storage_t ramdiskStorage;
+
+void ramdisk_attach(const uint8_t* image, uint32_t numSectors)
+{
+	ramdiskImage = image;
+	ramdiskSectors = numSectors;
+	memset(&ramdiskStats, 0, sizeof(ramdiskStats));
+	ramdiskStorage.sec_cnt = numSectors;
+}
+
+void ramdisk_stats(RamdiskStats_t* stats)
+{
+	*stats = ramdiskStats;
+}
+
+sdmmc_storage_t* get_storage_for_index(u8 pdrv)
+{
+	return &ramdiskStorage;
+}
+
+int sdmmc_storage_read(sdmmc_storage_t* storage, u32 sector, u32 num_sectors, void* buf)
+{
+	if (ramdiskImage == NULL || sector >= ramdiskSectors || num_sectors > ramdiskSectors - sector)
+		return 0;
+
+	ramdiskStats.commands++;
+	if (num_sectors == 1)
+		ramdiskStats.singleCommands++;
+	ramdiskStats.sectors += num_sectors;
+
+	memcpy(buf, &ramdiskImage[(size_t)sector * 512], (size_t)num_sectors * 512);
+	return 1;
+}
+
+//the volume is mounted read-only, same as on the console
+int sdmmc_storage_write(sdmmc_storage_t* storage, u32 sector, u32 num_sectors, void* buf)
+{
+	return 0;
+}
+
+//diskio.c is built with malloc renamed to this, heap.h declares it with a u32 size that libc's can't take
+void* ramdisk_malloc(u32 size)
+{
+	return aligned_alloc(16, (size + 15) & ~15u);
+}
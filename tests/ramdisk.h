@@ -0,0 +1,19 @@
+#ifndef _RAMDISK_H_
+#define _RAMDISK_H_
+
+#include <stdint.h>
+
+//Stands in for the SD card under diskio.c on the host: get_storage_for_index and sdmmc_storage_read
+//serve sectors out of a memory image and count the commands the card would have received.
+
+typedef struct
+{
+	uint32_t commands; //reads issued to the card, one CMD17/CMD18 each
+	uint32_t singleCommands; //the ones for a single sector
+	uint64_t sectors;
+} RamdiskStats_t;
+
+void ramdisk_attach(const uint8_t* image, uint32_t numSectors);
+void ramdisk_stats(RamdiskStats_t* stats);
+
+#endif
@@ -0,0 +1,349 @@
+#define _GNU_SOURCE
+#include "sectexec.h"
+#include "blzstream.h"
+#include "lib/blzdecode.h"
+#include "lib/memops.h"
+#include <lz4frame.h>
+#include <lzma.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+//Compressed LOAD and COPY sections only zero the part of dst their decoder didn't write. This runs them through
+//sectexec.c on poisoned memory and checks every byte against zeroing the whole of dst first and then decoding,
+//which is what the firmware used to do, bytes past dstlen included. With --bench it times both.
+
+static const uint8_t POISON_BYTE = 0xA5;
+
+//past dstlen, nothing may be touched
+static const size_t GUARD_SIZE = 64;
+
+static uint64_t rngState = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rng_next(void)
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 7;
+	rngState ^= rngState << 17;
+	return (uint32_t)(rngState >> 32);
+}
+
+//sections hold 32-bit addresses
+static uint8_t* map_low(size_t len)
+{
+	void* mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+	return (mem == MAP_FAILED) ? NULL : mem;
+}
+
+//runs of a few letters, so there's something for the encoders to find
+static void make_payload(uint8_t* buf, size_t len)
+{
+	for (size_t i=0; i<len;)
+	{
+		const uint8_t val = (uint8_t)(rng_next() % 7 + 'a');
+		for (size_t run=1 + rng_next() % 12; run>0 && i<len; run--)
+			buf[i++] = val;
+	}
+}
+
+//same settings as tools/compress.cpp apart from the levels, which only slow the test down
+static size_t compress_lzma(const uint8_t* src, size_t srcLen, uint8_t* out, size_t outSize)
+{
+	lzma_options_lzma options;
+	if (lzma_lzma_preset(&options, 1))
+		return 0;
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	if (lzma_alone_encoder(&strm, &options) != LZMA_OK)
+		return 0;
+
+	strm.next_in = src;
+	strm.avail_in = srcLen;
+	strm.next_out = out;
+	strm.avail_out = outSize;
+	const lzma_ret ret = lzma_code(&strm, LZMA_FINISH);
+	const size_t outLen = outSize - strm.avail_out;
+	lzma_end(&strm);
+	if (ret != LZMA_STREAM_END)
+		return 0;
+
+	//the real size instead of the end marker, like elf2ini writes it
+	for (size_t i=0; i<8; i++)
+		out[5 + i] = (uint8_t)((uint64_t)srcLen >> (8*i));
+
+	return outLen;
+}
+
+static size_t compress_lz4(const uint8_t* src, size_t srcLen, uint8_t* out, size_t outSize)
+{
+	LZ4F_preferences_t prefs;
+	memset(&prefs, 0, sizeof(prefs));
+	prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+	prefs.frameInfo.blockMode = LZ4F_blockLinked;
+	prefs.frameInfo.contentSize = srcLen;
+
+	if (LZ4F_compressFrameBound(srcLen, &prefs) > outSize)
+		return 0;
+
+	const size_t outLen = LZ4F_compressFrame(out, outSize, src, srcLen, &prefs);
+	return LZ4F_isError(outLen) ? 0 : outLen;
+}
+
+typedef struct
+{
+	uint32_t compType;
+	uint8_t* comp; //compressed stream, in low memory so a COPY can point at it
+	size_t compLen;
+	uint8_t* plain; //what it decodes to, NULL for BLZ streams which are made up token by token
+	size_t plainLen;
+} Stream_t;
+
+static StreamWriter_t blzWriter;
+
+static bool make_stream(Stream_t* strm, uint32_t compType, uint8_t* plain, size_t plainLen, uint8_t* comp, size_t compSize)
+{
+	strm->compType = compType;
+	strm->comp = comp;
+	strm->plain = plain;
+	strm->plainLen = plainLen;
+	if (compType == 1)
+		strm->compLen = compress_lzma(plain, plainLen, comp, compSize);
+	else if (compType == 2)
+		strm->compLen = compress_lz4(plain, plainLen, comp, compSize);
+	else
+	{
+		strm->plain = NULL;
+		strm->compLen = make_random_stream(comp, plainLen, &blzWriter, rng_next);
+		if (strm->compLen > plainLen)
+			strm->compLen = 0; //doesn't fit its own output
+
+		//random tokens can reach back before the start of the output
+		uint8_t* scratch = malloc(plainLen);
+		if (strm->compLen != 0 && scratch != NULL)
+		{
+			memcpy(scratch, comp, strm->compLen);
+			if (blz_uncompress(scratch, strm->compLen, plainLen) != plainLen)
+				strm->compLen = 0;
+		}
+		free(scratch);
+	}
+
+	return strm->compLen != 0;
+}
+
+typedef struct
+{
+	const uint8_t* src;
+	size_t pos;
+	size_t len;
+} MemReader_t;
+
+static size_t mem_reader_read(void* ctx, void* buf, size_t len)
+{
+	MemReader_t* rdr = ctx;
+	if (len > rdr->len - rdr->pos)
+		len = rdr->len - rdr->pos;
+
+	memcpy(buf, &rdr->src[rdr->pos], len);
+	rdr->pos += len;
+	return len;
+}
+
+//the previous behaviour: all of dst zeroed, then the decoder
+static size_t decode_full_zero(const Stream_t* strm, uint8_t* dst, size_t dstLen, bool asLoad)
+{
+	memzero(dst, dstLen);
+	if (asLoad && strm->compType != 3)
+	{
+		MemReader_t rdr = { strm->comp, 0, strm->compLen };
+		return (strm->compType == 1) ? ulzman_stream(mem_reader_read, &rdr, dst, dstLen) :
+									   ulz4fn_stream(mem_reader_read, &rdr, dst, dstLen);
+	}
+
+	if (strm->compType == 1)
+		return ulzman(strm->comp, strm->compLen, dst, dstLen);
+	else if (strm->compType == 2)
+		return ulz4fn(strm->comp, strm->compLen, dst, dstLen);
+
+	memmove(dst, strm->comp, strm->compLen);
+	return blz_uncompress(dst, strm->compLen, dstLen);
+}
+
+//what main.c does now, through sectexec.c
+static size_t decode_tail_zero(const Stream_t* strm, uint8_t* dst, size_t dstLen, bool asLoad)
+{
+	size_t len = 0;
+	if (asLoad)
+	{
+		IniLoadSection_t sect;
+		memset(&sect, 0, sizeof(sect));
+		sect.sectname = "tailzero";
+		sect.filename = "tailzero.bin";
+		sect.dst = (uint32_t)(uintptr_t)dst;
+		sect.compType = strm->compType;
+		sect.dstlen = (uint32_t)dstLen;
+
+		MemReader_t rdr = { strm->comp, 0, strm->compLen };
+		return load_section_fill(&sect, mem_reader_read, &rdr, strm->compLen, 0, &len) ? len : 0;
+	}
+
+	IniCopySection_t sect;
+	memset(&sect, 0, sizeof(sect));
+	sect.sectname = "tailzero";
+	sect.compType = strm->compType;
+	sect.src = (uint32_t)(uintptr_t)strm->comp;
+	sect.srclen = (uint32_t)strm->compLen;
+	sect.dst = (uint32_t)(uintptr_t)dst;
+	sect.dstlen = (uint32_t)dstLen;
+	return copy_section_run(&sect, &len) ? len : 0;
+}
+
+static const char* const COMP_NAMES[] = { "", "lzma", "lz4", "blz" };
+
+static bool is_filled(const uint8_t* buf, size_t len, uint8_t val)
+{
+	for (size_t i=0; i<len; i++)
+	{
+		if (buf[i] != val)
+			return false;
+	}
+	return true;
+}
+
+//the decoded bytes have to match, after them dst has to be all zeroes with tail only zeroing. Zeroing first
+//doesn't guarantee that, the decoders may write scratch bytes past their output which it leaves behind.
+static bool check_stream(const Stream_t* strm, uint8_t* dst, uint8_t* refDst, size_t dstLen, bool asLoad, bool* outRefStale)
+{
+	memset(dst, POISON_BYTE, dstLen + GUARD_SIZE);
+	memset(refDst, POISON_BYTE, dstLen + GUARD_SIZE);
+
+	const size_t len = decode_tail_zero(strm, dst, dstLen, asLoad);
+	const size_t refLen = decode_full_zero(strm, refDst, dstLen, asLoad);
+	bool ok = len == refLen && len != 0 && memcmp(dst, refDst, len) == 0 && is_filled(&dst[len], dstLen - len, 0) &&
+			  is_filled(&dst[dstLen], GUARD_SIZE, POISON_BYTE) && is_filled(&refDst[dstLen], GUARD_SIZE, POISON_BYTE);
+	if (ok && strm->plain != NULL)
+		ok = len == strm->plainLen && memcmp(dst, strm->plain, len) == 0;
+
+	if (!ok)
+	{
+		printf("%s %s: %zu bytes into a dst of %zu at alignment %u, tail only gave %zu, full zero %zu\n",
+			   asLoad ? "LOAD" : "COPY", COMP_NAMES[strm->compType], strm->plainLen, dstLen,
+			   (unsigned)((uintptr_t)dst & 15), len, refLen);
+	}
+
+	*outRefStale = !is_filled(&refDst[refLen], dstLen - refLen, 0);
+	return ok;
+}
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run_bench(void)
+{
+	//a kernel sized section with a large tail, bss and the rest of its reserved area
+	static const size_t PLAIN_LEN = 16*1024*1024;
+	static const size_t DST_LEN = 64*1024*1024;
+	static const int ROUNDS = 5;
+
+	uint8_t* plain = malloc(PLAIN_LEN);
+	uint8_t* comp = map_low(PLAIN_LEN * 2);
+	uint8_t* dst = map_low(DST_LEN + GUARD_SIZE);
+	blzWriter.bytes = malloc(PLAIN_LEN * 2);
+	if (plain == NULL || comp == NULL || dst == NULL || blzWriter.bytes == NULL)
+		return 1;
+
+	make_payload(plain, PLAIN_LEN);
+	printf("%zu MiB decoded into a %zu MiB dst\n", PLAIN_LEN >> 20, DST_LEN >> 20);
+	for (uint32_t compType=1; compType<=3; compType++)
+	{
+		Stream_t strm;
+		if (!make_stream(&strm, compType, plain, PLAIN_LEN, comp, PLAIN_LEN * 2))
+			return 1;
+
+		for (int asLoad=0; asLoad<2; asLoad++)
+		{
+			double bestFull = 1e9;
+			double bestTail = 1e9;
+			for (int r=0; r<ROUNDS; r++)
+			{
+				double t = now_seconds();
+				if (decode_full_zero(&strm, dst, DST_LEN, asLoad) != PLAIN_LEN)
+					return 1;
+				double elapsed = now_seconds() - t;
+				if (elapsed < bestFull)
+					bestFull = elapsed;
+
+				t = now_seconds();
+				if (decode_tail_zero(&strm, dst, DST_LEN, asLoad) != PLAIN_LEN)
+					return 1;
+				elapsed = now_seconds() - t;
+				if (elapsed < bestTail)
+					bestTail = elapsed;
+			}
+			printf("%s %-4s full zero %7.2f ms, tail only %7.2f ms (%.2fx)\n", asLoad ? "LOAD" : "COPY",
+				   COMP_NAMES[compType], bestFull * 1e3, bestTail * 1e3, bestFull / bestTail);
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	static const int ITERATIONS = 300;
+	static const size_t MAX_PLAIN = 64*1024;
+	static const size_t MAX_TAIL = 16*1024;
+	static const size_t MAX_DST = MAX_PLAIN + MAX_TAIL + 16 + GUARD_SIZE;
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+		return run_bench();
+
+	uint8_t* plain = malloc(MAX_PLAIN);
+	uint8_t* comp = map_low(MAX_PLAIN * 2);
+	uint8_t* dst = map_low(MAX_DST);
+	uint8_t* refDst = map_low(MAX_DST);
+	blzWriter.bytes = malloc(MAX_PLAIN * 2);
+	if (plain == NULL || comp == NULL || dst == NULL || refDst == NULL || blzWriter.bytes == NULL)
+	{
+		printf("Can't allocate the buffers\n");
+		return 1;
+	}
+
+	int numChecked = 0;
+	int numRefStale[4] = { 0 };
+	for (int i=0; i<ITERATIONS; i++)
+	{
+		const uint32_t compType = 1 + i % 3;
+		const size_t plainLen = 1 + rng_next() % MAX_PLAIN;
+		//every fourth one has no tail at all
+		const size_t tailLen = (rng_next() % 4 == 0) ? 0 : rng_next() % MAX_TAIL;
+		const size_t align = rng_next() % 16;
+		make_payload(plain, plainLen);
+
+		Stream_t strm;
+		if (!make_stream(&strm, compType, plain, plainLen, comp, MAX_PLAIN * 2))
+			continue;
+
+		for (int asLoad=0; asLoad<2; asLoad++)
+		{
+			bool refStale = false;
+			if (!check_stream(&strm, dst + align, refDst + align, plainLen + tailLen, asLoad, &refStale))
+				return 1;
+
+			numRefStale[compType] += refStale;
+		}
+		numChecked++;
+	}
+
+	printf("tail only zeroing matches zeroing all of dst for %d compressed LOAD and COPY pairs\n", numChecked);
+	printf("zeroing first left decoder bytes after the output in %d lzma, %d lz4 and %d blz runs\n",
+		   numRefStale[1], numRefStale[2], numRefStale[3]);
+	return 0;
+}
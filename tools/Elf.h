@@ -1,6 +1,6 @@
 #pragma once
 #include "Types.h"
-#include <iostream>
+#include "ImageView.h"
 
 struct Elf
 {
@@ -102,11 +102,12 @@ struct Elf
 		PF_READ = 4
 	};
 
-	template<size_t bitness>
+	//the unused parameter makes these partial specializations, which unlike explicit ones may be in class scope
+	template<size_t bitness, bool unused=true>
 	struct Types {};
 
-	template<>
-	struct Types<32>
+	template<bool unused>
+	struct Types<32, unused>
 	{
 		typedef u32	Addr;
 		typedef u16	Half;
@@ -118,8 +119,8 @@ struct Elf
 		typedef s32 SLong;
 	};
 
-	template<>
-	struct Types<64>
+	template<bool unused>
+	struct Types<64, unused>
 	{
 		typedef u64	Addr;
 		typedef u16	Half;
@@ -162,9 +163,9 @@ struct Elf
 					ident[EI_MAG3] == ELF_MAGIC_3);
 		}
 
-		HeaderBase& deserialize(std::istream& src)
+		HeaderBase& deserialize(ImageCursor& src)
 		{
-			src.read((char*)this->ident, ELF_NIDENT);
+			src.read(this->ident, ELF_NIDENT);
 			return *this;
 		}
 	};
@@ -189,22 +190,23 @@ struct Elf
 		typename T::Half shnum;       // Number of entries in the section header table
 		typename T::Half shstrndx;    // Sect hdr table index of sect name string table
 
-		Header& deserialize(std::istream& src)
+		//fields are read as little-endian, big-endian files are rejected from the ident before this
+		Header& deserialize(ImageCursor& src)
 		{
 			HeaderBase::deserialize(src);
-			src.read((char*)&this->type, sizeof(this->type));
-			src.read((char*)&this->machine, sizeof(this->machine));
-			src.read((char*)&this->version, sizeof(this->version));
-			src.read((char*)&this->entry, sizeof(this->entry));
-			src.read((char*)&this->phoff, sizeof(this->phoff));
-			src.read((char*)&this->shoff, sizeof(this->shoff));
-			src.read((char*)&this->flags, sizeof(this->flags));
-			src.read((char*)&this->ehsize, sizeof(this->ehsize));
-			src.read((char*)&this->phentsize, sizeof(this->phentsize));
-			src.read((char*)&this->phnum, sizeof(this->phnum));
-			src.read((char*)&this->shentsize, sizeof(this->shentsize));
-			src.read((char*)&this->shnum, sizeof(this->shnum));
-			src.read((char*)&this->shstrndx, sizeof(this->shstrndx));
+			src.readLE(this->type);
+			src.readLE(this->machine);
+			src.readLE(this->version);
+			src.readLE(this->entry);
+			src.readLE(this->phoff);
+			src.readLE(this->shoff);
+			src.readLE(this->flags);
+			src.readLE(this->ehsize);
+			src.readLE(this->phentsize);
+			src.readLE(this->phnum);
+			src.readLE(this->shentsize);
+			src.readLE(this->shnum);
+			src.readLE(this->shstrndx);
 			return *this;
 		}
 	};
@@ -253,18 +255,18 @@ struct Elf
 			return *this;
 		}
 
-		SectionHeader& deserialize(std::istream& src)
+		SectionHeader& deserialize(ImageCursor& src)
 		{
-			src.read((char*)&this->name, sizeof(this->name));
-			src.read((char*)&this->type, sizeof(this->type));
-			src.read((char*)&this->flags, sizeof(this->flags));
-			src.read((char*)&this->addr, sizeof(this->addr));
-			src.read((char*)&this->offset, sizeof(this->offset));
-			src.read((char*)&this->size, sizeof(this->size));
-			src.read((char*)&this->link, sizeof(this->link));
-			src.read((char*)&this->info, sizeof(this->info));
-			src.read((char*)&this->addralign, sizeof(this->addralign));
-			src.read((char*)&this->entsize, sizeof(this->entsize));
+			src.readLE(this->name);
+			src.readLE(this->type);
+			src.readLE(this->flags);
+			src.readLE(this->addr);
+			src.readLE(this->offset);
+			src.readLE(this->size);
+			src.readLE(this->link);
+			src.readLE(this->info);
+			src.readLE(this->addralign);
+			src.readLE(this->entsize);
 			return *this;
 		}
 	};
@@ -304,23 +306,23 @@ struct Elf
 			return *this;
 		}
 
-		ProgramHeader& deserialize(std::istream& src)
+		ProgramHeader& deserialize(ImageCursor& src)
 		{
-			src.read((char*)&this->type, sizeof(this->type));
+			src.readLE(this->type);
 
 			if (bitness == 64)
-				src.read((char*)&this->flags, sizeof(this->flags));
+				src.readLE(this->flags);
 
-			src.read((char*)&this->offset, sizeof(this->offset));
-			src.read((char*)&this->vaddr, sizeof(this->vaddr));
-			src.read((char*)&this->paddr, sizeof(this->paddr));
-			src.read((char*)&this->filesz, sizeof(this->filesz));
-			src.read((char*)&this->memsz, sizeof(this->memsz));
+			src.readLE(this->offset);
+			src.readLE(this->vaddr);
+			src.readLE(this->paddr);
+			src.readLE(this->filesz);
+			src.readLE(this->memsz);
 
 			if (bitness == 32)
-				src.read((char*)&this->flags, sizeof(this->flags));
+				src.readLE(this->flags);
 
-			src.read((char*)&this->align, sizeof(this->align));
+			src.readLE(this->align);
 
 			return *this;
 		}
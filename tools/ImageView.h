@@ -0,0 +1,257 @@
+#pragma once
+
+#include "Types.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//assembles integers byte by byte, so they work on any host and at any alignment
+template<typename T>
+T LoadLE(const byte* src)
+{
+	static_assert(std::is_integral<T>::value, "LoadLE only reads integers");
+	using U = typename std::make_unsigned<T>::type;
+	U val = 0;
+	for (size_t i=0; i<sizeof(T); i++)
+		val |= U(src[i]) << (8*i);
+
+	return T(val);
+}
+
+template<typename T>
+T LoadBE(const byte* src)
+{
+	static_assert(std::is_integral<T>::value, "LoadBE only reads integers");
+	using U = typename std::make_unsigned<T>::type;
+	U val = 0;
+	for (size_t i=0; i<sizeof(T); i++)
+		val = U(val << 8) | U(src[i]);
+
+	return T(val);
+}
+
+//Read-only view of a whole input file, mapped instead of read so big images aren't copied.
+//Every accessor takes a file offset and checks it against the file size, so offsets and
+//lengths that come out of the file itself can be passed straight in.
+class ImageView
+{
+public:
+	ImageView() {}
+	~ImageView() { Close(); }
+	ImageView(const ImageView&) = delete;
+	ImageView& operator=(const ImageView&) = delete;
+
+	//same return values as the tools use for file errors, 0 on success and -2 on failure
+	int Open(const char* fileType, const char* inputFilename, bool silent)
+	{
+		Close();
+#ifdef _WIN32
+		fileHandle = CreateFileA(inputFilename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (fileHandle == INVALID_HANDLE_VALUE)
+			return OpenFailed(fileType, inputFilename, silent);
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(fileHandle, &fileSize))
+			return MapFailed(fileType, inputFilename);
+
+		numBytes = (size_t)fileSize.QuadPart;
+		if (numBytes == 0) //can't map an empty file
+			return 0;
+
+		mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mappingHandle == nullptr)
+			return MapFailed(fileType, inputFilename);
+
+		base = (const byte*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		if (base == nullptr)
+			return MapFailed(fileType, inputFilename);
+#else
+		fileDesc = open(inputFilename, O_RDONLY);
+		if (fileDesc < 0)
+			return OpenFailed(fileType, inputFilename, silent);
+
+		struct stat fileStat;
+		if (fstat(fileDesc, &fileStat) != 0)
+			return MapFailed(fileType, inputFilename);
+
+		numBytes = (size_t)fileStat.st_size;
+		if (numBytes == 0) //can't map an empty file
+			return 0;
+
+		void* mapped = mmap(nullptr, numBytes, PROT_READ, MAP_PRIVATE, fileDesc, 0);
+		if (mapped == MAP_FAILED)
+			return MapFailed(fileType, inputFilename);
+
+		base = (const byte*)mapped;
+#endif
+		return 0;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (base != nullptr)
+			UnmapViewOfFile(base);
+		if (mappingHandle != nullptr)
+			CloseHandle(mappingHandle);
+		if (fileHandle != INVALID_HANDLE_VALUE)
+			CloseHandle(fileHandle);
+
+		mappingHandle = nullptr;
+		fileHandle = INVALID_HANDLE_VALUE;
+#else
+		if (base != nullptr)
+			munmap((void*)base, numBytes);
+		if (fileDesc >= 0)
+			close(fileDesc);
+
+		fileDesc = -1;
+#endif
+		base = nullptr;
+		numBytes = 0;
+	}
+
+	size_t size() const { return numBytes; }
+
+	bool Contains(u64 offset, u64 len) const { return offset <= numBytes && len <= numBytes - offset; }
+
+	//nullptr if any of the range is outside the file
+	const byte* Bytes(u64 offset, u64 len) const { return Contains(offset, len) ? base + offset : nullptr; }
+
+	template<typename T>
+	bool ReadLE(u64 offset, T& outVal) const
+	{
+		const byte* src = Bytes(offset, sizeof(T));
+		if (src == nullptr)
+			return false;
+
+		outVal = LoadLE<T>(src);
+		return true;
+	}
+
+	template<typename T>
+	bool ReadBE(u64 offset, T& outVal) const
+	{
+		const byte* src = Bytes(offset, sizeof(T));
+		if (src == nullptr)
+			return false;
+
+		outVal = LoadBE<T>(src);
+		return true;
+	}
+
+	//a zero terminated string that has to end within maxLen bytes and within the file
+	bool ReadString(u64 offset, size_t maxLen, string& outStr) const
+	{
+		if (!Contains(offset, 0))
+			return false;
+
+		const size_t avail = (size_t)std::min<u64>(maxLen, numBytes - offset);
+		const byte* src = base + offset;
+		const void* terminator = memchr(src, 0, avail);
+		if (terminator == nullptr)
+			return false;
+
+		outStr.assign((const char*)src, (const byte*)terminator - src);
+		return true;
+	}
+
+private:
+	static int OpenFailed(const char* fileType, const char* inputFilename, bool silent)
+	{
+		if (!silent)
+			fprintf(stderr, "Couldn't open %s file '%s' for reading\n", fileType, inputFilename);
+
+		return -2;
+	}
+
+	int MapFailed(const char* fileType, const char* inputFilename)
+	{
+		fprintf(stderr, "Error mapping %s file '%s' for reading\n", fileType, inputFilename);
+		Close();
+		return -2;
+	}
+
+	const byte* base = nullptr;
+	size_t numBytes = 0;
+#ifdef _WIN32
+	HANDLE fileHandle = INVALID_HANDLE_VALUE;
+	HANDLE mappingHandle = nullptr;
+#else
+	int fileDesc = -1;
+#endif
+};
+
+//Sequential reads from an ImageView, for headers that are deserialized field by field.
+//Like a stream, a read past the end of the file sets the fail flag and leaves the field zeroed.
+class ImageCursor
+{
+public:
+	ImageCursor(const ImageView& view, u64 offset) : view(view), pos(offset), failed(false) {}
+
+	u64 tell() const { return pos; }
+	ImageCursor& seek(u64 offset) { pos = offset; return *this; }
+	bool fail() const { return failed; }
+
+	ImageCursor& read(void* dst, size_t len)
+	{
+		const byte* src = view.Bytes(pos, len);
+		if (src != nullptr)
+			memcpy(dst, src, len);
+		else
+		{
+			memset(dst, 0, len);
+			failed = true;
+		}
+
+		pos += len;
+		return *this;
+	}
+
+	template<typename T>
+	ImageCursor& readLE(T& outVal)
+	{
+		if (!view.ReadLE(pos, outVal))
+		{
+			outVal = 0;
+			failed = true;
+		}
+
+		pos += sizeof(T);
+		return *this;
+	}
+
+	template<typename T>
+	ImageCursor& readBE(T& outVal)
+	{
+		if (!view.ReadBE(pos, outVal))
+		{
+			outVal = 0;
+			failed = true;
+		}
+
+		pos += sizeof(T);
+		return *this;
+	}
+
+private:
+	const ImageView& view;
+	u64 pos;
+	bool failed;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Types.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+//calls func for every index below count, on up to numThreads threads that each take the next free index
+template<typename Func>
+void ParallelFor(size_t count, unsigned int numThreads, Func func)
+{
+	std::atomic<size_t> nextIdx(0);
+	auto worker = [&]() {
+		for (size_t i=nextIdx++; i<count; i=nextIdx++)
+			func(i);
+	};
+
+	vector<std::thread> threads;
+	for (size_t i=1; i<std::min<size_t>(numThreads, count); i++)
+		threads.emplace_back(worker);
+
+	worker();
+	for (auto& thread : threads)
+		thread.join();
+}
\ No newline at end of file
@@ -57,72 +57,108 @@ static void BLZ_Invert(u8 *buffer, int length)
 }
 
 /*----------------------------------------------------------------------------*/
-ByteVector BLZ_Code(u8* raw_buffer, unsigned int raw_len, bool best)
+#define BLZ_HASH_BITS 16
+
+struct BLZ_Token
 {
-	u8 *pak_buffer, *pak, *raw, *raw_end, *flg = nullptr;
-	u32   pak_len, inc_len, hdr_len, enc_len, len, pos, max;
-	u32   len_best, pos_best = 0, len_next, pos_next, len_post, pos_post;
-	u32   pak_tmp, raw_tmp;
-	u8  mask;
+	u32 len; // BLZ_THRESHOLD or less for a literal
+	u32 pos;
+};
+
+// Hash chains over the 3 byte prefix every match needs, so only earlier positions that
+// can actually match get compared. A chain goes from the nearest position outwards, the
+// same order the old brute force search tried them in, and the first longest match wins
+// just like it did, so the output doesn't change. Works on the inverted buffer.
+class BLZ_MatchFinder
+{
+public:
+	BLZ_MatchFinder(const u8* buffer, u32 length)
+		: raw_buffer(buffer), raw_len(length), head(1u << BLZ_HASH_BITS, -1), prev(length, -1) {}
 
-#define SEARCH(l,p) { \
-  l = BLZ_THRESHOLD;                                             \
-                                                                 \
-  max = (raw-raw_buffer >= BLZ_N) ? BLZ_N : u32(raw-raw_buffer); \
-  for (pos = 3; pos <= max; pos++) {                             \
-    for (len = 0; len < BLZ_F; len++) {                          \
-      if (raw + len == raw_end) break;                           \
-      if (len >= pos) break;                                     \
-      if (*(raw + len) != *(raw + len - pos)) break;             \
-    }                                                            \
-                                                                 \
-    if (len > l) {                                               \
-      p = pos;                                                   \
-      if ((l = len) == BLZ_F) break;                             \
-    }                                                            \
-  }                                                              \
-}
+	// longest match at cur and its lowest distance, len_best stays BLZ_THRESHOLD if there's none
+	void Search(u32 cur, u32& len_best, u32& pos_best)
+	{
+		len_best = BLZ_THRESHOLD;
+		if (raw_len - cur <= BLZ_THRESHOLD)
+			return;
 
-	pak_tmp = 0;
-	raw_tmp = raw_len;
+		// a match has to start at least 3 bytes back, earlier searches may have inserted closer ones
+		for (; inserted + 3 <= cur; inserted++)
+		{
+			s32& chainHead = head[Hash(raw_buffer + inserted)];
+			prev[inserted] = chainHead;
+			chainHead = s32(inserted);
+		}
 
-	pak_len = raw_len + ((raw_len + 7) / 8) + 15;
-	ByteVector outBuf(pak_len, 0);
-	if (outBuf.size() > 0)
-		pak_buffer = &outBuf[0];
-	else
-		pak_buffer = nullptr;
+		const u8* raw = raw_buffer + cur;
+		const u32 max = (cur >= BLZ_N) ? BLZ_N : cur;
+		const u32 len_avail = (raw_len - cur < BLZ_F) ? raw_len - cur : BLZ_F;
+		for (s32 cand = head[Hash(raw)]; cand >= 0; cand = prev[cand])
+		{
+			if (u32(cand) + 3 > cur)
+				continue;
 
-	BLZ_Invert(raw_buffer, raw_len);
+			const u32 pos = cur - u32(cand);
+			if (pos > max)
+				break;
 
-	pak = pak_buffer;
-	raw = raw_buffer;
-	raw_end = raw_buffer + raw_len;
+			const u32 len_max = (len_avail < pos) ? len_avail : pos;
+			if (len_max <= len_best)
+				continue;
 
-	mask = 0;
+			// can't beat the best so far unless it also matches one byte further
+			const u8* match = raw - pos;
+			if (raw[len_best] != match[len_best])
+				continue;
 
-	while (raw < raw_end)
-	{
-		if (!(mask >>= BLZ_SHIFT))
-		{
-			*(flg = pak++) = 0;
-			mask = BLZ_MASK;
+			u32 len = 0;
+			while (len < len_max && raw[len] == match[len])
+				len++;
+
+			if (len > len_best)
+			{
+				len_best = len;
+				pos_best = pos;
+				if (len == BLZ_F)
+					break;
+			}
 		}
+	}
+
+private:
+	static u32 Hash(const u8* p)
+	{
+		return ((u32(p[0]) << 16 | u32(p[1]) << 8 | p[2]) * 2654435761u) >> (32 - BLZ_HASH_BITS);
+	}
+
+	const u8* raw_buffer;
+	u32 raw_len;
+	u32 inserted = 0;
+	vector<s32> head;
+	vector<s32> prev;
+};
+
+/*----------------------------------------------------------------------------*/
+// Greedy longest match, with the LZ-CUE lookahead in best mode
+static vector<BLZ_Token> BLZ_ParseGreedy(const u8* raw_buffer, u32 raw_len, bool best)
+{
+	BLZ_MatchFinder finder(raw_buffer, raw_len);
+	vector<BLZ_Token> tokens;
+	u32 len_best, pos_best = 0, len_next, pos_next, len_post, pos_post;
 
-		SEARCH(len_best, pos_best);
+	for (u32 raw = 0; raw < raw_len;)
+	{
+		finder.Search(raw, len_best, pos_best);
 
 		// LZ-CUE optimization start
 		if (best)
 		{
 			if (len_best > BLZ_THRESHOLD)
 			{
-				if (raw + len_best < raw_end)
+				if (raw + len_best < raw_len)
 				{
-					raw += len_best;
-					SEARCH(len_next, pos_next);
-					raw -= len_best - 1;
-					SEARCH(len_post, pos_post);
-					raw--;
+					finder.Search(raw + len_best, len_next, pos_next);
+					finder.Search(raw + 1, len_post, pos_post);
 
 					if (len_next <= BLZ_THRESHOLD) len_next = 1;
 					if (len_post <= BLZ_THRESHOLD) len_post = 1;
@@ -133,28 +169,101 @@ ByteVector BLZ_Code(u8* raw_buffer, unsigned int raw_len, bool best)
 		}
 		// LZ-CUE optimization end
 
-		*flg <<= 1;
 		if (len_best > BLZ_THRESHOLD)
 		{
+			tokens.push_back({ len_best, pos_best });
 			raw += len_best;
+		}
+		else
+		{
+			tokens.push_back({ 1, 0 });
+			raw++;
+		}
+	}
+
+	return tokens;
+}
+
+// Fewest bits overall: a literal costs 9 (with its flag) and any match 17, and a match
+// can be cut short at the same distance, so a shortest path from the end finds the best split.
+static vector<BLZ_Token> BLZ_ParseOptimal(const u8* raw_buffer, u32 raw_len)
+{
+	BLZ_MatchFinder finder(raw_buffer, raw_len);
+	vector<BLZ_Token> longest(raw_len);
+	for (u32 raw = 0; raw < raw_len; raw++)
+		finder.Search(raw, longest[raw].len, longest[raw].pos);
+
+	vector<u32> cost(raw_len + 1, 0);
+	vector<u32> step(raw_len, 1);
+	for (u32 raw = raw_len; raw-- > 0;)
+	{
+		cost[raw] = cost[raw + 1] + 9;
+		for (u32 len = BLZ_THRESHOLD + 1; len <= longest[raw].len; len++)
+		{
+			if (cost[raw + len] + 17 < cost[raw])
+			{
+				cost[raw] = cost[raw + len] + 17;
+				step[raw] = len;
+			}
+		}
+	}
+
+	vector<BLZ_Token> tokens;
+	for (u32 raw = 0; raw < raw_len; raw += step[raw])
+		tokens.push_back({ step[raw], longest[raw].pos });
+
+	return tokens;
+}
+
+/*----------------------------------------------------------------------------*/
+// raw_buffer is the original (not inverted) data, the tokens walk it from the end
+static ByteVector BLZ_Pack(const u8* raw_buffer, u32 raw_len, const vector<BLZ_Token>& tokens)
+{
+	u8 *pak_buffer, *pak, *flg = nullptr;
+	u32   pak_len, inc_len, hdr_len, enc_len, len, done;
+	u32   pak_tmp, raw_tmp;
+	u8  mask;
+
+	pak_tmp = 0;
+	raw_tmp = raw_len;
+
+	pak_len = raw_len + ((raw_len + 7) / 8) + 15;
+	ByteVector outBuf(pak_len, 0);
+	pak_buffer = &outBuf[0];
+
+	pak = pak_buffer;
+	done = 0;
+
+	mask = 0;
+
+	for (const BLZ_Token& token : tokens)
+	{
+		if (!(mask >>= BLZ_SHIFT))
+		{
+			*(flg = pak++) = 0;
+			mask = BLZ_MASK;
+		}
+
+		*flg <<= 1;
+		if (token.len > BLZ_THRESHOLD)
+		{
+			done += token.len;
 			*flg |= 1;
-			*pak++ = ((len_best - (BLZ_THRESHOLD+1)) << 4) | ((pos_best - 3) >> 8);
-			*pak++ = (pos_best - 3) & 0xFF;
+			*pak++ = ((token.len - (BLZ_THRESHOLD+1)) << 4) | ((token.pos - 3) >> 8);
+			*pak++ = (token.pos - 3) & 0xFF;
 		}
 		else
 		{
-			*pak++ = *raw++;
+			*pak++ = raw_buffer[raw_len - 1 - done++];
 		}
 
-		if ((pak - pak_buffer + raw_len - (raw - raw_buffer)) < (pak_tmp + raw_tmp))
+		if ((pak - pak_buffer + raw_len - done) < (pak_tmp + raw_tmp))
 		{
 			pak_tmp = u32(pak - pak_buffer);
-			raw_tmp = raw_len - u32(raw - raw_buffer);
+			raw_tmp = raw_len - done;
 		}
 	}
 
-#undef SEARCH
-
 	while (mask && (mask != 1))
 	{
 		mask >>= BLZ_SHIFT;
@@ -163,16 +272,13 @@ ByteVector BLZ_Code(u8* raw_buffer, unsigned int raw_len, bool best)
 
 	pak_len = u32(pak - pak_buffer);
 
-	BLZ_Invert(raw_buffer, raw_len);
 	BLZ_Invert(pak_buffer, pak_len);
 
 	if (!pak_tmp || (raw_len + 4 < ((pak_tmp + raw_tmp + 3) & -4) + 8))
 	{
 		pak = pak_buffer;
-		raw = raw_buffer;
-		raw_end = raw_buffer + raw_len;
-
-		while (raw < raw_end) *pak++ = *raw++;
+		for (len = 0; len < raw_len; len++)
+			*pak++ = raw_buffer[len];
 
 		while ((pak - pak_buffer) & 3) *pak++ = 0;
 
@@ -215,4 +321,27 @@ ByteVector BLZ_Code(u8* raw_buffer, unsigned int raw_len, bool best)
 	outBuf.resize(new_len, 0);
 
 	return outBuf;
-}
\ No newline at end of file
+}
+
+/*----------------------------------------------------------------------------*/
+ByteVector BLZ_Code(u8* raw_buffer, unsigned int raw_len, bool best)
+{
+	// matches are searched for back to front
+	BLZ_Invert(raw_buffer, raw_len);
+	const vector<BLZ_Token> greedy = BLZ_ParseGreedy(raw_buffer, raw_len, best);
+	vector<BLZ_Token> optimal;
+	if (best)
+		optimal = BLZ_ParseOptimal(raw_buffer, raw_len);
+	BLZ_Invert(raw_buffer, raw_len);
+
+	ByteVector outBuf = BLZ_Pack(raw_buffer, raw_len, greedy);
+	if (best)
+	{
+		// fewer bits doesn't always mean a smaller file, the stored prefix can make up for it
+		ByteVector optimalBuf = BLZ_Pack(raw_buffer, raw_len, optimal);
+		if (optimalBuf.size() < outBuf.size())
+			outBuf = std::move(optimalBuf);
+	}
+
+	return outBuf;
+}
@@ -1,40 +1,14 @@
 #include "Types.h"
 #include "ScopeGuard.h"
 #include "RelPath.h"
+#include "ImageView.h"
+#include "inplace.h"
+#include "compress.h"
+#include "ParallelFor.h"
 #include <cassert>
 #include <cstdio>
 #include <fstream>
-#include <iostream>
-
-static int ReadFileToBuf(ByteVector& outBuf, const char* fileType, const char* inputFilename, bool silent)
-{
-	std::ifstream inputFile(inputFilename, std::ios::binary);
-	if (!inputFile.is_open())
-	{
-		if (!silent)
-			fprintf(stderr, "Couldn't open %s file '%s' for reading\n", fileType, inputFilename);
-
-		return -2;
-	}
-
-	inputFile.seekg(0, std::ios::end);
-	const auto inputSize = inputFile.tellg();
-	inputFile.seekg(0, std::ios::beg);
-
-	outBuf.resize((size_t)inputSize);
-	if (outBuf.size() > 0)
-	{
-		inputFile.read((char*)&outBuf[0], outBuf.size());
-		const auto bytesRead = inputFile.gcount();
-		if (bytesRead < inputSize)
-		{
-			fprintf(stderr, "Error reading %s file '%s' (only %llu out of %llu bytes read)\n", fileType, inputFilename, (u64)bytesRead, (u64)inputSize);
-			return -2;
-		}
-	}
-
-	return 0;
-};
+#include <set>
 
 static const size_t FMAP_NAMELEN = 32;
 static const char FMAP_SIGNATURE[] = "__FMAP__";
@@ -42,9 +16,13 @@ static const size_t FMAP_SIGNATURE_SIZE = 8;
 static const size_t FMAP_SEARCH_STRIDE = 4;
 static const uint8_t FMAP_VER_MAJOR = 1;
 
-#pragma pack(push, 1)
+//the headers below are read field by field out of the rom, SIZE is how many bytes each takes up in it
+
+//in little endian
 struct FmapHeader 
 {
+	static const size_t SIZE = 56;
+
 	char        fmap_signature[FMAP_SIGNATURE_SIZE];
 	uint8_t     fmap_ver_major;
 	uint8_t     fmap_ver_minor;
@@ -55,31 +33,58 @@ struct FmapHeader
 
 	struct FmapAreaHeader
 	{
+		static const size_t SIZE = 42;
+
 		uint32_t area_offset;
 		uint32_t area_size;
 		char     area_name[FMAP_NAMELEN];
 		uint16_t area_flags;
+
+		bool read(const ImageView& img, u64 fileOffset)
+		{
+			ImageCursor src(img, fileOffset);
+			src.readLE(area_offset).readLE(area_size).read(area_name, sizeof(area_name)).readLE(area_flags);
+			area_name[FMAP_NAMELEN-1] = 0; //names are at most 31 chars, don't trust the file on that
+			assert(src.tell() == fileOffset + SIZE);
+			return !src.fail();
+		}
 	};
 
-	static int is_fmap(const void* ptr)
+	bool read(const ImageView& img, u64 fileOffset)
 	{
-		auto fmap_header = (const FmapHeader *)ptr;
+		ImageCursor src(img, fileOffset);
+		src.read(fmap_signature, sizeof(fmap_signature)).read(&fmap_ver_major, 1).read(&fmap_ver_minor, 1);
+		src.readLE(fmap_base).readLE(fmap_size).read(fmap_name, sizeof(fmap_name)).readLE(fmap_nareas);
+		fmap_name[FMAP_NAMELEN-1] = 0;
+		assert(src.tell() == fileOffset + SIZE);
+		return !src.fail();
+	}
 
-		if (0 != memcmp(ptr, FMAP_SIGNATURE, FMAP_SIGNATURE_SIZE))
+	static int is_fmap(const ImageView& img, u64 fileOffset)
+	{
+		const byte* bytePtr = img.Bytes(fileOffset, FmapHeader::SIZE);
+		if (bytePtr == nullptr || 0 != memcmp(bytePtr, FMAP_SIGNATURE, FMAP_SIGNATURE_SIZE))
 			return 0;
 
-		if (fmap_header->fmap_ver_major == FMAP_VER_MAJOR)
+		const uint8_t fmap_ver_major = bytePtr[FMAP_SIGNATURE_SIZE];
+		if (fmap_ver_major == FMAP_VER_MAJOR)
 			return 1;
 
-		fprintf(stderr, "Found FMAP, but major version is %u instead of %u\n", fmap_header->fmap_ver_major, FMAP_VER_MAJOR);
+		fprintf(stderr, "Found FMAP, but major version is %u instead of %u\n", fmap_ver_major, FMAP_VER_MAJOR);
 		return 0;
 	}
 
-	static const FmapHeader* fmap_find(const void* ptr, size_t size)
+	static bool fmap_find(const ImageView& img, u64& outOffset)
 	{
-		const size_t lim = size - sizeof(FmapHeader);
-		if (lim >= 0 && is_fmap(ptr))
-			return (const FmapHeader*)ptr;
+		if (img.size() < SIZE)
+			return false;
+
+		const size_t lim = img.size() - SIZE;
+		if (is_fmap(img, 0))
+		{
+			outOffset = 0;
+			return true;
+		}
 
 		size_t align;
 		for (align = FMAP_SEARCH_STRIDE; align <= lim; align *= 2);
@@ -87,13 +92,15 @@ struct FmapHeader
 		{
 			for (size_t offset=align; offset<=lim; offset+=align*2)
 			{
-				const uint8_t* bytePtr = (const uint8_t*)(ptr)+offset;
-				if (is_fmap(bytePtr))
-					return (const FmapHeader *)(bytePtr);
+				if (is_fmap(img, offset))
+				{
+					outOffset = offset;
+					return true;
+				}
 			}
 		}
 
-		return nullptr;
+		return false;
 	}
 };
 
@@ -102,6 +109,8 @@ static const char HEADER_MAGIC[] = "ORBC";
 //in big endian
 struct cbheader 
 {
+	static const size_t SIZE = 32;
+
 	u32 magic;
 	u32 version;
 	u32 romsize;
@@ -111,17 +120,14 @@ struct cbheader
 	u32 architecture;
 	u32 pad[1];
 
-	cbheader& fromBigEndian(const cbheader* cbHeaderPtr)
+	bool read(const ImageView& img, u64 fileOffset)
 	{
-		magic = cbHeaderPtr->magic;
-		version = cbHeaderPtr->version;
-		romsize = _byteswap_ulong(cbHeaderPtr->romsize);
-		bootblocksize = _byteswap_ulong(cbHeaderPtr->bootblocksize);
-		align = _byteswap_ulong(cbHeaderPtr->align);
-		offset = _byteswap_ulong(cbHeaderPtr->offset);
-		architecture = _byteswap_ulong(cbHeaderPtr->architecture);
-
-		return *this;
+		ImageCursor src(img, fileOffset);
+		src.read(&magic, sizeof(magic)).read(&version, sizeof(version));
+		src.readBE(romsize).readBE(bootblocksize).readBE(align).readBE(offset).readBE(architecture);
+		src.read(pad, sizeof(pad));
+		assert(src.tell() == fileOffset + SIZE);
+		return !src.fail();
 	}
 };
 
@@ -140,37 +146,47 @@ enum ComponentType
 	COMPONENT_NULL = -1
 };
 
-//in big endian
+//in big endian, followed by the zero terminated filename which ends before offset
 struct cbfile 
 {
+	static const size_t SIZE = 24;
+
 	u64 magic;
 	u32 len;
 	u32 type;
 	u32 tagsoffset;
 	u32 offset;
-	char filename[0];
 
-	cbfile& fromBigEndian(const cbfile* cbFilePtr)
+	bool read(const ImageView& img, u64 fileOffset)
 	{
-		magic = cbFilePtr->magic;
-		len = _byteswap_ulong(cbFilePtr->len);
-		type = _byteswap_ulong(cbFilePtr->type);
-		tagsoffset = _byteswap_ulong(cbFilePtr->tagsoffset);
-		offset = _byteswap_ulong(cbFilePtr->offset);
-
-		return *this;
+		ImageCursor src(img, fileOffset);
+		src.read(&magic, sizeof(magic)).readBE(len).readBE(type).readBE(tagsoffset).readBE(offset);
+		assert(src.tell() == fileOffset + SIZE);
+		return !src.fail();
 	}
 };
 
+//in little endian
 struct cbfs_stage
 {
+	static const size_t SIZE = 28;
+
 	u32 compression;
 	u64 entry;
 	u64 load;
 	u32 len;
 	u32 memlen;
+
+	bool read(const ImageView& img, u64 fileOffset)
+	{
+		ImageCursor src(img, fileOffset);
+		src.readLE(compression).readLE(entry).readLE(load).readLE(len).readLE(memlen);
+		assert(src.tell() == fileOffset + SIZE);
+		return !src.fail();
+	}
 };
 
+//four characters in file order, so they're compared as little endian
 enum SegmentType
 {
 	PAYLOAD_SEGMENT_CODE = 0x45444F43,
@@ -180,9 +196,11 @@ enum SegmentType
 	PAYLOAD_SEGMENT_ENTRY = 0x52544E45
 };
 
-// in big endian
+// in big endian, except for the type
 struct cbfs_payload_segment 
 {
+	static const size_t SIZE = 28;
+
 	u32 type;
 	u32 compression;
 	u32 offset;
@@ -190,26 +208,74 @@ struct cbfs_payload_segment
 	u32 len;
 	u32 mem_len;
 
-	cbfs_payload_segment& fromBigEndian(const cbfs_payload_segment* payloadPtr)
+	bool read(const ImageView& img, u64 fileOffset)
+	{
+		ImageCursor src(img, fileOffset);
+		src.readLE(type).readBE(compression).readBE(offset).readBE(load_addr).readBE(len).readBE(mem_len);
+		assert(src.tell() == fileOffset + SIZE);
+		return !src.fail();
+	}
+
+	string typeName() const
+	{
+		const char chars[] = { char(type), char(type >> 8), char(type >> 16), char(type >> 24) };
+		return string(chars, sizeof(chars));
+	}
+};
+
+//How long the firmware takes to get a section into memory. A LOAD reads a chunk off the card and
+//decodes it before reading the next one, so card time and decode time add up.
+struct LoadCostModel
+{
+	//in MB/s, the decoder speeds counting decompressed bytes on the BPMP
+	double sdSpeed = 40.0;
+	double lzmaSpeed = 5.0;
+	double lz4Speed = 100.0;
+
+	double Seconds(u32 compType, size_t storedLen, size_t decompLen) const
 	{
-		type = payloadPtr->type;
-		compression = _byteswap_ulong(payloadPtr->compression);
-		offset = _byteswap_ulong(payloadPtr->offset);
-		load_addr = _byteswap_uint64(payloadPtr->load_addr);
-		len = _byteswap_ulong(payloadPtr->len);
-		mem_len = _byteswap_ulong(payloadPtr->mem_len);
-
-		return *this;
+		const double MB = 1024.0 * 1024.0;
+		double secs = storedLen / (sdSpeed * MB);
+		if (compType == 1)
+			secs += decompLen / (lzmaSpeed * MB);
+		else if (compType == 2)
+			secs += decompLen / (lz4Speed * MB);
+
+		return secs;
 	}
 };
 
-#pragma pack(pop)
+static const char* CompTypeName(u32 compType)
+{
+	if (compType == 1)
+		return "lzma";
+	else if (compType == 2)
+		return "lz4";
+
+	return "raw";
+}
+
+//section names become filenames, so anything but letters, digits, '.', '-' and '_' is replaced
+static string SidecarFilename(const string& sectName, u32 compType)
+{
+	string filename = sectName;
+	for (auto& c : filename)
+	{
+		if (!isalnum((unsigned char)c) && c != '.' && c != '-' && c != '_')
+			c = '_';
+	}
+
+	return filename + "." + CompTypeName(compType);
+}
 
 int main(int argc, char* argv[])
 {
 	auto PrintUsage = []() -> int
 	{
-		fprintf(stderr, "Usage: cbfs2ini.exe (--add-section=FMAP)* (--skip-section=BIOS)* (--add-archive=*)* (--skip-archive=fallback/romstage)* --load-addr=0x80000000 [--boot=fallback/ramstage] coreboot.rom\n");
+		fprintf(stderr, "Usage: cbfs2ini.exe (--add-section=FMAP)* (--skip-section=BIOS)* (--add-archive=*)* (--skip-archive=fallback/romstage)* --load-addr=0x80000000 [--boot=fallback/ramstage] [--in-place] [--compress=outdir [--threads=N] [--sd-speed=40] [--lz4-speed=100] [--lzma-speed=5]] coreboot.rom\n");
+		fprintf(stderr, "\t--in-place loads compressed boot stages at the end of their destination and decompresses them there\n");
+		fprintf(stderr, "\t--compress writes every loaded section to outdir as lz4 or lzma if that loads it faster, judged from\n");
+		fprintf(stderr, "\t           the card speed and the decompression speeds (in MB/s of output), using N threads\n");
 		return -1;
 	};
 
@@ -225,11 +291,20 @@ int main(int argc, char* argv[])
 	const char* bootArchiveName = nullptr;
 	const char* cbfsFilename = nullptr;
 	const char* outputFilename = nullptr;
+	bool inPlace = false;
+	const char* compressDir = nullptr;
+	unsigned int numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	LoadCostModel costModel;
 
 	const char HEXA_PREFIX[] = "0x";
 	for (int argIdx=1; argIdx<argc; argIdx++)
 	{
 		char* currArg = argv[argIdx];
+		if (stricmp(currArg, "--in-place") == 0)
+		{
+			inPlace = true;
+			continue;
+		}
 
 		enum ArgType
 		{
@@ -240,9 +315,14 @@ int main(int argc, char* argv[])
 			ARG_BOOT,
 			ARG_OUTPUT,
 			ARG_LOADADDRESS,
+			ARG_COMPRESS,
+			ARG_THREADS,
+			ARG_SDSPEED,
+			ARG_LZ4SPEED,
+			ARG_LZMASPEED,
 			ARGTYPE_COUNT
 		};
-		const char* TEXT_ARGUMENTS[] ={ "--add-section", "--skip-section", "--add-archive", "--skip-archive", "--boot", "--out", "--load-addr" };
+		const char* TEXT_ARGUMENTS[] ={ "--add-section", "--skip-section", "--add-archive", "--skip-archive", "--boot", "--out", "--load-addr", "--compress", "--threads", "--sd-speed", "--lz4-speed", "--lzma-speed" };
 		static_assert(array_countof(TEXT_ARGUMENTS) == ARGTYPE_COUNT, "TEXT_ARGUMENTS size mismatch vs enum");
 
 		size_t argType;
@@ -293,6 +373,35 @@ int main(int argc, char* argv[])
 					return PrintUsage();
 				}
 			}
+			else if (argType == ARG_COMPRESS)
+				compressDir = theValueStr;
+			else if (argType == ARG_THREADS)
+			{
+				char* matchedEnd = nullptr;
+				numThreads = strtoul(theValueStr, &matchedEnd, 10);
+				if (matchedEnd == theValueStr || *matchedEnd != 0 || numThreads == 0)
+				{
+					fprintf(stderr, "Invalid thread count '%s'\n", theValueStr);
+					return PrintUsage();
+				}
+			}
+			else if (argType == ARG_SDSPEED || argType == ARG_LZ4SPEED || argType == ARG_LZMASPEED)
+			{
+				char* matchedEnd = nullptr;
+				const double speed = strtod(theValueStr, &matchedEnd);
+				if (matchedEnd == theValueStr || *matchedEnd != 0 || !(speed > 0))
+				{
+					fprintf(stderr, "Invalid speed '%s', must be a positive number of MB/s\n", theValueStr);
+					return PrintUsage();
+				}
+
+				if (argType == ARG_SDSPEED)
+					costModel.sdSpeed = speed;
+				else if (argType == ARG_LZ4SPEED)
+					costModel.lz4Speed = speed;
+				else
+					costModel.lzmaSpeed = speed;
+			}
 
 			break;
 		}
@@ -326,9 +435,9 @@ int main(int argc, char* argv[])
 		return PrintUsage();
 	}	
 
-	ByteVector fileBuf;
-	int retVal = ReadFileToBuf(fileBuf, "cbrom", cbfsFilename, false);
-	if (retVal != 0 || fileBuf.size() == 0)
+	ImageView romImage;
+	int retVal = romImage.Open("cbrom", cbfsFilename, false);
+	if (retVal != 0 || romImage.size() == 0)
 		return retVal;
 
 	FILE* outputFile = nullptr;
@@ -361,111 +470,262 @@ int main(int argc, char* argv[])
 		cbfsFilename = newRelativeFilename.c_str();
 	}
 
-	auto fmapPtr = FmapHeader::fmap_find(&fileBuf[0], fileBuf.size());
-	if (fmapPtr == nullptr && addSections.size() > 0)
+	//the plain LOADs out of the rom are only written once all of them are known, so that
+	//--compress can work on every section at the same time
+	struct RomLoad
+	{
+		string sectName;
+		u64 skip;
+		u64 count;
+		u64 dst;
+	};
+	vector<RomLoad> romLoads;
+	auto WriteRomLoads = [&]() -> bool
+	{
+		namespace fs=boost::filesystem;
+
+		vector<u32> compTypes(romLoads.size(), 0);
+		vector<ByteVector> compData(romLoads.size());
+		vector<string> logs(romLoads.size());
+		vector<bool> failed(romLoads.size(), false);
+		if (compressDir != nullptr)
+		{
+			ParallelFor(romLoads.size(), numThreads, [&](size_t idx) {
+				const RomLoad& load = romLoads[idx];
+				if (load.count == 0) //that loads the whole rom, leave it as it is
+					return;
+
+				//past the end of the rom the LOAD fills with zeroes, so those get compressed too
+				ByteVector srcData((size_t)load.count, 0);
+				if (load.skip < romImage.size())
+				{
+					const size_t avail = (size_t)std::min<u64>(load.count, romImage.size() - load.skip);
+					memcpy(srcData.data(), romImage.Bytes(load.skip, avail), avail);
+				}
+
+				char logLine[128];
+				double bestSecs = costModel.Seconds(0, srcData.size(), srcData.size());
+				snprintf(logLine, sizeof(logLine), "\t%s: raw 0x%08zx bytes %.2fms", load.sectName.c_str(), srcData.size(), bestSecs*1000);
+				logs[idx] = logLine;
+
+				for (const u32 compType : { 2u, 1u })
+				{
+					//decoded back the way the firmware will, so a bad stream never makes it into the ini
+					ByteVector packedData;
+					u32 margin = 0;
+					u32 decompLen = 0;
+					if (!CompressSection(compType, srcData.data(), srcData.size(), packedData) ||
+						!ComputeInPlaceMargin(compType, packedData.data(), packedData.size(), margin, decompLen) ||
+						decompLen != srcData.size())
+					{
+						logs[idx] += string(", ") + CompTypeName(compType) + " FAILED\n";
+						failed[idx] = true;
+						return;
+					}
+
+					const double secs = costModel.Seconds(compType, packedData.size(), srcData.size());
+					snprintf(logLine, sizeof(logLine), ", %s 0x%08zx bytes %.2fms", CompTypeName(compType), packedData.size(), secs*1000);
+					logs[idx] += logLine;
+					if (secs < bestSecs)
+					{
+						bestSecs = secs;
+						compTypes[idx] = compType;
+						compData[idx] = std::move(packedData);
+					}
+				}
+				logs[idx] += string(", using ") + CompTypeName(compTypes[idx]) + "\n";
+			});
+
+			boost::system::error_code err;
+			fs::create_directories(compressDir, err);
+			if (err)
+			{
+				fprintf(stderr, "Couldn't create output directory '%s': %s\n", compressDir, err.message().c_str());
+				return false;
+			}
+		}
+
+		std::set<string> usedFilenames;
+		for (size_t idx=0; idx<romLoads.size(); idx++)
+		{
+			const RomLoad& load = romLoads[idx];
+			fprintf(stderr, "%s", logs[idx].c_str());
+			if (failed[idx])
+				return false;
+
+			if (compTypes[idx] == 0)
+			{
+				fprintf(outputFile, "[load:%s]\n", load.sectName.c_str());
+				fprintf(outputFile, "if=%s\n", cbfsFilename);
+				fprintf(outputFile, "skip=0x%08llx\n", load.skip);
+				fprintf(outputFile, "count=0x%08llx\n", load.count);
+				fprintf(outputFile, "dst=0x%08llx\n", load.dst);
+				fprintf(outputFile, "\n");
+				fflush(outputFile);
+				continue;
+			}
+
+			string sidecarFilename = SidecarFilename(load.sectName, compTypes[idx]);
+			if (!usedFilenames.insert(sidecarFilename).second) //cbfs names can repeat
+			{
+				sidecarFilename = std::to_string(idx) + "_" + sidecarFilename;
+				usedFilenames.insert(sidecarFilename);
+			}
+
+			const string sidecarPath = (fs::path(compressDir) / sidecarFilename).string();
+			std::ofstream sidecarFile(sidecarPath, std::ios::binary);
+			sidecarFile.write((const char*)compData[idx].data(), compData[idx].size());
+			sidecarFile.close();
+			if (sidecarFile.fail())
+			{
+				fprintf(stderr, "Error writing compressed section file '%s'\n", sidecarPath.c_str());
+				return false;
+			}
+
+			const string sidecarName = (outputFile != stdout) ? GetRelativePath(sidecarPath.c_str(), outputFilename) : sidecarPath;
+			fprintf(outputFile, "[load:%s]\n", load.sectName.c_str());
+			fprintf(outputFile, "if=%s\n", sidecarName.c_str());
+			fprintf(outputFile, "type=%d\n", compTypes[idx]);
+			fprintf(outputFile, "skip=0x%08x\n", 0);
+			fprintf(outputFile, "count=0x%08zx\n", compData[idx].size());
+			fprintf(outputFile, "dst=0x%08llx\n", load.dst);
+			fprintf(outputFile, "dstlen=0x%08llx\n", load.count);
+			fprintf(outputFile, "\n");
+			fflush(outputFile);
+		}
+
+		romLoads.clear();
+		return true;
+	};
+
+	FmapHeader fmap;
+	u64 fmapOffset = 0;
+	const bool fmapFound = FmapHeader::fmap_find(romImage, fmapOffset) && fmap.read(romImage, fmapOffset);
+	if (!fmapFound && addSections.size() > 0)
 	{
 		fprintf(stderr, "No FMAP found but we need to load sections, exiting\n");
 		return -3;
 	}
-	else if (fmapPtr != nullptr)
+	else if (fmapFound)
 	{
 		fprintf(stderr, "Found FMAP ver %u.%u at 0x%08llx, base: 0x%08llx size: 0x%08x\n",
-			(u32)fmapPtr->fmap_ver_major, (u32)fmapPtr->fmap_ver_minor, (u64)fmapPtr, fmapPtr->fmap_base, fmapPtr->fmap_size);
+			(u32)fmap.fmap_ver_major, (u32)fmap.fmap_ver_minor, fmapOffset, (u64)fmap.fmap_base, fmap.fmap_size);
 
-		auto areas = reinterpret_cast<const FmapHeader::FmapAreaHeader*>((const u8*)(fmapPtr)+sizeof(FmapHeader));
 		const bool wildcardEnabled = FindInVectByName(addSections, "*") != addSections.cend();
-		for (decltype(fmapPtr->fmap_nareas) i=0; i<fmapPtr->fmap_nareas; i++)
+		for (decltype(fmap.fmap_nareas) i=0; i<fmap.fmap_nareas; i++)
 		{
-			const FmapHeader::FmapAreaHeader* currArea = &areas[i];
-			fprintf(stderr, "\t%s @0x%08x size 0x%08x bytes: ", currArea->area_name, currArea->area_offset, currArea->area_size);
-			if (!wildcardEnabled && FindInVectByName(addSections, currArea->area_name) == addSections.cend())
+			FmapHeader::FmapAreaHeader currArea;
+			if (!currArea.read(romImage, fmapOffset + FmapHeader::SIZE + u64(i)*FmapHeader::FmapAreaHeader::SIZE))
+			{
+				fprintf(stderr, "FMAP area %u is past the end of the file\n", (u32)i);
+				return -3;
+			}
+
+			fprintf(stderr, "\t%s @0x%08x size 0x%08x bytes: ", currArea.area_name, currArea.area_offset, currArea.area_size);
+			if (!wildcardEnabled && FindInVectByName(addSections, currArea.area_name) == addSections.cend())
 			{
 				fprintf(stderr, "Skipped due to not being in addSections.\n");
 				continue;
 			}
-			if (FindInVectByName(skipSections, currArea->area_name) != skipSections.cend() && FindInVectByName(addSections, currArea->area_name) == addSections.cend())
+			if (FindInVectByName(skipSections, currArea.area_name) != skipSections.cend() && FindInVectByName(addSections, currArea.area_name) == addSections.cend())
 			{
 				fprintf(stderr, "Skipped due to being in skipSections (and not in addSections).\n");
 				continue;
 			}
 			fprintf(stderr, "Added!\n");
 
-			fprintf(outputFile, "[load:%s_%s]\n", fmapPtr->fmap_name, currArea->area_name);
-			fprintf(outputFile, "if=%s\n", cbfsFilename);
-			fprintf(outputFile, "skip=0x%08llx\n", fmapPtr->fmap_base + currArea->area_offset);
-			fprintf(outputFile, "count=0x%08x\n", currArea->area_size);
-			fprintf(outputFile, "dst=0x%08llx\n", loadStartAddress + fmapPtr->fmap_base + currArea->area_offset);
-			fprintf(outputFile, "\n");
-			fflush(outputFile);
+			const u64 areaStart = fmap.fmap_base + currArea.area_offset;
+			romLoads.push_back({ string(fmap.fmap_name) + "_" + currArea.area_name, areaStart, currArea.area_size, loadStartAddress + areaStart });
 		}
 	}
 
-	if (fileBuf.size() < sizeof(s32))
+	if (romImage.size() < sizeof(s32))
 		return -3;
 
 	cbheader cbHeader;
 	memset(&cbHeader, 0, sizeof(cbHeader));
-	const cbheader* cbHeaderPtr = nullptr;
+	u64 cbHeaderOffset = 0;
 	{
-		const s64 masterBlockOffset = *reinterpret_cast<const s32*>(&fileBuf[fileBuf.size()-sizeof(s32)]);
+		s32 masterBlockOffset32 = 0;
+		romImage.ReadLE(romImage.size()-sizeof(s32), masterBlockOffset32);
+		const s64 masterBlockOffset = masterBlockOffset32;
 		if (masterBlockOffset < 0)
-			cbHeaderPtr = reinterpret_cast<const cbheader*>(&fileBuf[u64(fileBuf.size())+masterBlockOffset]);
+			cbHeaderOffset = u64(romImage.size())+masterBlockOffset;
 		else
-			cbHeaderPtr = reinterpret_cast<const cbheader*>(&fileBuf[masterBlockOffset]);
+			cbHeaderOffset = u64(masterBlockOffset);
 
-		if (uptr(cbHeaderPtr) < uptr(&fileBuf[0]) || uptr(cbHeaderPtr) > uptr(&fileBuf[0] + fileBuf.size()))
+		if (!cbHeader.read(romImage, cbHeaderOffset))
 		{
 			fprintf(stderr, "Invalid master header offset: %lld\n", masterBlockOffset);
 			return -3;
 		}
-		if (memcmp(&cbHeaderPtr->magic, HEADER_MAGIC, sizeof(cbHeaderPtr->magic)) != 0)
+		if (memcmp(&cbHeader.magic, HEADER_MAGIC, sizeof(cbHeader.magic)) != 0)
 		{
 			fprintf(stderr, "Invalid master header magic at offset: %lld\n", masterBlockOffset);
 			return -3;
 		}
-		cbHeader.fromBigEndian(cbHeaderPtr);
 	}
 
-	if (cbHeader.offset >= fileBuf.size() || cbHeader.romsize > fileBuf.size())
+	if (cbHeader.offset >= romImage.size() || cbHeader.romsize > romImage.size() || cbHeader.align == 0)
 	{
-		fprintf(stderr, "Invalid master header extents (offset: 0x%08x romsize: 0x%08x)\n", cbHeader.offset, cbHeader.romsize);
+		fprintf(stderr, "Invalid master header extents (offset: 0x%08x romsize: 0x%08x align: 0x%08x)\n", cbHeader.offset, cbHeader.romsize, cbHeader.align);
 		return -3;
 	}
 	else
 	{
 		fprintf(stderr, "CB master header version %c.%c.%c.%c at 0x%08llx has offset: 0x%08x romsize: 0x%08x\n",
 			cbHeader.version & 0xFF, (cbHeader.version >> 8) & 0xFF, (cbHeader.version >> 16) & 0xFF, (cbHeader.version >> 24) & 0xFF,
-			u64(cbHeaderPtr), cbHeader.offset, cbHeader.romsize);
+			cbHeaderOffset, cbHeader.offset, cbHeader.romsize);
 	}
 
 	const bool wildcardEnabled = FindInVectByName(addArchives, "*") != addArchives.cend();
-	const cbfile* bootArchivePtr = nullptr;
+	bool bootArchiveFound = false;
+	cbfile bootArchive;
+	u32 bootArchiveOffset = 0;
+	string bootArchiveFilename;
 	for (u32 i=cbHeader.offset; i<cbHeader.romsize;)
 	{
-		const auto cbFilePtr = reinterpret_cast<const cbfile*>(&fileBuf[i]);
-		if (memcmp(&cbFilePtr->magic, LARCHIVE_MAGIC, sizeof(cbFilePtr->magic)) != 0)
+		cbfile cbFile;
+		if (!cbFile.read(romImage, i) || memcmp(&cbFile.magic, LARCHIVE_MAGIC, sizeof(cbFile.magic)) != 0)
 		{
 			fprintf(stderr, "Not a LARCHIVE at offset: 0x%08x of %s, are we done ?\n", i, cbfsFilename);
-			return 0;
+			return WriteRomLoads() ? 0 : -6;
+		}
+
+		string cbFilename;
+		if (cbFile.offset < cbfile::SIZE || !romImage.Contains(i, u64(cbFile.offset)+cbFile.len) ||
+			!romImage.ReadString(u64(i)+cbfile::SIZE, cbFile.offset-cbfile::SIZE, cbFilename))
+		{
+			fprintf(stderr, "Invalid LARCHIVE header at offset: 0x%08x of %s\n", i, cbfsFilename);
+			return -3;
 		}
 
-		auto cbFile = cbfile().fromBigEndian(cbFilePtr);
 		const auto areaStart = i;
 		const auto areaEnd = i+cbFile.offset+cbFile.len;
-		fprintf(stderr, "\t%s @0x%08x data: 0x%08x size 0x%08x bytes: ", cbFilePtr->filename, areaStart, areaEnd-cbFile.len, cbFile.len);		
+		fprintf(stderr, "\t%s @0x%08x data: 0x%08x size 0x%08x bytes: ", cbFilename.c_str(), areaStart, areaEnd-cbFile.len, cbFile.len);		
 		
 		i = align_up(areaEnd, cbHeader.align);
-		if (!wildcardEnabled && FindInVectByName(addArchives, cbFilePtr->filename) == addArchives.cend())
+		const bool isBootArchive = bootArchiveName != nullptr && stricmp(cbFilename.c_str(), bootArchiveName) == 0;
+		if (isBootArchive)
+		{
+			bootArchive = cbFile;
+			bootArchiveOffset = areaStart;
+			bootArchiveFilename = cbFilename;
+			if (inPlace)
+				bootArchiveFound = true; //its pieces get their own LOADs, so it can be skipped below
+		}
+
+		if (!wildcardEnabled && FindInVectByName(addArchives, cbFilename.c_str()) == addArchives.cend())
 		{
 			fprintf(stderr, "Skipped due to not being in addArchives.\n");
 			continue;
 		}
-		if (FindInVectByName(skipArchives, cbFilePtr->filename) != skipArchives.cend() && FindInVectByName(addArchives, cbFilePtr->filename) == addArchives.cend())
+		if (FindInVectByName(skipArchives, cbFilename.c_str()) != skipArchives.cend() && FindInVectByName(addArchives, cbFilename.c_str()) == addArchives.cend())
 		{
 			fprintf(stderr, "Skipped due to being in skipArchives (and not in addArchives).\n");
 			continue;
 		}
-		if (strlen(cbFilePtr->filename) == 0 && cbFile.type == COMPONENT_NULL) //padding section, can be skipped
+		if (cbFilename.empty() && cbFile.type == u32(COMPONENT_NULL)) //padding section, can be skipped
 		{
 			fprintf(stderr, "Skipped due to being an empty padding section.\n");
 			continue;
@@ -473,78 +733,117 @@ int main(int argc, char* argv[])
 
 		fprintf(stderr, "Added!\n");
 
-		fprintf(outputFile, "[load:%s]\n", cbFilePtr->filename);
-		fprintf(outputFile, "if=%s\n", cbfsFilename);
-		fprintf(outputFile, "skip=0x%08x\n", areaStart);
-		fprintf(outputFile, "count=0x%08x\n", areaEnd-areaStart);
-		fprintf(outputFile, "dst=0x%08x\n", loadStartAddress + areaStart);
-		fprintf(outputFile, "\n");
-		fflush(outputFile);
+		romLoads.push_back({ cbFilename, areaStart, areaEnd-areaStart, u64(u32(loadStartAddress + areaStart)) });
 
-		if (bootArchiveName != nullptr && stricmp(cbFilePtr->filename, bootArchiveName) == 0)
-			bootArchivePtr = cbFilePtr;
+		if (isBootArchive)
+			bootArchiveFound = true;
 	}
 
-	if (bootArchiveName != nullptr && bootArchivePtr == nullptr)
+	if (!WriteRomLoads())
+		return -6;
+
+	if (bootArchiveName != nullptr && !bootArchiveFound)
 	{
 		fprintf(stderr, "Specified archive for booting '%s' not found or skipped\n", bootArchiveName);
 		return -4;
 	}
-	if (bootArchivePtr != nullptr)
+
+	//with --in-place every piece of the boot archive is loaded straight from the rom file, compressed ones
+	//to the tail of their destination so the firmware decompresses them there, uncompressed ones to it directly
+	auto WriteCopySection = [&](const string& sectName, u32 compression, u64 dataOffset, u32 len, u64 dst, u32 memlen) -> bool
 	{
-		const u8* bootArchiveBytes = (const u8*)(bootArchivePtr);
-		auto cbFile = cbfile().fromBigEndian(bootArchivePtr);
-		if (cbFile.type == COMPONENT_STAGE)
+		const byte* data = romImage.Bytes(dataOffset, len);
+		if (data == nullptr)
 		{
-			const auto stagePtr = reinterpret_cast<const cbfs_stage*>(bootArchiveBytes + cbFile.offset);
-			const auto dataPtr = bootArchiveBytes + cbFile.offset + sizeof(cbfs_stage);
-
-			fprintf(outputFile, "[copy:%s]\n", bootArchivePtr->filename);
-			fprintf(outputFile, "type=%d\n", stagePtr->compression);
-			fprintf(outputFile, "src=0x%08llx\n", u64(loadStartAddress) + u64(dataPtr)-u64(&fileBuf[0]));
-			fprintf(outputFile, "srclen=0x%08x\n", stagePtr->len);
-			fprintf(outputFile, "dst=0x%08llx\n", stagePtr->load);
-			fprintf(outputFile, "dstlen=0x%08x\n", stagePtr->memlen);
-			fprintf(outputFile, "\n");
+			fprintf(stderr, "Data of '%s' is past the end of the file\n", sectName.c_str());
+			return false;
+		}
+
+		u64 src = u64(loadStartAddress) + dataOffset;
+		u32 margin = 0;
+		if (inPlace)
+		{
+			u32 decompLen = len;
+			if (compression != 0 && !ComputeInPlaceMargin(compression, data, len, margin, decompLen))
+			{
+				fprintf(stderr, "Can't decompress '%s' to work out its in-place margin\n", sectName.c_str());
+				return false;
+			}
+
+			const u64 srcEnd = dst + std::max(memlen, decompLen) + margin;
+			src = (compression != 0 && srcEnd >= dst + len) ? align_up(srcEnd - len, 16) : dst;
 
-			fprintf(outputFile, "[boot:%s]\n", bootArchivePtr->filename);
-			fprintf(outputFile, "pc=0x%08llx\n", stagePtr->entry);
+			if (len != 0) //a zero count would load the whole file
+			{
+				fprintf(outputFile, "[load:%s]\n", sectName.c_str());
+				fprintf(outputFile, "if=%s\n", cbfsFilename);
+				fprintf(outputFile, "skip=0x%08llx\n", dataOffset);
+				fprintf(outputFile, "count=0x%08x\n", len);
+				fprintf(outputFile, "dst=0x%08llx\n", src);
+				fprintf(outputFile, "\n");
+			}
+		}
+
+		fprintf(outputFile, "[copy:%s]\n", sectName.c_str());
+		fprintf(outputFile, "type=%d\n", compression);
+		fprintf(outputFile, "src=0x%08llx\n", src);
+		fprintf(outputFile, "srclen=0x%08x\n", len);
+		fprintf(outputFile, "dst=0x%08llx\n", dst);
+		fprintf(outputFile, "dstlen=0x%08x\n", memlen);
+		if (margin != 0)
+			fprintf(outputFile, "margin=0x%08x\n", margin);
+		fprintf(outputFile, "\n");
+		fflush(outputFile);
+		return true;
+	};
+
+	if (bootArchiveFound)
+	{
+		const u64 bootDataOffset = u64(bootArchiveOffset) + bootArchive.offset;
+		if (bootArchive.type == COMPONENT_STAGE)
+		{
+			cbfs_stage stage;
+			if (!stage.read(romImage, bootDataOffset))
+			{
+				fprintf(stderr, "Stage header of '%s' is past the end of the file\n", bootArchiveFilename.c_str());
+				return -3;
+			}
+
+			if (!WriteCopySection(bootArchiveFilename, stage.compression, bootDataOffset + cbfs_stage::SIZE, stage.len, stage.load, stage.memlen))
+				return -5;
+
+			fprintf(outputFile, "[boot:%s]\n", bootArchiveFilename.c_str());
+			fprintf(outputFile, "pc=0x%08llx\n", stage.entry);
 			fprintf(outputFile, "\n");
 			fflush(outputFile);
 		}
-		else if (cbFile.type == COMPONENT_PAYLOAD)
+		else if (bootArchive.type == COMPONENT_PAYLOAD)
 		{
-			const auto startPtr = bootArchiveBytes + cbFile.offset;
-			auto stagePtr = reinterpret_cast<const cbfs_payload_segment*>(startPtr);
-			while (uptr(stagePtr) < uptr(&fileBuf[0]+fileBuf.size()))
+			for (u64 segOffset=bootDataOffset; ; segOffset+=cbfs_payload_segment::SIZE)
 			{
-				if (stagePtr->type == PAYLOAD_SEGMENT_CODE ||
-					stagePtr->type == PAYLOAD_SEGMENT_DATA ||
-					stagePtr->type == PAYLOAD_SEGMENT_BSS ||
-					stagePtr->type == PAYLOAD_SEGMENT_PARAMS ||
-					stagePtr->type == PAYLOAD_SEGMENT_ENTRY)
+				cbfs_payload_segment stage;
+				if (!stage.read(romImage, segOffset))
+					break;
+
+				if (stage.type == PAYLOAD_SEGMENT_CODE ||
+					stage.type == PAYLOAD_SEGMENT_DATA ||
+					stage.type == PAYLOAD_SEGMENT_BSS ||
+					stage.type == PAYLOAD_SEGMENT_PARAMS ||
+					stage.type == PAYLOAD_SEGMENT_ENTRY)
 				{
-					const auto stage = cbfs_payload_segment().fromBigEndian(stagePtr);
 					if (stage.type == PAYLOAD_SEGMENT_ENTRY)
 					{
-						fprintf(outputFile, "[boot:%s]\n", bootArchivePtr->filename);
+						fprintf(outputFile, "[boot:%s]\n", bootArchiveFilename.c_str());
 						fprintf(outputFile, "pc=0x%08llx\n", stage.load_addr);
 						fprintf(outputFile, "\n");
 						fflush(outputFile);
 					}
 					else
 					{
-						fprintf(outputFile, "[copy:%s_%s]\n", bootArchivePtr->filename, (const char*)&stagePtr->type);
-						fprintf(outputFile, "type=%d\n", stage.compression);
-						fprintf(outputFile, "src=0x%08llx\n", u64(loadStartAddress) + u64(startPtr+stage.offset)-u64(&fileBuf[0]));
-						fprintf(outputFile, "srclen=0x%08x\n", stage.len);
-						fprintf(outputFile, "dst=0x%08llx\n", stage.load_addr);
-						fprintf(outputFile, "dstlen=0x%08x\n", stage.mem_len);
-						fprintf(outputFile, "\n");
-						fflush(outputFile);
+						const string sectName = bootArchiveFilename + "_" + stage.typeName();
+						if (!WriteCopySection(sectName, stage.compression, bootDataOffset+stage.offset, stage.len, stage.load_addr, stage.mem_len))
+							return -5;
 					}
-
-					stagePtr++;
 				}
 				else
 					break;
@@ -0,0 +1,70 @@
+#include "compress.h"
+#include <cstring>
+#include <lz4frame.h>
+#include <lz4hc.h>
+#include <lzma.h>
+
+static bool CompressLzma(const byte* srcData, size_t srcLen, ByteVector& outData)
+{
+	lzma_options_lzma options;
+	if (lzma_lzma_preset(&options, 9 | LZMA_PRESET_EXTREME))
+		return false;
+
+	//the preset's 64 MiB dictionary costs about 10 times that in encoder memory on every thread,
+	//but the match finder can't use more dictionary than the section has bytes
+	if (options.dict_size > srcLen)
+		options.dict_size = (srcLen > LZMA_DICT_SIZE_MIN) ? (uint32_t)srcLen : LZMA_DICT_SIZE_MIN;
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	if (lzma_alone_encoder(&strm, &options) != LZMA_OK)
+		return false;
+
+	outData.resize(srcLen + srcLen/2 + 64 * 1024);
+	strm.next_in = srcData;
+	strm.avail_in = srcLen;
+	strm.next_out = outData.data();
+	strm.avail_out = outData.size();
+	const lzma_ret ret = lzma_code(&strm, LZMA_FINISH);
+	const size_t outLen = outData.size() - strm.avail_out;
+	lzma_end(&strm);
+	if (ret != LZMA_STREAM_END)
+		return false;
+
+	//the encoder writes an unknown size with an end marker, the firmware wants the real size
+	//in the header like the Makefile's mtc tables, and then stops before the marker
+	const size_t SIZE_FIELD_OFFSET = 5;
+	const u64 decompLen = srcLen;
+	for (size_t i=0; i<sizeof(decompLen); i++)
+		outData[SIZE_FIELD_OFFSET + i] = byte(decompLen >> (8*i));
+
+	outData.resize(outLen);
+	return true;
+}
+
+static bool CompressLz4(const byte* srcData, size_t srcLen, ByteVector& outData)
+{
+	LZ4F_preferences_t prefs;
+	memset(&prefs, 0, sizeof(prefs));
+	prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+	prefs.frameInfo.blockMode = LZ4F_blockLinked;
+	prefs.frameInfo.contentSize = srcLen;
+	prefs.compressionLevel = LZ4HC_CLEVEL_MAX;
+
+	outData.resize(LZ4F_compressFrameBound(srcLen, &prefs));
+	const size_t outLen = LZ4F_compressFrame(outData.data(), outData.size(), srcData, srcLen, &prefs);
+	if (LZ4F_isError(outLen))
+		return false;
+
+	outData.resize(outLen);
+	return true;
+}
+
+bool CompressSection(u32 compType, const byte* srcData, size_t srcLen, ByteVector& outData)
+{
+	if (compType == 1)
+		return CompressLzma(srcData, srcLen, outData);
+	else if (compType == 2)
+		return CompressLz4(srcData, srcLen, outData);
+
+	return false;
+}
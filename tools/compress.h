@@ -0,0 +1,8 @@
+#pragma once
+
+#include "Types.h"
+
+//Compresses a whole section into the format the firmware decodes for that ini type= value,
+//1 for an lzma stream with its decompressed size in the header, 2 for an lz4 frame.
+//Both use the slowest, tightest settings, since they're only ever decoded. Returns false on failure.
+bool CompressSection(u32 compType, const byte* srcData, size_t srcLen, ByteVector& outData);
\ No newline at end of file
@@ -2,23 +2,99 @@
 #include "ScopeGuard.h"
 #include "RelPath.h"
 #include "Elf.h"
+#include "ImageView.h"
+#include "compress.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <fstream>
 
+//a PT_LOAD program header, in the order they appear in the file
+struct LoadSegment
+{
+	u32 index;
+	u64 offset;
+	u64 vaddr;
+	u64 filesz;
+	u64 memsz;
+};
+
+//one or more segments loaded from the payload with a single LOAD. Everything between start
+//and fileEnd is stored, everything from there up to memEnd gets zero filled.
+struct LoadRegion
+{
+	string sectName;
+	u64 start;
+	u64 fileEnd;
+	u64 memEnd;
+	vector<const LoadSegment*> segments;
+};
+
+//regions start on a sector boundary in the payload, so the firmware can read them straight to memory
+static const size_t PAYLOAD_ALIGN = 512;
+
 int main(int argc, char* argv[])
 {
 	auto PrintUsage = []() -> int
 	{
-		fprintf(stderr, "Usage: elf2ini.exe inputFile.elf [outputFile.ini]\n");
+		fprintf(stderr, "Usage: elf2ini.exe [--payload=outputFile.bin [--merge-gap=0x1000] [--compress=lz4|lzma]] inputFile.elf [outputFile.ini]\n");
+		fprintf(stderr, "\t--payload packs the file backed bytes of all segments into outputFile.bin and loads them from there,\n");
+		fprintf(stderr, "\t          with segments that are at most merge-gap bytes apart loaded together, and bss zero filled\n");
 		return -1;
 	};
 
-	if (argc < 2)
-		return PrintUsage();
+	const char* inputFilename = nullptr;
+	const char* outputFilename = nullptr;
+	const char* payloadFilename = nullptr;
+	u64 mergeGap = 0x1000;
+	u32 payloadCompType = 0;
+	for (int argIdx=1; argIdx<argc; argIdx++)
+	{
+		const char* currArg = argv[argIdx];
+		if (strncmp(currArg, "--", 2) != 0)
+		{
+			if (inputFilename == nullptr)
+				inputFilename = currArg;
+			else if (outputFilename == nullptr)
+				outputFilename = currArg;
+			else
+				return PrintUsage();
+
+			continue;
+		}
 
-	const char* inputFilename = argv[1];
-	const char* outputFilename = (argc>2) ? argv[2] : nullptr;
+		const char* theValueStr = strchr(currArg, '=');
+		if (theValueStr == nullptr)
+			return PrintUsage();
+
+		const string argName(currArg, theValueStr++);
+		if (argName == "--payload")
+			payloadFilename = theValueStr;
+		else if (argName == "--merge-gap")
+		{
+			char* matchedEnd = nullptr;
+			mergeGap = strtoull(theValueStr, &matchedEnd, 0);
+			if (matchedEnd == theValueStr || *matchedEnd != 0)
+			{
+				fprintf(stderr, "Invalid merge gap '%s'\n", theValueStr);
+				return PrintUsage();
+			}
+		}
+		else if (argName == "--compress")
+		{
+			if (stricmp(theValueStr, "lzma") == 0)
+				payloadCompType = 1;
+			else if (stricmp(theValueStr, "lz4") == 0)
+				payloadCompType = 2;
+			else
+			{
+				fprintf(stderr, "Unknown compression '%s'\n", theValueStr);
+				return PrintUsage();
+			}
+		}
+		else
+			return PrintUsage();
+	}
 
 	//check all arguments
 	if (inputFilename == nullptr || strlen(inputFilename) == 0)
@@ -27,20 +103,25 @@ int main(int argc, char* argv[])
 		return PrintUsage();
 	}
 
-	std::ifstream inFile(inputFilename, std::ios::binary);
-	if (!inFile.is_open())
+	if (payloadFilename == nullptr && payloadCompType != 0)
 	{
-		fprintf(stderr, "Error opening input filename '%s' for reading\n", inputFilename);
-		return -2;
+		fprintf(stderr, "--compress only applies to a --payload\n");
+		return PrintUsage();
 	}
 
+	ImageView inFile;
+	int retVal = inFile.Open("elf", inputFilename, false);
+	if (retVal != 0)
+		return retVal;
+
 	//check if file is valid elf of the type we want
 	{
 		Elf::HeaderBase base;
 		memset(&base, 0, sizeof(base));
-		base.deserialize(inFile);
+		ImageCursor baseCursor(inFile, 0);
+		base.deserialize(baseCursor);
 
-		if (!base.validMagic())
+		if (baseCursor.fail() || !base.validMagic())
 		{
 			fprintf(stderr, "Invalid ELF magic in '%s'\n", inputFilename);
 			return -3;
@@ -63,13 +144,18 @@ int main(int argc, char* argv[])
 			fprintf(stderr, "Invalid ELF header version in '%s'\n", inputFilename);
 			return -3;
 		}
-
-		inFile.seekg(0, std::ios::beg);
 	}
 
 	Elf::Header<64> hdr;
 	memset(&hdr, 0, sizeof(hdr));
-	hdr.deserialize(inFile);
+	ImageCursor hdrCursor(inFile, 0);
+	hdr.deserialize(hdrCursor);
+
+	if (hdrCursor.fail())
+	{
+		fprintf(stderr, "Truncated ELF header in '%s'\n", inputFilename);
+		return -3;
+	}
 
 	if (hdr.type != Elf::ET_EXEC)
 	{
@@ -106,6 +192,12 @@ int main(int argc, char* argv[])
 		fprintf(stderr, "Invalid ELF section header size in '%s'\n", inputFilename);
 		return -3;
 	}
+
+	if (!inFile.Contains(hdr.phoff, u64(hdr.phnum)*hdr.phentsize))
+	{
+		fprintf(stderr, "ELF program headers are outside of '%s'\n", inputFilename);
+		return -3;
+	}
 	
 	FILE* outputFile = nullptr;
 	if (outputFilename != nullptr && strlen(outputFilename) > 0)
@@ -125,6 +217,129 @@ int main(int argc, char* argv[])
 		}
 	});
 	
+	ImageCursor phdrCursor(inFile, hdr.phoff);
+	vector<LoadSegment> segments;
+	for (size_t i=0; i<hdr.phnum; i++)
+	{
+		Elf::ProgramHeader<64> phdr;
+		memset(&phdr, 0, sizeof(phdr));
+		phdr.deserialize(phdrCursor);
+
+		if (phdr.type != Elf::PT_LOAD)
+			continue;
+
+		if (!inFile.Contains(phdr.offset, phdr.filesz))
+		{
+			fprintf(stderr, "ELF program header %u points outside of the file\n", (u32)i);
+			return -3;
+		}
+
+		segments.push_back({ (u32)i, phdr.offset, phdr.vaddr, phdr.filesz, std::max(phdr.memsz, phdr.filesz) });
+	}
+
+	vector<LoadRegion> regions;
+	ByteVector payloadData;
+	vector<u32> regionCompTypes;
+	vector<u64> regionOffsets;
+	vector<u64> regionStoredLens;
+	if (payloadFilename != nullptr)
+	{
+		vector<const LoadSegment*> byAddr;
+		for (const auto& seg : segments)
+			byAddr.push_back(&seg);
+
+		std::stable_sort(byAddr.begin(), byAddr.end(), [](const LoadSegment* a, const LoadSegment* b) { return a->vaddr < b->vaddr; });
+		for (const LoadSegment* seg : byAddr)
+		{
+			if (!regions.empty() && seg->vaddr < regions.back().memEnd)
+			{
+				fprintf(stderr, "ELF program headers %u and %u overlap in memory\n", regions.back().segments.back()->index, seg->index);
+				return -3;
+			}
+
+			//merging only adds the zeroes in between to the payload, and a segment without
+			//file data doesn't even do that, its memory just gets zero filled with the rest
+			bool merge = false;
+			if (!regions.empty())
+			{
+				const LoadRegion& prev = regions.back();
+				merge = seg->vaddr - ((seg->filesz == 0) ? prev.memEnd : prev.fileEnd) <= mergeGap;
+			}
+
+			if (!merge)
+			{
+				char sectName[32];
+				snprintf(sectName, sizeof(sectName), "PH_%u", seg->index);
+				regions.push_back({ sectName, seg->vaddr, seg->vaddr, seg->vaddr, {} });
+			}
+			else
+			{
+				char nameSuffix[16];
+				snprintf(nameSuffix, sizeof(nameSuffix), "_%u", seg->index);
+				regions.back().sectName += nameSuffix;
+			}
+
+			LoadRegion& region = regions.back();
+			region.segments.push_back(seg);
+			if (seg->filesz > 0)
+				region.fileEnd = seg->vaddr + seg->filesz;
+
+			region.memEnd = seg->vaddr + seg->memsz;
+		}
+
+		for (auto& region : regions)
+		{
+			ByteVector regionData((size_t)(region.fileEnd - region.start), 0);
+			for (const LoadSegment* seg : region.segments)
+			{
+				if (seg->filesz > 0)
+					memcpy(&regionData[(size_t)(seg->vaddr - region.start)], inFile.Bytes(seg->offset, seg->filesz), (size_t)seg->filesz);
+			}
+
+			//zeroes at the end of the file data are cheaper to fill in than to read
+			while (!regionData.empty() && regionData.back() == 0)
+				regionData.pop_back();
+
+			region.fileEnd = region.start + regionData.size();
+
+			u32 compType = 0;
+			if (payloadCompType != 0 && !regionData.empty())
+			{
+				ByteVector packedData;
+				if (!CompressSection(payloadCompType, regionData.data(), regionData.size(), packedData))
+				{
+					fprintf(stderr, "Error compressing %s\n", region.sectName.c_str());
+					return -4;
+				}
+
+				if (packedData.size() < regionData.size())
+				{
+					compType = payloadCompType;
+					regionData = std::move(packedData);
+				}
+			}
+
+			payloadData.resize((payloadData.size() + PAYLOAD_ALIGN - 1) / PAYLOAD_ALIGN * PAYLOAD_ALIGN, 0);
+			regionCompTypes.push_back(compType);
+			regionOffsets.push_back(payloadData.size());
+			regionStoredLens.push_back(regionData.size());
+			payloadData.insert(payloadData.end(), regionData.begin(), regionData.end());
+
+			fprintf(stderr, "\t%s [0x%08llx,0x%08llx]: 0x%08llx file bytes stored in 0x%08llx, 0x%08llx zero filled\n",
+				region.sectName.c_str(), region.start, region.memEnd, region.fileEnd - region.start,
+				regionStoredLens.back(), region.memEnd - region.fileEnd);
+		}
+
+		std::ofstream payloadFile(payloadFilename, std::ios::binary);
+		payloadFile.write((const char*)payloadData.data(), payloadData.size());
+		payloadFile.close();
+		if (payloadFile.fail())
+		{
+			fprintf(stderr, "Error writing payload file '%s'\n", payloadFilename);
+			return -2;
+		}
+	}
+
 	std::string newRelativeFilename;
 	if (outputFile == nullptr)
 	{
@@ -137,23 +352,57 @@ int main(int argc, char* argv[])
 		inputFilename = newRelativeFilename.c_str();
 	}
 
-	inFile.seekg(hdr.phoff, std::ios::beg);
-	for (size_t i=0; i<hdr.phnum; i++)
+	if (payloadFilename == nullptr)
 	{
-		Elf::ProgramHeader<64> phdr;
-		memset(&phdr, 0, sizeof(phdr));
-		phdr.deserialize(inFile);
+		for (const auto& seg : segments)
+		{
+			fprintf(outputFile, "[load:PH_%u]\n", seg.index);
+			fprintf(outputFile, "if=%s\n", inputFilename);
+			fprintf(outputFile, "skip=0x%08llx\n", seg.offset);
+			fprintf(outputFile, "count=0x%08llx\n", seg.filesz);
+			fprintf(outputFile, "dst=0x%08llx\n", seg.vaddr);
+			fprintf(outputFile, "\n");
+			fflush(outputFile);
+		}
+	}
 
-		if (phdr.type != Elf::PT_LOAD)
-			continue;
+	std::string payloadRelativeFilename = (payloadFilename != nullptr) ? payloadFilename : "";
+	if (payloadFilename != nullptr && outputFile != stdout)
+		payloadRelativeFilename = GetRelativePath(payloadFilename, outputFilename);
 
-		fprintf(outputFile, "[load:PH_%u]\n", (u32)i);
-		fprintf(outputFile, "if=%s\n", inputFilename);
-		fprintf(outputFile, "skip=0x%08llx\n", (u64)phdr.offset);
-		fprintf(outputFile, "count=0x%08llx\n", (u64)phdr.filesz);
-		fprintf(outputFile, "dst=0x%08llx\n", (u64)phdr.vaddr);
-		fprintf(outputFile, "\n");
-		fflush(outputFile);
+	for (size_t i=0; i<regions.size(); i++)
+	{
+		const LoadRegion& region = regions[i];
+		if (regionStoredLens[i] > 0)
+		{
+			fprintf(outputFile, "[load:%s]\n", region.sectName.c_str());
+			fprintf(outputFile, "if=%s\n", payloadRelativeFilename.c_str());
+			if (regionCompTypes[i] != 0)
+				fprintf(outputFile, "type=%u\n", regionCompTypes[i]);
+
+			fprintf(outputFile, "skip=0x%08llx\n", regionOffsets[i]);
+			fprintf(outputFile, "count=0x%08llx\n", regionStoredLens[i]);
+			fprintf(outputFile, "dst=0x%08llx\n", region.start);
+			if (regionCompTypes[i] != 0) //the decoder zero fills the rest of dstlen itself
+				fprintf(outputFile, "dstlen=0x%08llx\n", region.memEnd - region.start);
+
+			fprintf(outputFile, "\n");
+			fflush(outputFile);
+			if (regionCompTypes[i] != 0)
+				continue;
+		}
+
+		if (region.memEnd > region.fileEnd)
+		{
+			fprintf(outputFile, "[copy:%s_BSS]\n", region.sectName.c_str());
+			fprintf(outputFile, "type=0\n");
+			fprintf(outputFile, "src=0x%08llx\n", region.fileEnd);
+			fprintf(outputFile, "srclen=0x%08x\n", 0);
+			fprintf(outputFile, "dst=0x%08llx\n", region.fileEnd);
+			fprintf(outputFile, "dstlen=0x%08llx\n", region.memEnd - region.fileEnd);
+			fprintf(outputFile, "\n");
+			fflush(outputFile);
+		}
 	}
 
 	if (hdr.entry != 0)
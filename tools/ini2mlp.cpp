@@ -0,0 +1,228 @@
+#include "Types.h"
+#include "../src/iniparse.h"
+#include "../src/mlplan.h"
+#include <cstdarg>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+
+static int PrintToStderr(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	const int retVal = vfprintf(stderr, format, args);
+	va_end(args);
+	return retVal;
+}
+
+class PlanBuilder
+{
+public:
+	PlanBuilder()
+	{
+		planBytes.resize(sizeof(MlpHeader_t));
+	}
+
+	ByteVector Build(const IniParsedInfo_t& info)
+	{
+		MlpHeader_t header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, MLPLAN_MAGIC, sizeof(header.magic));
+		header.version = MLPLAN_VERSION;
+		header.headerSize = sizeof(MlpHeader_t);
+		header.earlyMemoryFreq = info.globals.earlyMemoryFreq;
+
+		//nodes first, in list order so every next offset points forward, then all the strings
+		vector<std::pair<u32, const char*>> stringFixups;
+		auto AddString = [&stringFixups](u32 fieldOffset, const char* str) {
+			if (str != nullptr)
+				stringFixups.emplace_back(fieldOffset, str);
+		};
+
+		u32* prevNext = &header.loads;
+		for (auto nod=info.loads; nod!=nullptr; nod=nod->next)
+		{
+			MlpLoadNode_t planNode;
+			memset(&planNode, 0, sizeof(planNode));
+			planNode.skip = nod->curr.skip;
+			planNode.count = nod->curr.count;
+			planNode.dst = nod->curr.dst;
+			planNode.compType = nod->curr.compType;
+			planNode.dstlen = nod->curr.dstlen;
+			planNode.lba = nod->curr.lba;
+			planNode.sectors = nod->curr.sectors;
+			planNode.part = nod->curr.part;
+
+			const u32 nodeOffset = AppendNode(planNode, prevNext);
+			AddString(nodeOffset + offsetof(MlpLoadNode_t, sectname), nod->curr.sectname);
+			AddString(nodeOffset + offsetof(MlpLoadNode_t, filename), nod->curr.filename);
+			prevNext = nullptr;
+			lastNextOffset = nodeOffset + offsetof(MlpLoadNode_t, next);
+		}
+
+		prevNext = &header.copies;
+		for (auto nod=info.copies; nod!=nullptr; nod=nod->next)
+		{
+			MlpCopyNode_t planNode;
+			memset(&planNode, 0, sizeof(planNode));
+			planNode.compType = nod->curr.compType;
+			planNode.src = nod->curr.src;
+			planNode.srclen = nod->curr.srclen;
+			planNode.dst = nod->curr.dst;
+			planNode.dstlen = nod->curr.dstlen;
+			planNode.margin = nod->curr.margin;
+
+			const u32 nodeOffset = AppendNode(planNode, prevNext);
+			AddString(nodeOffset + offsetof(MlpCopyNode_t, sectname), nod->curr.sectname);
+			prevNext = nullptr;
+			lastNextOffset = nodeOffset + offsetof(MlpCopyNode_t, next);
+		}
+
+		prevNext = &header.boots;
+		for (auto nod=info.boots; nod!=nullptr; nod=nod->next)
+		{
+			MlpBootNode_t planNode;
+			memset(&planNode, 0, sizeof(planNode));
+			planNode.pc = nod->curr.pc;
+			planNode.codeArch = nod->curr.codeArch;
+			planNode.pwroffHoldTime = nod->curr.pwroffHoldTime;
+			planNode.maxMemoryFreq = nod->curr.maxMemoryFreq;
+
+			const u32 nodeOffset = AppendNode(planNode, prevNext);
+			AddString(nodeOffset + offsetof(MlpBootNode_t, sectname), nod->curr.sectname);
+			prevNext = nullptr;
+			lastNextOffset = nodeOffset + offsetof(MlpBootNode_t, next);
+		}
+
+		//every LOAD out of cbfs2ini has the same filename, so store each distinct string once
+		unordered_map<string, u32> stringOffsets;
+		for (const auto& fixup : stringFixups)
+		{
+			auto it = stringOffsets.find(fixup.second);
+			if (it == stringOffsets.end())
+			{
+				const size_t strSize = strlen(fixup.second) + 1;
+				it = stringOffsets.emplace(fixup.second, (u32)planBytes.size()).first;
+				planBytes.insert(planBytes.end(), (const byte*)fixup.second, (const byte*)fixup.second + strSize);
+			}
+			memcpy(&planBytes[fixup.first], &it->second, sizeof(u32));
+		}
+
+		//the loader requires a terminating zero as the very last byte
+		planBytes.resize(align_up(planBytes.size() + 1, sizeof(u32)), 0);
+		header.totalSize = (u32)planBytes.size();
+		memcpy(&planBytes[0], &header, sizeof(header));
+
+		return planBytes;
+	}
+
+private:
+	template<typename NodeType>
+	u32 AppendNode(const NodeType& planNode, u32* firstNodeOffset)
+	{
+		const u32 nodeOffset = (u32)planBytes.size();
+		if (firstNodeOffset != nullptr)
+			*firstNodeOffset = nodeOffset;
+		else
+			memcpy(&planBytes[lastNextOffset], &nodeOffset, sizeof(u32));
+
+		planBytes.insert(planBytes.end(), (const byte*)&planNode, (const byte*)&planNode + sizeof(planNode));
+		return nodeOffset;
+	}
+
+	ByteVector planBytes;
+	u32 lastNextOffset = 0;
+};
+
+int main(int argc, char* argv[])
+{
+	auto PrintUsage = []() -> int
+	{
+		fprintf(stderr, "Usage: ini2mlp.exe inputfile.ini outputfile.mlp\n");
+		return -1;
+	};
+
+	std::vector<const char*> args;
+	args.reserve(2);
+
+	for (int i=1; i<argc; i++)
+	{
+		const char* currArg = argv[i];
+		if (strncmp(currArg, "--", 2) == 0)
+		{
+			fprintf(stderr, "Unknown option '%s'\n", currArg);
+			return PrintUsage();
+		}
+		else
+			args.push_back(currArg);
+	}
+
+	if (args.size() != 2)
+	{
+		fprintf(stderr, "You must specify both input and output filename, and no more\n");
+		return PrintUsage();
+	}
+
+	const char* inputFilename = args[0];
+	const char* outputFilename = args[1];
+
+	std::ifstream inFile(inputFilename, std::ios::binary);
+	if (!inFile.is_open())
+	{
+		fprintf(stderr, "Error opening input filename '%s' for reading\n", inputFilename);
+		return -2;
+	}
+
+	string iniText;
+	inFile.seekg(0, std::ios::end);
+	iniText.resize((size_t)inFile.tellg());
+	inFile.seekg(0, std::ios::beg);
+
+	if (iniText.size() == 0)
+	{
+		fprintf(stderr, "Zero sized input file '%s'!\n", inputFilename);
+		return -2;
+	}
+
+	inFile.read(&iniText[0], iniText.size());
+	if (inFile.fail())
+	{
+		fprintf(stderr, "Error reading input file '%s'!\n", inputFilename);
+		return -2;
+	}
+	inFile.close();
+
+	ByteVector arenaBytes(memloader_ini_arena_size(iniText.c_str(), (int)iniText.size()));
+	IniArena_t arena;
+	arena.base = arenaBytes.data();
+	arena.size = arenaBytes.size();
+	arena.used = 0;
+
+	IniParsedInfo_t info = parse_memloader_ini(&iniText[0], (int)iniText.size(), &arena, PrintToStderr);
+	if (info.loads == nullptr && info.copies == nullptr && info.boots == nullptr)
+	{
+		fprintf(stderr, "No sections found in input file '%s'!\n", inputFilename);
+		return -3;
+	}
+
+	const ByteVector outputData = PlanBuilder().Build(info);
+
+	printf("Compiled %zu bytes of ini into a %zu byte plan.\n", iniText.size(), outputData.size());
+
+	std::ofstream outFile(outputFilename, std::ios::binary);
+	if (!outFile.is_open())
+	{
+		fprintf(stderr, "Error opening output filename '%s' for writing\n", outputFilename);
+		return -4;
+	}
+
+	outFile.write((const char*)&outputData[0], outputData.size());
+	if (outFile.fail())
+	{
+		fprintf(stderr, "Error writing to output file '%s'!\n", outputFilename);
+		return -4;
+	}
+	outFile.close();
+
+	return 0;
+}
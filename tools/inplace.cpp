@@ -0,0 +1,186 @@
+#include "inplace.h"
+#include <algorithm>
+#include <cstring>
+
+extern "C" {
+#include "../src/lib/lzmadecode.h"
+}
+
+static u32 ReadLE32(const byte* p)
+{
+	return u32(p[0]) | (u32(p[1]) << 8) | (u32(p[2]) << 16) | (u32(p[3]) << 24);
+}
+
+//Walks the LZ4 frame the way the firmware decoder consumes it. With the input starting at
+//outLen+margin-compLen, every block must start with the output at or before the input and
+//every sequence with at least 8 bytes between them, and no match may spill past the next
+//token (LZ4 copies 8 bytes at a time, so both write a little beyond their end).
+static bool Lz4InPlaceMargin(const byte* src, size_t srcLen, u32& outMargin, u32& outDecompLen)
+{
+	const u32 LZ4F_MAGIC = 0x184D2204;
+	const s64 WILDCOPY_LENGTH = 8;
+
+	if (srcLen < 7 || ReadLE32(src) != LZ4F_MAGIC)
+		return false;
+
+	const byte flags = src[4];
+	const bool hasBlockChecksum = (flags & (1 << 4)) != 0;
+	const bool hasContentSize = (flags & (1 << 3)) != 0;
+	const bool hasContentChecksum = (flags & (1 << 2)) != 0;
+
+	size_t inPos = 4 + 2 + (hasContentSize ? 8 : 0) + 1;
+	u64 outPos = 0;
+	s64 worstLead = 0; //largest amount the output is ahead of the input at any checked point
+	auto Check = [&](s64 slack) {
+		worstLead = std::max(worstLead, s64(outPos) + slack - s64(inPos));
+	};
+
+	while (true)
+	{
+		Check(0);
+		if (inPos + 4 > srcLen)
+			return false;
+
+		const u32 blockHeader = ReadLE32(&src[inPos]);
+		inPos += 4;
+		if (blockHeader == 0)
+			break;
+
+		const size_t blockSize = blockHeader & 0x7FFFFFFF;
+		const size_t blockEnd = inPos + blockSize;
+		if (blockEnd > srcLen)
+			return false;
+
+		Check(0);
+		if (blockHeader & 0x80000000) //stored
+		{
+			outPos += blockSize;
+			inPos = blockEnd;
+		}
+		else
+		{
+			while (inPos < blockEnd)
+			{
+				Check(WILDCOPY_LENGTH);
+
+				const byte token = src[inPos++];
+				size_t length = token >> 4;
+				if (length == 15)
+				{
+					byte s;
+					do
+					{
+						if (inPos >= blockEnd)
+							return false;
+						s = src[inPos++];
+						length += s;
+					} while (s == 255);
+				}
+				inPos += length;
+				outPos += length;
+				if (inPos >= blockEnd)
+					break; //last literals
+
+				inPos += 2; //offset
+				length = token & 15;
+				if (length == 15)
+				{
+					byte s;
+					do
+					{
+						if (inPos >= blockEnd)
+							return false;
+						s = src[inPos++];
+						length += s;
+					} while (s == 255);
+				}
+				//the match is copied 8 bytes at a time after an initial 8, all before the next token is read
+				length += 4;
+				const u64 copied = 8 + ((length > 8) ? align_up(length - 8, 8) : 8);
+				worstLead = std::max(worstLead, s64(outPos + copied) - s64(inPos));
+				outPos += length;
+			}
+			if (inPos != blockEnd)
+				return false;
+		}
+
+		if (hasBlockChecksum)
+			inPos += 4;
+	}
+	if (hasContentChecksum)
+		inPos += 4;
+
+	if (inPos > srcLen || outPos > 0xFFFFFFFF)
+		return false;
+
+	outDecompLen = u32(outPos);
+	outMargin = u32(std::max(s64(0), worstLead + s64(srcLen) - s64(outPos)));
+	return true;
+}
+
+//The firmware LZMA decoder refuses to let its output reach unread input, so decoding in place
+//with that same decoder and a given margin tells whether the margin is enough. Search for the smallest.
+static bool LzmaInPlaceMargin(const byte* src, size_t srcLen, u32& outMargin, u32& outDecompLen)
+{
+	const size_t LZMA_HEADER_SIZE = LZMA_PROPERTIES_SIZE + 8;
+	if (srcLen < LZMA_HEADER_SIZE)
+		return false;
+
+	CLzmaDecoderState state;
+	if (LzmaDecodeProperties(&state.Properties, src, LZMA_PROPERTIES_SIZE) != LZMA_RESULT_OK)
+		return false;
+
+	const u32 decompLen = ReadLE32(&src[LZMA_PROPERTIES_SIZE]);
+	if (ReadLE32(&src[LZMA_PROPERTIES_SIZE+4]) != 0) //also rejects streams of unknown size
+		return false;
+
+	vector<CProb> probs(LzmaGetNumProbs(&state.Properties));
+	state.Probs = probs.data();
+	state.InCallback = nullptr;
+
+	ByteVector buf;
+	auto DecodesInPlace = [&](size_t margin) -> bool
+	{
+		buf.assign(decompLen + margin, 0);
+		byte* inPlaceSrc = &buf[buf.size() - srcLen];
+		memcpy(inPlaceSrc, src, srcLen);
+
+		SizeT inProcessed = 0;
+		SizeT outProcessed = 0;
+		LzmaDecoderInit(&state);
+		const int res = LzmaDecode(&state, inPlaceSrc + LZMA_HEADER_SIZE, SizeT(srcLen - LZMA_HEADER_SIZE), &inProcessed,
+			buf.data(), 0, decompLen, &outProcessed);
+		return res == LZMA_RESULT_OK && outProcessed == decompLen;
+	};
+
+	//with the input entirely past the output it always works, unless the data is bad
+	size_t lo = (srcLen > decompLen) ? (srcLen - decompLen) : 0;
+	size_t hi = srcLen;
+	if (!DecodesInPlace(hi))
+		return false;
+
+	while (lo < hi)
+	{
+		const size_t mid = lo + (hi - lo) / 2;
+		if (DecodesInPlace(mid))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	//the decoder reads a whole word when the input pointer is aligned, so where the input
+	//really ends up can make the firmware's check up to 3 bytes stricter than it was here
+	outDecompLen = decompLen;
+	outMargin = u32(hi) + 3;
+	return true;
+}
+
+bool ComputeInPlaceMargin(u32 compType, const byte* compData, size_t compLen, u32& outMargin, u32& outDecompLen)
+{
+	if (compType == 1)
+		return LzmaInPlaceMargin(compData, compLen, outMargin, outDecompLen);
+	else if (compType == 2)
+		return Lz4InPlaceMargin(compData, compLen, outMargin, outDecompLen);
+	else
+		return false;
+}
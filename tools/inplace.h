@@ -0,0 +1,8 @@
+#pragma once
+
+#include "Types.h"
+
+//How many bytes the compressed data has to extend past the end of the decompressed data so the
+//firmware can decompress it in place, with the compressed data loaded at the tail of the destination.
+//compType is the same as the ini type= key (1 lzma, 2 lz4). Returns false if the data can't be decoded.
+bool ComputeInPlaceMargin(u32 compType, const byte* compData, size_t compLen, u32& outMargin, u32& outDecompLen);
@@ -1,106 +1,52 @@
 #include "Types.h"
 #include "Kip.h"
 #include "blz.h"
+#include "ParallelFor.h"
+#include "../src/lib/blzdecode.h"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdarg>
 #include <cstdio>
 #include <fstream>
+#include <thread>
 
-//from https://github.com/SciresM/hactool/blob/master/kip.c which is exactly how kernel does it, thanks SciresM!
-bool kip1_blz_uncompress(unsigned char* dataBuf, unsigned int compSize)
+enum OperationType
 {
-	u32* hdr_end = (u32*)&dataBuf[compSize];
+	OP_DECOMPRESS = 0,
+	OP_COMPRESS = 1,
+	OP_COUNT = 2
+};
 
-	u32 addl_size = hdr_end[-1];
-	u32 header_size = hdr_end[-2];
-	u32 cmp_and_hdr_size = hdr_end[-3];
+static const unsigned int KIP_NUM_SEGMENTS = sizeof(Kip::Header::Segments) / sizeof(Kip::Segment);
 
-	unsigned char* cmp_start = (unsigned char *)(hdr_end) - cmp_and_hdr_size;
-	u32 cmp_ofs = cmp_and_hdr_size - header_size;
-	u32 out_ofs = cmp_and_hdr_size + addl_size;
-
-	while (out_ofs)
-	{
-		unsigned char control = cmp_start[--cmp_ofs];
-		for (unsigned int i=0; i<8; i++)
-		{
-			if (control & 0x80)
-			{
-				if (cmp_ofs < 2)
-					return false; //out of bounds
-
-				cmp_ofs -= 2;
-				u16 seg_val = ((unsigned int)(cmp_start[cmp_ofs+1]) << 8) | cmp_start[cmp_ofs];
-				u32 seg_size = ((seg_val >> 12) & 0xF) + 3;
-				u32 seg_ofs = (seg_val & 0x0FFF) + 3;
-				if (out_ofs < seg_size) // Kernel restricts segment copy to stay in bounds.
-					seg_size = out_ofs;
-
-				out_ofs -= seg_size;
-
-				for (unsigned int j=0; j<seg_size; j++)
-					cmp_start[out_ofs + j] = cmp_start[out_ofs + j + seg_ofs];
-			}
-			else
-			{
-				// Copy directly.
-				if (cmp_ofs < 1)
-					return false; //out of bounds
-
-				cmp_start[--out_ofs] = cmp_start[--cmp_ofs];
-			}
-			control <<= 1;
-			if (out_ofs == 0) // blz works backwards, so if it reaches byte 0, it's done
-				return true;
-		}
-	}
+//one KIP1 file, read and written on the main thread, its segments (de)compressed by any of the workers
+struct KipJob
+{
+	string inputFilename;
+	string outputFilename;
+	Kip::Header header;
+	ByteVector segments[KIP_NUM_SEGMENTS];
+	bool compressedIn[KIP_NUM_SEGMENTS] = {};
+	bool compressedOut[KIP_NUM_SEGMENTS] = {};
+	string segmentLogs[KIP_NUM_SEGMENTS]; //printed in segment order once all the workers are done
+	string segmentErrors[KIP_NUM_SEGMENTS];
+	ByteVector trailingData;
+};
 
-	return true;
+static void AppendLog(string& log, const char* format, ...)
+{
+	char buffer[512];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	log += buffer;
 }
 
-int main(int argc, char* argv[])
+static int ReadKip(KipJob& job)
 {
-	auto PrintUsage = []() -> int
-	{
-		fprintf(stderr, "Usage: kip1decomp.exe d/c inputfile.kip1 outputfile.kip1\n");
-		return -1;
-	};
-
-	if (argc < 4)
-		return PrintUsage();
-
-	enum OperationType
-	{
-		OP_DECOMPRESS = 0,
-		OP_COMPRESS = 1,
-		OP_COUNT = 2
-	} opType = OP_COUNT;
-
-	const char* opTypeStr = argv[1];
-	if (strlen(opTypeStr) == 1 && opTypeStr[0] == 'd')
-		opType = OP_DECOMPRESS;
-	else if (strlen(opTypeStr) == 1 && opTypeStr[0] == 'c')
-		opType = OP_COMPRESS;
-	else
-	{
-		fprintf(stderr, "Invalid operation specified as first argument\n");
-		return PrintUsage();
-	}
-
-	const char* inputFilename = argv[2];
-	const char* outputFilename = argv[3];
-
-	//check all arguments
-	if (inputFilename == nullptr || strlen(inputFilename) == 0)
-	{
-		fprintf(stderr, "No input filename specified\n");
-		return PrintUsage();
-	}
-
-	if (outputFilename == nullptr || strlen(outputFilename) == 0)
-	{
-		fprintf(stderr, "No output filename specified\n");
-		return PrintUsage();
-	}
-
+	const char* inputFilename = job.inputFilename.c_str();
 	std::ifstream inFile(inputFilename, std::ios::binary);
 	if (!inFile.is_open())
 	{
@@ -108,7 +54,7 @@ int main(int argc, char* argv[])
 		return -2;
 	}
 
-	Kip::Header kipHeader;
+	Kip::Header& kipHeader = job.header;
 	try { kipHeader.deserialize(inFile); }
 	catch (std::exception& err)
 	{
@@ -122,14 +68,13 @@ int main(int argc, char* argv[])
 		return -2;
 	}
 
-	ByteVector segments[array_countof(kipHeader.Segments)];
-	for (unsigned int i=0; i<array_countof(segments); i++)
+	for (unsigned int i=0; i<KIP_NUM_SEGMENTS; i++)
 	{
 		bool compressed = false;
 		if (i < 3)
 			compressed = (kipHeader.Flags & (1u << i)) != 0;
 
-		ByteVector& segmentData = segments[i];
+		ByteVector& segmentData = job.segments[i];
 		const Kip::Segment& info = kipHeader.Segments[i];
 		printf("Reading segment %u compSize: %u decompSize: %u BLZ: %s...", i, info.CompSz, info.DecompSz, compressed ? "true" : "false");
 
@@ -138,41 +83,28 @@ int main(int argc, char* argv[])
 			printf("EMPTY!\n");
 			continue;
 		}
-		else if (!compressed)
+		else if (compressed && info.DecompSz < info.CompSz)
 		{
-			segmentData.resize(info.CompSz);
-			inFile.read((char*)&segmentData[0], segmentData.size());
-			if (inFile.fail())
-			{
-				printf("FAIL!\n");
-				fprintf(stderr, "Error reading decomp data for section %u from input file '%s', pos: %llu\n", i, inputFilename, (u64)inFile.tellg());
-				return -3;
-			}
-			else
-				printf("OK!\n");
+			printf("FAIL!\n");
+			fprintf(stderr, "Compressed section %u in input file '%s' is bigger than its decompressed size\n", i, inputFilename);
+			return -3;
 		}
-		else
-		{
-			segmentData.resize(info.DecompSz, 0);
-			inFile.read((char*)&segmentData[0], info.CompSz);
-			if (inFile.fail())
-			{
-				printf("FAIL!\n");
-				fprintf(stderr, "Error reading comp data for section %u from input file '%s', pos: %llu\n", i, inputFilename, (u64)inFile.tellg());
-				return -3;
-			}
 
-			if (!kip1_blz_uncompress(&segmentData[0], info.CompSz))
-			{
-				printf("FAIL!\n");
-				fprintf(stderr, "Error decompressing BLZ data for section %u from input file '%s'\n", i, inputFilename);
-				return -3;
-			}
-			printf("OK!\n");
+		//compressed segments expand in place, so they get room for the decompressed size right away
+		segmentData.resize(compressed ? info.DecompSz : info.CompSz, 0);
+		inFile.read((char*)&segmentData[0], info.CompSz);
+		if (inFile.fail())
+		{
+			printf("FAIL!\n");
+			fprintf(stderr, "Error reading %s data for section %u from input file '%s', pos: %llu\n",
+				compressed ? "comp" : "decomp", i, inputFilename, (u64)inFile.tellg());
+			return -3;
 		}
+
+		job.compressedIn[i] = compressed;
+		printf("OK!\n");
 	}
 
-	ByteVector trailingData;
 	if (!inFile.eof())
 	{
 		const auto startPos = inFile.tellg();
@@ -182,42 +114,82 @@ int main(int argc, char* argv[])
 		const auto trailingSize = endPos - startPos;
 		if (trailingSize > 0)
 		{
-			trailingData.resize((size_t)trailingSize);
+			job.trailingData.resize((size_t)trailingSize);
 			inFile.seekg(startPos, std::ios::beg);
-			inFile.read((char*)&trailingData[0], trailingData.size());
+			inFile.read((char*)&job.trailingData[0], job.trailingData.size());
 		}
 	}
 	inFile.close();
 
-	//nothing is compressed anymore
-	kipHeader.Flags &= 0xF8; 
-	//unless we compress it again
-	if (opType == OP_COMPRESS)
+	return 0;
+}
+
+//runs on a worker thread, only touches the given segment of the job
+static void ProcessSegment(KipJob& job, unsigned int i, OperationType opType)
+{
+	ByteVector& segmentData = job.segments[i];
+	string& log = job.segmentLogs[i];
+
+	if (job.compressedIn[i])
 	{
-		for (unsigned int i=0; i<3; i++)
+		AppendLog(log, "Decompressing segment %u...", i);
+		//a BLZ footer that expands to less than DecompSz would leave the rest of the segment zeroed
+		const size_t decompSize = blz_uncompress(&segmentData[0], job.header.Segments[i].CompSz, segmentData.size());
+		if (decompSize != job.header.Segments[i].DecompSz)
 		{
-			ByteVector srcData = segments[i]; //compressor modifies this
-			if (srcData.size() == 0)
-				continue;
+			AppendLog(log, "FAIL!\n");
+			AppendLog(job.segmentErrors[i], "Error decompressing BLZ data for section %u from input file '%s' (got %u bytes, header says %u)\n",
+				i, job.inputFilename.c_str(), (u32)decompSize, job.header.Segments[i].DecompSz);
+			return;
+		}
+		AppendLog(log, "OK!\n");
+	}
 
-			printf("Compressing segment %u (size: %u)...", i, (u32)srcData.size());
-			ByteVector compData = BLZ_Code(&srcData[0], (int)srcData.size(), true);
-			printf("%u bytes.", (u32)compData.size());
-			if (compData.size() < srcData.size())
-			{
-				segments[i] = compData;
-				kipHeader.Flags |= (1u << i) & 0x7;
-				printf("Using COMPRESSED.\n");
-			}
-			else
-				printf("Using DECOMPRESSED.\n");
+	if (opType != OP_COMPRESS || i >= 3 || segmentData.size() == 0)
+		return;
+
+	ByteVector srcData = segmentData; //compressor modifies this
+	AppendLog(log, "Compressing segment %u (size: %u)...", i, (u32)srcData.size());
+	ByteVector compData = BLZ_Code(&srcData[0], (int)srcData.size(), true);
+	AppendLog(log, "%u bytes.", (u32)compData.size());
+	if (compData.size() < srcData.size())
+	{
+		//round trip through the same decoder the firmware uses, so what gets written is known to expand back
+		ByteVector checkData(srcData.size());
+		memcpy(&checkData[0], &compData[0], compData.size());
+		if (blz_uncompress(&checkData[0], compData.size(), checkData.size()) != checkData.size() ||
+			memcmp(&checkData[0], &segmentData[0], checkData.size()) != 0)
+		{
+			AppendLog(log, "FAIL!\n");
+			AppendLog(job.segmentErrors[i], "Compressed segment %u doesn't decompress back to the original\n", i);
+			return;
 		}
+
+		segmentData = std::move(compData);
+		job.compressedOut[i] = true;
+		AppendLog(log, "Using COMPRESSED.\n");
+	}
+	else
+		AppendLog(log, "Using DECOMPRESSED.\n");
+}
+
+static int WriteKip(KipJob& job)
+{
+	Kip::Header& kipHeader = job.header;
+
+	//nothing is compressed anymore, unless we compressed it again
+	kipHeader.Flags &= 0xF8;
+	for (unsigned int i=0; i<3; i++)
+	{
+		if (job.compressedOut[i])
+			kipHeader.Flags |= (1u << i);
 	}
 
 	//update the file size of all the sections
-	for (unsigned int i=0; i<array_countof(segments); i++)
-		kipHeader.Segments[i].CompSz = (unsigned int)segments[i].size();
+	for (unsigned int i=0; i<KIP_NUM_SEGMENTS; i++)
+		kipHeader.Segments[i].CompSz = (unsigned int)job.segments[i].size();
 
+	const char* outputFilename = job.outputFilename.c_str();
 	std::ofstream outFile(outputFilename, std::ios::binary);
 	if (!outFile.is_open())
 	{
@@ -229,9 +201,9 @@ int main(int argc, char* argv[])
 	outFile.write((const char*)&kipHeader, sizeof(kipHeader));
 	if (outFile.fail()) { printf("FAIL!\n"); return -4; } else { printf("OK!\n"); }
 
-	for (unsigned int i=0; i<array_countof(segments); i++)
+	for (unsigned int i=0; i<KIP_NUM_SEGMENTS; i++)
 	{
-		const ByteVector& segmentData = segments[i];
+		const ByteVector& segmentData = job.segments[i];
 		if (segmentData.size() == 0)
 			continue;
 
@@ -240,14 +212,232 @@ int main(int argc, char* argv[])
 		if (outFile.fail()) { printf("FAIL!\n"); return -4; } else { printf("OK!\n"); }
 	}
 
-	if (trailingData.size() > 0)
+	if (job.trailingData.size() > 0)
 	{
-		printf("Writing trailing data (size: %u) to file @%llu...", (u32)trailingData.size(), (u64)outFile.tellp());
-		outFile.write((const char*)&trailingData[0], trailingData.size());
+		printf("Writing trailing data (size: %u) to file @%llu...", (u32)job.trailingData.size(), (u64)outFile.tellp());
+		outFile.write((const char*)&job.trailingData[0], job.trailingData.size());
 		if (outFile.fail()) { printf("FAIL!\n"); return -4; }
 		else { printf("OK!\n"); }
 	}
 
 	outFile.close();
 	return 0;
-}
\ No newline at end of file
+}
+
+//a directory means every .kip1/.kip file in it, @file means one input path per line of that file
+static bool AddBatchInputs(vector<string>& inputs, const char* arg)
+{
+	namespace fs=boost::filesystem;
+	if (arg[0] == '@')
+	{
+		std::ifstream listFile(&arg[1]);
+		if (!listFile.is_open())
+		{
+			fprintf(stderr, "Error opening list file '%s' for reading\n", &arg[1]);
+			return false;
+		}
+
+		string line;
+		while (std::getline(listFile, line))
+		{
+			while (line.size() > 0 && isspace((unsigned char)line.back()))
+				line.pop_back();
+			if (line.size() > 0)
+				inputs.push_back(line);
+		}
+		return true;
+	}
+
+	boost::system::error_code ec;
+	if (!fs::is_directory(arg, ec))
+	{
+		inputs.push_back(arg);
+		return true;
+	}
+
+	vector<string> dirInputs;
+	for (fs::directory_iterator it(arg, ec), end; !ec && it != end; it.increment(ec))
+	{
+		const string ext = it->path().extension().string();
+		if (fs::is_regular_file(it->status()) && (stricmp(ext.c_str(), ".kip1") == 0 || stricmp(ext.c_str(), ".kip") == 0))
+			dirInputs.push_back(it->path().string());
+	}
+	if (ec)
+	{
+		fprintf(stderr, "Error listing directory '%s': %s\n", arg, ec.message().c_str());
+		return false;
+	}
+
+	std::sort(dirInputs.begin(), dirInputs.end());
+	inputs.insert(inputs.end(), dirInputs.begin(), dirInputs.end());
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	namespace fs=boost::filesystem;
+	auto PrintUsage = []() -> int
+	{
+		fprintf(stderr, "Usage: kip1decomp.exe d/c [--threads=N] inputfile.kip1 outputfile.kip1\n");
+		fprintf(stderr, "       kip1decomp.exe d/c [--threads=N] --batch=outputdir (inputfile.kip1 | inputdir | @listfile)...\n");
+		fprintf(stderr, "--threads defaults to the number of hardware threads, 1 processes everything in order\n");
+		return -1;
+	};
+
+	if (argc < 4)
+		return PrintUsage();
+
+	OperationType opType = OP_COUNT;
+	const char* opTypeStr = argv[1];
+	if (strlen(opTypeStr) == 1 && opTypeStr[0] == 'd')
+		opType = OP_DECOMPRESS;
+	else if (strlen(opTypeStr) == 1 && opTypeStr[0] == 'c')
+		opType = OP_COMPRESS;
+	else
+	{
+		fprintf(stderr, "Invalid operation specified as first argument\n");
+		return PrintUsage();
+	}
+
+	unsigned int numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	const char* batchDir = nullptr;
+	vector<const char*> args;
+	for (int i=2; i<argc; i++)
+	{
+		const char* currArg = argv[i];
+		if (strnicmp(currArg, "--threads=", strlen("--threads=")) == 0)
+		{
+			const char* valueStr = &currArg[strlen("--threads=")];
+			char* valueEnd = nullptr;
+			numThreads = strtoul(valueStr, &valueEnd, 0);
+			if (valueEnd == valueStr || *valueEnd != 0 || numThreads == 0)
+			{
+				fprintf(stderr, "Invalid thread count '%s'\n", valueStr);
+				return PrintUsage();
+			}
+		}
+		else if (strnicmp(currArg, "--batch=", strlen("--batch=")) == 0)
+			batchDir = &currArg[strlen("--batch=")];
+		else if (strncmp(currArg, "--", 2) == 0)
+		{
+			fprintf(stderr, "Unknown option '%s'\n", currArg);
+			return PrintUsage();
+		}
+		else
+			args.push_back(currArg);
+	}
+
+	vector<KipJob> jobs;
+	if (batchDir == nullptr)
+	{
+		if (args.size() != 2)
+		{
+			fprintf(stderr, "You must specify both input and output filename, and no more\n");
+			return PrintUsage();
+		}
+
+		jobs.resize(1);
+		jobs[0].inputFilename = args[0];
+		jobs[0].outputFilename = args[1];
+	}
+	else
+	{
+		if (strlen(batchDir) == 0 || args.size() == 0)
+		{
+			fprintf(stderr, "Batch mode needs an output directory and at least one input\n");
+			return PrintUsage();
+		}
+
+		vector<string> inputs;
+		for (const char* arg : args)
+		{
+			if (!AddBatchInputs(inputs, arg))
+				return -2;
+		}
+
+		boost::system::error_code ec;
+		fs::create_directories(batchDir, ec);
+		if (ec)
+		{
+			fprintf(stderr, "Error creating output directory '%s': %s\n", batchDir, ec.message().c_str());
+			return -4;
+		}
+
+		//outputs keep their input's name, so two inputs of the same name would overwrite each other
+		jobs.resize(inputs.size());
+		for (size_t i=0; i<inputs.size(); i++)
+		{
+			jobs[i].inputFilename = inputs[i];
+			jobs[i].outputFilename = (fs::path(batchDir) / fs::path(inputs[i]).filename()).string();
+			for (size_t j=0; j<i; j++)
+			{
+				if (fs::path(jobs[j].outputFilename) == fs::path(jobs[i].outputFilename))
+				{
+					fprintf(stderr, "Inputs '%s' and '%s' would both be written to '%s'\n",
+						inputs[j].c_str(), inputs[i].c_str(), jobs[i].outputFilename.c_str());
+					return -2;
+				}
+			}
+		}
+	}
+
+	int retVal = 0;
+	vector<bool> jobOk(jobs.size(), false);
+	vector<pair<size_t, unsigned int>> work;
+	for (size_t j=0; j<jobs.size(); j++)
+	{
+		if (batchDir != nullptr)
+			printf("Reading '%s'\n", jobs[j].inputFilename.c_str());
+
+		const int readResult = ReadKip(jobs[j]);
+		if (readResult != 0)
+		{
+			if (retVal == 0)
+				retVal = readResult;
+			continue;
+		}
+
+		jobOk[j] = true;
+		for (unsigned int i=0; i<KIP_NUM_SEGMENTS; i++)
+		{
+			if (jobs[j].segments[i].size() > 0)
+				work.emplace_back(j, i);
+		}
+	}
+
+	//biggest segments first, so a big .text doesn't start last and keep everyone waiting
+	if (numThreads > 1)
+		std::stable_sort(work.begin(), work.end(), [&jobs](const pair<size_t, unsigned int>& a, const pair<size_t, unsigned int>& b) {
+			return jobs[a.first].segments[a.second].size() > jobs[b.first].segments[b.second].size();
+		});
+	ParallelFor(work.size(), numThreads, [&](size_t w) {
+		ProcessSegment(jobs[work[w].first], work[w].second, opType);
+	});
+
+	for (size_t j=0; j<jobs.size(); j++)
+	{
+		if (!jobOk[j])
+			continue;
+
+		KipJob& job = jobs[j];
+		if (batchDir != nullptr)
+			printf("Writing '%s'\n", job.outputFilename.c_str());
+
+		bool failed = false;
+		for (unsigned int i=0; i<KIP_NUM_SEGMENTS; i++)
+		{
+			printf("%s", job.segmentLogs[i].c_str());
+			if (job.segmentErrors[i].size() > 0)
+			{
+				fprintf(stderr, "%s", job.segmentErrors[i].c_str());
+				failed = true;
+			}
+		}
+
+		const int jobResult = failed ? -3 : WriteKip(job);
+		if (jobResult != 0 && retVal == 0)
+			retVal = jobResult;
+	}
+
+	return retVal;
+}